@@ -1,7 +1,18 @@
 #version 430 core
 #extension GL_ARB_shading_language_include : require
 
+/* Variant specialization, defined by ShaderVariants. The generic kernel reads SAMPLES and
+   MAX_DEPTH from uniforms and compiles in every material and primitive type. */
+#ifndef VARIANT_MATERIALS
+#define VARIANT_MATERIALS 0xF    // bit 1 << MAT_* for each material type present
+#endif
+#ifndef VARIANT_PRIMITIVES
+#define VARIANT_PRIMITIVES 0x7   // bit 1 << HITTABLE_* for each primitive type present
+#endif
+
 layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+const uint GROUP_WIDTH = 16;
+const uint GROUP_SIZE  = GROUP_WIDTH * GROUP_WIDTH;
 
 // Output image texture, bound to image unit 0
 layout(rgba32f, binding = 0) uniform image2D imgOutput;
@@ -16,11 +27,45 @@ const float pi = 3.14159265358979323846;
 vec3   defocus_disk_u;       // Disk X basis for defocus
 vec3   defocus_disk_v;       // Disk Y basis for defocus
 float iSeed;
+int iBounces;                // Bounces traced by this invocation, for the group stats
+uint iSample;                // Sample of the pixel being traced, for sample_float()
+uint iDepth;                 // Bounce of the path being traced, 0 for the camera ray
+
+// Dispatch modes in uDispatchMode, must match Dispatch_Mode in Dispatcher.h
+const int DISPATCH_TILES      = 0; // one 16x16 pixel tile per workgroup
+const int DISPATCH_PERSISTENT = 1; // device filling groups pull batches of tiles from nextWorkItem
+
+shared uint sBatchStart;
+shared uint sGroupItems;
+shared uint sGroupBounces;
 
 /* Forward Uniforms */
+#ifdef VARIANT_MAX_DEPTH
+const int MAX_DEPTH = VARIANT_MAX_DEPTH;
+#else
 uniform int MAX_DEPTH;
+#endif
+uniform int uRouletteDepth;  // Bounces before Russian roulette starts, MAX_DEPTH turns it off
 uniform int uSphereCount;
+uniform int uCubeCount;
+uniform int uPlaneCount;
+uniform int uAccel;
+uniform vec3 uGridMin;
+uniform vec3 uGridMax;
+uniform ivec3 uGridRes;
+uniform ivec4 uGridEscape;
 uniform int uMaterialsCount;
+uniform int uLightCount;
+uniform int uLightSampling;   // LIGHT_SAMPLING_UNIFORM or LIGHT_SAMPLING_TREE
+uniform float uSkyIntensity;
+uniform bool uUniformSky;     // White furnace: constant sky of 1
+uniform int uDispatchMode;
+uniform int uBatchSize;      // Tiles fetched per group at a time in DISPATCH_PERSISTENT
+uniform bool uCollectStats;
+uniform int uRowCount;       // Rows [0, uRowCount) are traced, the rest belong to the CPU in hybrid frames
+uniform float uSeed; // Time used for random value seeding
+uniform bool uDeterministic; // Counter based random numbers seeded by uSeedBits
+uniform uint uSeedBits;      // CPUTracer::m_Seed, so both tracers draw the same numbers
 
 ivec2 pixel_coords; // replaces gl_fragcoords;
 
@@ -30,7 +75,12 @@ ivec2 pixel_coords; // replaces gl_fragcoords;
 #include "/camera.glsl"
 #include "/aabb.glsl"
 #include "/sphere.glsl"
+#include "/plane.glsl"
+#include "/grid.glsl"
+#include "/scene.glsl"
+#include "/bsdf.glsl"
 #include "/material.glsl"
+#include "/light.glsl"
 #include "/ray.glsl"
 
 
@@ -39,22 +89,19 @@ ivec2 pixel_coords; // replaces gl_fragcoords;
 /* Uniforms */
 uniform Camera cam;
 
-uniform float uSeed; // Time used for random value seeding
 uniform int SCR_WIDTH;
 uniform int SCR_HEIGHT;
+#ifdef VARIANT_SAMPLES
+const int SAMPLES = VARIANT_SAMPLES;
+#else
 uniform int SAMPLES;
+#endif
 
-void main() {
+// Trace all samples of pixel_coords and store the result
+void render_pixel() {
 
-    // Get the pixel coordinates for this thread ( use global invocation ID )
-    pixel_coords = ivec2(gl_GlobalInvocationID.xy);
     ivec2 resolution = ivec2(SCR_WIDTH, SCR_HEIGHT);
 
-    // Stop if we're outside the screen dimensions
-    if (pixel_coords.x >= resolution.x || pixel_coords.y >= resolution.y) {
-        return;
-    }
-
     vec3 pixel_color = vec3(0.0);
     iSeed = uSeed;
 
@@ -65,16 +112,17 @@ void main() {
 
         //Update iteration seed
         iSeed += i;
+        iSample = uint(i);
+        iDepth = 0u;
 
         // 1) Create a seed for jitter vec generation
         float fi = float(i);
         vec2 seed = pixel_coords.xy + vec2(iSeed + fi, iSeed - fi);
 
         // 2) Create jitter offset for anti-aliasing [-0.5, 0.5]
-        vec2 jitter = vec2(
-            random_float(seed + vec2(1.0,0.0)),
-            random_float(seed + vec2(0.0,1.0))
-        ) - 0.5;
+        vec2 jitter = uDeterministic
+            ? vec2(sample_float(DIM_JITTER), sample_float(DIM_JITTER + 1u)) - 0.5
+            : vec2(random_float(seed + vec2(1.0,0.0)), random_float(seed + vec2(0.0,1.0))) - 0.5;
 
         // 3) Set pixel coords with offset for current sample
         vec2 pixel_coords = vec2(pixel_coords.xy) + jitter;
@@ -103,3 +151,69 @@ void main() {
 
 }
 
+void main() {
+
+    uint local_index = gl_LocalInvocationIndex;
+    if (local_index == 0) {
+        sGroupItems = 0;
+        sGroupBounces = 0;
+    }
+    barrier();
+
+    int items = 0;
+    iBounces = 0;
+
+    if (uDispatchMode == DISPATCH_PERSISTENT) {
+
+        // Work items are pixels in 16x16 tile order, so one batch covers whole tiles
+        uint tiles_x = uint(SCR_WIDTH + GROUP_WIDTH - 1) / GROUP_WIDTH;
+        uint tiles_y = uint(uRowCount + GROUP_WIDTH - 1) / GROUP_WIDTH;
+        uint total_items = tiles_x * tiles_y * GROUP_SIZE;
+        uint batch_items = GROUP_SIZE * uint(uBatchSize);
+
+        // Keep pulling batches until the frame is done, the exit test is uniform per group
+        while (true) {
+            if (local_index == 0)
+                sBatchStart = atomicAdd(nextWorkItem, batch_items);
+            barrier();
+            uint batch_start = sBatchStart;
+            barrier();
+
+            if (batch_start >= total_items)
+                break;
+
+            for (uint k = 0; k < uint(uBatchSize); ++k) {
+                uint item = batch_start + k * GROUP_SIZE + local_index;
+                uint tile = item / GROUP_SIZE;
+                uint in_tile = item % GROUP_SIZE;
+                pixel_coords = ivec2((tile % tiles_x) * GROUP_WIDTH + in_tile % GROUP_WIDTH,
+                                     (tile / tiles_x) * GROUP_WIDTH + in_tile / GROUP_WIDTH);
+
+                if (item < total_items && pixel_coords.x < SCR_WIDTH && pixel_coords.y < uRowCount) {
+                    render_pixel();
+                    items++;
+                }
+            }
+        }
+    }
+    else {
+
+        // One 16x16 tile per workgroup
+        pixel_coords = ivec2(gl_GlobalInvocationID.xy);
+        if (pixel_coords.x < SCR_WIDTH && pixel_coords.y < uRowCount) {
+            render_pixel();
+            items++;
+        }
+    }
+
+    // Per group totals for the profiler, no thread returns early so the barrier is safe
+    if (uCollectStats) {
+        atomicAdd(sGroupItems, uint(items));
+        atomicAdd(sGroupBounces, uint(iBounces));
+        barrier();
+
+        uint group = gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+        if (local_index == 0)
+            groupStats[group] = uvec2(sGroupItems, sGroupBounces);
+    }
+}
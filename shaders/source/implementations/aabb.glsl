@@ -1,9 +1,66 @@
 
 
 #include "/aabb.glsl_h"
+#include "/sphere.glsl_h"
+#include "/ray.glsl_h"
 
-float temp_func(Interval ins){
-	return ins.min + 1.0f;
+bool hit_aabb(Ray r, vec3 box_min, vec3 box_max, Interval ray_t, out float t_enter, out float t_exit) {
+
+    // Division by zero gives +-inf which the min/max below handle correctly
+    vec3 inv_dir = 1.0 / r.direction;
+    vec3 t0 = (box_min - r.origin) * inv_dir;
+    vec3 t1 = (box_max - r.origin) * inv_dir;
+
+    vec3 t_small = min(t0, t1);
+    vec3 t_big   = max(t0, t1);
+
+    t_enter = max(max(t_small.x, t_small.y), t_small.z);
+    t_exit  = min(min(t_big.x, t_big.y), t_big.z);
+
+    return t_enter <= t_exit && t_exit > ray_t.min && t_enter < ray_t.max;
 }
 
+bool intersectCube(Ray r, Interval ray_t, out float t, int index) {
+
+        vec3 box_min = inCubes[index].min_pad.xyz;
+        vec3 box_max = inCubes[index].max_matId.xyz;
+
+        float t_enter, t_exit;
+        if (!hit_aabb(r, box_min, box_max, ray_t, t_enter, t_exit))
+            return false;
+
+        // Entry point when outside the box, exit point when inside it
+        float root = t_enter;
+        if (!surrounds(ray_t, root)) {
+            root = t_exit;
+            if (!surrounds(ray_t, root))
+                return false;
+        }
+
+        t = root;
+        return true;
+}
+
+void cube_hit_record(Ray r, int index, inout hit_record rec) {
+
+        vec3 box_min = inCubes[index].min_pad.xyz;
+        vec4 max_matId = inCubes[index].max_matId;
+
+        // The face hit is the axis on which the point is furthest from the center
+        vec3 center    = 0.5 * (box_min + max_matId.xyz);
+        vec3 half_size = 0.5 * (max_matId.xyz - box_min);
+        vec3 local     = (rec.point - center) / half_size;
+        vec3 a         = abs(local);
+
+        vec3 outward_normal;
+        if (a.x > a.y && a.x > a.z)
+            outward_normal = vec3(sign(local.x), 0.0, 0.0);
+        else if (a.y > a.z)
+            outward_normal = vec3(0.0, sign(local.y), 0.0);
+        else
+            outward_normal = vec3(0.0, 0.0, sign(local.z));
+
+        set_face_normal(r, rec, outward_normal);
+        rec.matId = int(max_matId.w + 0.5);
+}
 
@@ -0,0 +1,143 @@
+#include "/bsdf.glsl_h"
+#include "/material.glsl_h"
+#include "/utilities.glsl_h"
+
+// Schlick's Fresnel with the metal color as reflectance at normal incidence
+vec3 fresnel_schlick(vec3 f0, float cos_theta) {
+    float m = 1.0 - min(max(cos_theta, 0.0), 1.0);
+    return f0 + (1.0 - f0) * (m * m * m * m * m);
+}
+
+// Local frame around n, z = n
+vec3 to_local(vec3 v, vec3 t, vec3 b, vec3 n) {
+    return vec3(dot(v, t), dot(v, b), dot(v, n));
+}
+
+float ggx_alpha(in Material mat) {
+    return mat.fuzz * mat.fuzz;
+}
+
+vec3 sample_cosine_hemisphere(vec2 u) {
+    float r = sqrt(u.x);
+    float phi = 2.0 * pi * u.y;
+    return vec3(r * cos(phi), r * sin(phi), sqrt(max(0.0, 1.0 - u.x)));
+}
+
+float ggx_D(vec3 h, float alpha) {
+    float a2 = alpha * alpha;
+    float d = h.z * h.z * (a2 - 1.0) + 1.0;
+    return a2 / (pi * d * d);
+}
+
+float ggx_lambda(vec3 v, float alpha) {
+    float tan2 = (v.x * v.x + v.y * v.y) / max(v.z * v.z, 1e-12);
+    return 0.5 * (sqrt(1.0 + alpha * alpha * tan2) - 1.0);
+}
+
+vec3 sample_ggx_vndf(vec3 wo, float alpha, vec2 u) {
+
+    // Stretch to the hemisphere configuration, sample the spherical cap, unstretch
+    vec3 wo_std = normalize(vec3(wo.xy * alpha, wo.z));
+    float phi = 2.0 * pi * u.x;
+    float z = (1.0 - u.y) * (1.0 + wo_std.z) - wo_std.z;
+    float sin_theta = sqrt(max(1.0 - z * z, 0.0));
+    vec3 h_std = vec3(sin_theta * cos(phi), sin_theta * sin(phi), z) + wo_std;
+    return normalize(vec3(h_std.xy * alpha, max(h_std.z, 0.0)));
+}
+
+bool bsdf_is_delta(in Material mat) {
+    if (mat.type == MAT_METAL)
+        return ggx_alpha(mat) < GGX_MIN_ALPHA;
+    return mat.type != MAT_LAMBERTIAN;
+}
+
+vec3 bsdf_eval(in Material mat, vec3 n, vec3 wo, vec3 wi) {
+
+    vec3 t, b;
+    make_basis(n, t, b);
+    vec3 lo = to_local(wo, t, b, n);
+    vec3 li = to_local(wi, t, b, n);
+    if (lo.z <= 0.0 || li.z <= 0.0 || bsdf_is_delta(mat))
+        return vec3(0.0);
+
+    if (mat.type == MAT_LAMBERTIAN)
+        return mat.albedo / pi * li.z;
+
+#if HAS_METAL
+    // GGX with height correlated Smith masking: F D G2 / (4 cos_o cos_i), times cos_i
+    float alpha = ggx_alpha(mat);
+    vec3 h = normalize(lo + li);
+    float G2 = 1.0 / (1.0 + ggx_lambda(lo, alpha) + ggx_lambda(li, alpha));
+    return fresnel_schlick(mat.albedo, dot(li, h)) * ggx_D(h, alpha) * G2 / (4.0 * lo.z);
+#else
+    return vec3(0.0);
+#endif
+}
+
+float bsdf_pdf(in Material mat, vec3 n, vec3 wo, vec3 wi) {
+
+    vec3 t, b;
+    make_basis(n, t, b);
+    vec3 lo = to_local(wo, t, b, n);
+    vec3 li = to_local(wi, t, b, n);
+    if (lo.z <= 0.0 || li.z <= 0.0 || bsdf_is_delta(mat))
+        return 0.0;
+
+    if (mat.type == MAT_LAMBERTIAN)
+        return li.z / pi;
+
+#if HAS_METAL
+    // Visible normal density D_wo(h) = G1(wo) D(h) max(0, wo.h) / cos_o, times the
+    // reflection jacobian 1 / (4 wo.h)
+    float alpha = ggx_alpha(mat);
+    vec3 h = normalize(lo + li);
+    float G1 = 1.0 / (1.0 + ggx_lambda(lo, alpha));
+    return G1 * ggx_D(h, alpha) / (4.0 * lo.z);
+#else
+    return 0.0;
+#endif
+}
+
+bool bsdf_sample(in Material mat, vec3 n, vec3 wo, vec2 u, out vec3 wi, out vec3 weight, out float pdf) {
+
+    vec3 t, b;
+    make_basis(n, t, b);
+    vec3 lo = to_local(wo, t, b, n);
+
+    // Grazing hits can see the surface from slightly below
+    lo.z = max(lo.z, 1e-4);
+
+    vec3 li;
+    if (mat.type == MAT_LAMBERTIAN) {
+        li = sample_cosine_hemisphere(u);
+        weight = mat.albedo;
+        pdf = li.z / pi;
+    }
+    else if (bsdf_is_delta(mat)) {
+        li = vec3(-lo.xy, lo.z);
+        weight = fresnel_schlick(mat.albedo, lo.z);
+        pdf = 0.0;
+    }
+#if HAS_METAL
+    else {
+        float alpha = ggx_alpha(mat);
+        vec3 h = sample_ggx_vndf(lo, alpha, u);
+        li = reflect(-lo, h);
+        if (li.z <= 0.0)
+            return false;
+
+        // F G2 / G1, D and the jacobian cancel against the pdf
+        float lambda_o = ggx_lambda(lo, alpha);
+        float G1 = 1.0 / (1.0 + lambda_o);
+        float G2 = 1.0 / (1.0 + lambda_o + ggx_lambda(li, alpha));
+        weight = fresnel_schlick(mat.albedo, dot(li, h)) * (G2 / G1);
+        pdf = G1 * ggx_D(h, alpha) / (4.0 * lo.z);
+    }
+#else
+    else
+        return false;
+#endif
+
+    wi = normalize(li.x * t + li.y * b + li.z * n);
+    return true;
+}
@@ -0,0 +1,102 @@
+
+
+#include "/grid.glsl_h"
+#include "/scene.glsl_h"
+#include "/sphere.glsl_h"
+#include "/aabb.glsl_h"
+#include "/ray.glsl_h"
+
+bool hit_cell(Ray r, ivec4 cell, inout Interval ray_t, inout int prim_id, bool any_hit) {
+
+    bool hit_anything = false;
+    float t;
+
+    // Cell ranges are grouped by type like the primitive table
+    int sphere_end = cell.x + cell.y;
+#if HAS_SPHERES
+    for (int i = cell.x; i < sphere_end; ++i) {
+        int id = inCellPrims[i];
+        if (intersectSphere(r, ray_t, t, inHittables[id].index)) {
+            ray_t.max = t;
+            prim_id = id;
+            hit_anything = true;
+            if (any_hit)
+                return true;
+        }
+    }
+#endif
+
+#if HAS_CUBES
+    for (int i = sphere_end; i < sphere_end + cell.z; ++i) {
+        int id = inCellPrims[i];
+        if (intersectCube(r, ray_t, t, inHittables[id].index)) {
+            ray_t.max = t;
+            prim_id = id;
+            hit_anything = true;
+            if (any_hit)
+                return true;
+        }
+    }
+#endif
+
+    return hit_anything;
+}
+
+bool hit_grid(Ray r, inout Interval ray_t, out int prim_id, bool any_hit) {
+
+    prim_id = -1;
+
+    // Oversized primitives live outside the grid
+    if (hit_cell(r, uGridEscape, ray_t, prim_id, any_hit) && any_hit)
+        return true;
+
+    float t_enter, t_exit;
+    if (!hit_aabb(r, uGridMin, uGridMax, ray_t, t_enter, t_exit))
+        return prim_id >= 0;
+
+    // Starting cell
+    vec3 cell_size = (uGridMax - uGridMin) / vec3(uGridRes);
+    vec3 start = ray_at(r, max(t_enter, ray_t.min));
+    // min/max instead of clamp, the clamp(Interval, float) overload hides the builtin on some compilers
+    ivec3 cell = min(max(ivec3(floor((start - uGridMin) / cell_size)), ivec3(0)), uGridRes - 1);
+
+    // Distance to the next cell boundary on each axis and between boundaries,
+    // axes the ray is parallel to are never crossed
+    ivec3 step = ivec3(sign(r.direction));
+    bvec3 moves = notEqual(step, ivec3(0));
+    vec3 inv_dir = 1.0 / r.direction;
+    vec3 next_boundary = uGridMin + (vec3(cell) + vec3(greaterThan(step, ivec3(0)))) * cell_size;
+    vec3 t_max   = mix(vec3(POS_MAX), (next_boundary - r.origin) * inv_dir, moves);
+    vec3 t_delta = mix(vec3(POS_MAX), abs(cell_size * inv_dir), moves);
+
+    while (true) {
+
+        if (hit_cell(r, inCells[cell.x + uGridRes.x * (cell.y + uGridRes.y * cell.z)], ray_t, prim_id, any_hit) && any_hit)
+            break;
+
+        // A hit before the cell exit cannot be beaten by later cells
+        float t_cell_exit = min(min(t_max.x, t_max.y), t_max.z);
+        if (ray_t.max <= t_cell_exit)
+            break;
+
+        // Step along the axis with the closest boundary
+        if (t_max.x < t_max.y && t_max.x < t_max.z) {
+            cell.x += step.x;
+            if (cell.x < 0 || cell.x >= uGridRes.x) break;
+            t_max.x += t_delta.x;
+        }
+        else if (t_max.y < t_max.z) {
+            cell.y += step.y;
+            if (cell.y < 0 || cell.y >= uGridRes.y) break;
+            t_max.y += t_delta.y;
+        }
+        else {
+            cell.z += step.z;
+            if (cell.z < 0 || cell.z >= uGridRes.z) break;
+            t_max.z += t_delta.z;
+        }
+    }
+
+    return prim_id >= 0;
+}
+
@@ -0,0 +1,253 @@
+
+
+#include "/light.glsl_h"
+#include "/bsdf.glsl_h"
+#include "/scene.glsl_h"
+#include "/sphere.glsl_h"
+#include "/utilities.glsl_h"
+
+// Independent streams of the per bounce random numbers, k picks the stream
+float light_random(float k) {
+    return random_bounce(k);
+}
+
+// Uniform direction in the cone the sphere covers as seen from p
+bool sample_sphere_light(vec3 p, int index, out vec3 wi, out float dist, out float pdf) {
+
+    vec4 cr = inSpheres[index].center_radius;
+    vec3 to_center = cr.xyz - p;
+    float dist2 = dot(to_center, to_center);
+    float sin2_max = cr.w * cr.w / dist2;
+    if (sin2_max >= 1.0)
+        return false;
+
+    // 1 - cos_max without the cancellation for small or distant lights
+    float cos_max = sqrt(1.0 - sin2_max);
+    float one_minus_cos_max = sin2_max / (1.0 + cos_max);
+
+    float cos_theta = 1.0 - light_random(3.1) * one_minus_cos_max;
+    float sin_theta = sqrt(max(0.0, 1.0 - cos_theta * cos_theta));
+    float phi = 2.0 * pi * light_random(5.7);
+
+    vec3 w = to_center / sqrt(dist2);
+    vec3 u, v;
+    make_basis(w, u, v);
+    wi = normalize(u * (cos(phi) * sin_theta) + v * (sin(phi) * sin_theta) + w * cos_theta);
+
+    // Grazing directions can miss the sphere by rounding
+    Ray r = Ray(p, wi);
+    if (!intersectSphere(r, Interval(0.0, POS_MAX), dist, index))
+        return false;
+
+    pdf = 1.0 / (2.0 * pi * one_minus_cos_max);
+    return true;
+}
+
+// Uniform point on the box surface, faces picked by area
+bool sample_cube_light(vec3 p, int index, out vec3 wi, out float dist, out float pdf) {
+
+    vec3 box_min = inCubes[index].min_pad.xyz;
+    vec3 box_max = inCubes[index].max_matId.xyz;
+    vec3 size = box_max - box_min;
+
+    // Area of the two faces normal to each axis
+    vec3 face_area = vec3(size.y * size.z, size.x * size.z, size.x * size.y);
+    float total_area = 2.0 * (face_area.x + face_area.y + face_area.z);
+
+    float pick = light_random(3.1) * (face_area.x + face_area.y + face_area.z);
+    int axis = pick < face_area.x ? 0 : (pick < face_area.x + face_area.y ? 1 : 2);
+
+    vec3 q = box_min + size * vec3(light_random(5.7), light_random(7.3), light_random(9.9));
+    bool max_side = light_random(11.3) < 0.5;
+    q[axis] = max_side ? box_max[axis] : box_min[axis];
+
+    vec3 n = vec3(0.0);
+    n[axis] = max_side ? 1.0 : -1.0;
+
+    vec3 d = q - p;
+    float dist2 = dot(d, d);
+    dist = sqrt(dist2);
+    wi = d / dist;
+
+    // Faces turned away from p are hidden by the front of the box
+    float cos_light = -dot(wi, n);
+    if (cos_light <= 0.0)
+        return false;
+
+    pdf = dist2 / (cos_light * total_area);
+    return true;
+}
+
+// cos(max(0, a - b)) from the sines and cosines of a and b
+float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+    return cos_a > cos_b ? 1.0 : cos_a * cos_b + sin_a * sin_b;
+}
+
+float light_importance(in PackedLightNode node, vec3 p, vec3 n) {
+
+    vec3 box_min = node.min_power.xyz;
+    vec3 box_max = node.max_child.xyz;
+    vec3 center = 0.5 * (box_min + box_max);
+
+    // Distance clamped to the bounding sphere so points inside the bounds do not blow up
+    vec3 to_light = center - p;
+    float r2 = 0.25 * dot(box_max - box_min, box_max - box_min);
+    float d2 = max(dot(to_light, to_light), r2);
+    vec3 wi = to_light * inversesqrt(max(dot(to_light, to_light), 1e-12));
+
+    // Half angle of the directions the bounds cover as seen from p
+    bool inside = all(greaterThanEqual(p, box_min)) && all(lessThanEqual(p, box_max));
+    float cos_b = inside || d2 <= r2 ? -1.0 : sqrt(1.0 - r2 / d2);
+    float sin_b = sqrt(max(0.0, 1.0 - cos_b * cos_b));
+
+    // Emission toward p: angle to the cone, less the cone and the bounds spread
+    float cos_o = node.axis_cosTheta.w;
+    float sin_o = sqrt(max(0.0, 1.0 - cos_o * cos_o));
+    float cos_w = dot(node.axis_cosTheta.xyz, -wi);
+    float sin_w = sqrt(max(0.0, 1.0 - cos_w * cos_w));
+    float cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, cos_o);
+    float sin_x = sqrt(max(0.0, 1.0 - cos_x * cos_x));
+    float cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+
+    // Every surface point emits over its hemisphere
+    if (cos_p <= 0.0)
+        return 0.0;
+
+    // Receiver cosine, widened by the bounds spread
+    float cos_i = dot(n, wi);
+    float sin_i = sqrt(max(0.0, 1.0 - cos_i * cos_i));
+    float cos_ip = max(cos_sub_clamped(sin_i, cos_i, sin_b, cos_b), 0.0);
+
+    return node.min_power.w * cos_p * cos_ip / d2;
+}
+
+int sample_light_tree(vec3 p, vec3 n, float u, out float pmf) {
+
+    const float ONE_MINUS_EPSILON = 0.99999994;
+    pmf = 1.0;
+
+    int node = 0;
+    while (inLightNodes[node].max_child.w >= 0.0) {
+
+        int left = int(inLightNodes[node].max_child.w + 0.5);
+        float w_left = light_importance(inLightNodes[left], p, n);
+        float w_right = light_importance(inLightNodes[left + 1], p, n);
+        if (w_left + w_right <= 0.0)
+            return -1;
+
+        // Reuse u for the next level by rescaling it into the chosen interval
+        float p_left = w_left / (w_left + w_right);
+        if (u < p_left) {
+            u = min(u / p_left, ONE_MINUS_EPSILON);
+            pmf *= p_left;
+            node = left;
+        }
+        else {
+            u = min((u - p_left) / (1.0 - p_left), ONE_MINUS_EPSILON);
+            pmf *= 1.0 - p_left;
+            node = left + 1;
+        }
+    }
+
+    return int(-inLightNodes[node].max_child.w + 0.5) - 1;
+}
+
+float light_tree_pmf(vec3 p, vec3 n, uint trail) {
+
+    float pmf = 1.0;
+    int node = 0;
+    while (inLightNodes[node].max_child.w >= 0.0) {
+
+        int left = int(inLightNodes[node].max_child.w + 0.5);
+        float w_left = light_importance(inLightNodes[left], p, n);
+        float w_right = light_importance(inLightNodes[left + 1], p, n);
+        if (w_left + w_right <= 0.0)
+            return 0.0;
+
+        bool right = (trail & 1u) != 0u;
+        pmf *= (right ? w_right : w_left) / (w_left + w_right);
+        node = right ? left + 1 : left;
+        trail >>= 1;
+    }
+
+    return pmf;
+}
+
+bool sample_light(vec3 p, vec3 n, out vec3 wi, out float dist, out vec3 Le, out float pdf) {
+
+    if (uLightCount == 0)
+        return false;
+
+    int light;
+    float pmf;
+    if (uLightSampling == LIGHT_SAMPLING_TREE) {
+        light = sample_light_tree(p, n, light_random(1.3), pmf);
+        if (light < 0)
+            return false;
+    }
+    else {
+        light = min(int(light_random(1.3) * float(uLightCount)), uLightCount - 1);
+        pmf = 1.0 / float(uLightCount);
+    }
+
+    vec4 emission_primId = inLights[light].emission_primId;
+    PackedHittable h = inHittables[int(emission_primId.w + 0.5)];
+    Le = emission_primId.rgb;
+
+    bool valid = h.type == HITTABLE_SPHERE
+        ? sample_sphere_light(p, h.index, wi, dist, pdf)
+        : sample_cube_light(p, h.index, wi, dist, pdf);
+
+    pdf *= pmf;
+    return valid;
+}
+
+float light_pdf(vec3 p, vec3 n, int light, in hit_record light_rec) {
+
+    float pmf = uLightSampling == LIGHT_SAMPLING_TREE
+        ? light_tree_pmf(p, n, inLights[light].trail_pad.x)
+        : 1.0 / float(uLightCount);
+
+    PackedHittable h = inHittables[int(inLights[light].emission_primId.w + 0.5)];
+    if (h.type == HITTABLE_SPHERE) {
+
+        // Same cone as sample_sphere_light(), no density from inside the sphere
+        vec4 cr = inSpheres[h.index].center_radius;
+        vec3 to_center = cr.xyz - p;
+        float sin2_max = cr.w * cr.w / dot(to_center, to_center);
+        if (sin2_max >= 1.0)
+            return 0.0;
+        float one_minus_cos_max = sin2_max / (1.0 + sqrt(1.0 - sin2_max));
+        return pmf / (2.0 * pi * one_minus_cos_max);
+    }
+
+    // Area density converted to solid angle, see sample_cube_light()
+    vec3 size = inCubes[h.index].max_matId.xyz - inCubes[h.index].min_pad.xyz;
+    float total_area = 2.0 * (size.x * size.y + size.y * size.z + size.z * size.x);
+    vec3 d = light_rec.point - p;
+    float dist2 = dot(d, d);
+    float cos_light = abs(dot(d, light_rec.normal)) * inversesqrt(dist2);
+    return pmf * dist2 / (max(cos_light, 1e-6) * total_area);
+}
+
+float power_heuristic(float pdf_a, float pdf_b) {
+    float a2 = pdf_a * pdf_a;
+    return a2 / (a2 + pdf_b * pdf_b);
+}
+
+vec3 direct_light(in hit_record rec, in Material mat, vec3 wo) {
+
+    vec3 wi, Le;
+    float dist, pdf;
+    if (!sample_light(rec.point, rec.normal, wi, dist, Le, pdf))
+        return vec3(0.0);
+
+    vec3 f = bsdf_eval(mat, rec.normal, wo, wi);
+    if (f == vec3(0.0))
+        return vec3(0.0);
+
+    if (occluded(Ray(rec.point, wi), Interval(0.001, dist - SHADOW_EPSILON)))
+        return vec3(0.0);
+
+    return f * Le * power_heuristic(pdf, bsdf_pdf(mat, rec.normal, wo, wi)) / pdf;
+}
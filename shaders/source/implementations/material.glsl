@@ -1,48 +1,63 @@
 
 
 #include "/material.glsl_h"
+#include "/bsdf.glsl_h"
+
+Material unpack_material(int matId) {
+    vec4 af = inMaterials[matId].albedo_fuzz;
+    vec4 ti = inMaterials[matId].type_ref_pad;
+
+    Material m;
+    m.type             = int(ti.x + 0.5);
+    m.albedo           = af.rgb;
+    m.refraction_index = ti.y;
+    m.fuzz             = af.w;
+    m.emission         = ti.z;
+    return m;
+}
+
+vec3 emitted(in Material mat, in hit_record rec) {
+    // Lights only emit from their outside
+    if (mat.type != MAT_EMISSIVE || !rec.front_face)
+        return vec3(0.0);
+    return mat.albedo * mat.emission;
+}
 
 bool scatter(
     in  Ray        r_in,        // incoming ray (read-only)
     in  hit_record rec,         // hit info (read-only)
+    in  Material   mat,         // unpack_material(rec.matId)
     out vec3       attenuation, // how the color is attenuated
-    out Ray        scattered   // the scattered ray
+    out Ray        scattered,   // the scattered ray
+    out float      pdf          // bsdf_pdf() of the scattered direction, 0 for delta materials
 ){
     
     //mat. == 0 is lambertian
     //matType == 1 is dielectric
+    //emissive materials (3) absorb, they fall through to the end
+    pdf = 0.0;
 
-    // Lambertian
-    if(rec.mat.type == 0) {
-        vec3 scatter_direction = rec.normal + random_unit_vector();
+    // Lambertian and metal: cosine weighted and GGX visible normal sampling
+#if HAS_LAMBERTIAN || HAS_METAL
+    if(mat.type == MAT_LAMBERTIAN || mat.type == MAT_METAL) {
+        vec3 wo = -normalize(r_in.direction);
+        vec2 u = vec2(random_bounce(13.1), random_bounce(17.9));
 
-        // Catch degenerate scatter direction
-        if (near_zero(scatter_direction))
-            scatter_direction = rec.normal;
-            
-        scattered.origin = rec.point;
-        scattered.direction = scatter_direction;        
-        
-        attenuation = rec.mat.albedo;
-        return true;
-    }
-
-    // Metal
-    if(rec.mat.type == 1) {
-        vec3 reflected = reflect(r_in.direction, rec.normal);
-        reflected = normalize(reflected) + (rec.mat.fuzz * random_unit_vector());
+        vec3 wi;
+        if (!bsdf_sample(mat, rec.normal, wo, u, wi, attenuation, pdf))
+            return false;
 
         scattered.origin = rec.point;
-        scattered.direction = reflected;
-
-        attenuation = rec.mat.albedo;
-        return (dot(scattered.direction, rec.normal) > 0);
+        scattered.direction = wi;
+        return true;
     }
+#endif
 
     // Dielectric
-    if(rec.mat.type == 2){
+#if HAS_DIELECTRIC
+    if(mat.type == 2){
         attenuation = vec3(1.0);
-        float ri = rec.front_face ? (1.0/rec.mat.refraction_index) : rec.mat.refraction_index;
+        float ri = rec.front_face ? (1.0/mat.refraction_index) : mat.refraction_index;
 
         vec3 unit_direction = normalize(r_in.direction);
         float cos_theta = min(dot(-unit_direction, rec.normal), 1.0);
@@ -51,7 +66,7 @@ bool scatter(
         bool cannot_refract = ri * sin_theta > 1.0;
         vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, ri) > random_float(pixel_coords.xy))
+        if (cannot_refract || reflectance(cos_theta, ri) > random_bounce(19.3))
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, ri);
@@ -60,6 +75,7 @@ bool scatter(
         scattered.direction = direction;
         return true;
     }
+#endif
 
     return false;
 
@@ -0,0 +1,48 @@
+
+
+#include "/plane.glsl_h"
+#include "/scene.glsl_h"
+#include "/sphere.glsl_h"
+#include "/ray.glsl_h"
+
+bool intersectPlane(Ray r, Interval ray_t, out float t, int index) {
+
+        vec4 no = inPlanes[index].normal_offset;
+
+        // Rays parallel to the plane never hit it
+        float denom = dot(no.xyz, r.direction);
+        if (denom == 0.0)
+            return false;
+
+        float root = (no.w - dot(no.xyz, r.origin)) / denom;
+        if (!surrounds(ray_t, root))
+            return false;
+
+        t = root;
+        return true;
+}
+
+void plane_hit_record(Ray r, int index, inout hit_record rec) {
+
+        PackedPlane p = inPlanes[index];
+        set_face_normal(r, rec, p.normal_offset.xyz);
+        rec.matId = int(p.color_matId.w + 0.5);
+}
+
+bool hit_planes(Ray r, inout Interval ray_t, out int prim_id) {
+
+    prim_id = -1;
+    float t;
+
+#if HAS_PLANES
+    int first = uSphereCount + uCubeCount;
+    for (int i = first; i < first + uPlaneCount; ++i) {
+        if (intersectPlane(r, ray_t, t, inHittables[i].index)) {
+            ray_t.max = t;
+            prim_id = i;
+        }
+    }
+#endif
+
+    return prim_id >= 0;
+}
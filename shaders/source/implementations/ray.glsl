@@ -1,6 +1,11 @@
 
 
 #include "/ray.glsl_h"
+#include "/scene.glsl_h"
+#include "/plane.glsl_h"
+#include "/material.glsl_h"
+#include "/light.glsl_h"
+#include "/bsdf.glsl_h"
 
 Ray make_ray(in Camera camera, vec3 origin, vec3 direction, vec3 filmPoint) {
     Ray r;
@@ -17,45 +22,91 @@ vec3 ray_color(Ray r) {
     vec3 throughput = vec3(1.0);   // cumulative attenuation
     vec3 result  = vec3(0.0);   // what well return
 
+    // Previous vertex, needed to weight emission found by BSDF sampling against light
+    // sampling (MIS). Camera rays and delta bounces count emission fully.
+    bool delta_bounce = true;
+    float bsdf_pdf_prev = 0.0;
+    vec3 point_prev = vec3(0.0);
+    vec3 normal_prev = vec3(0.0);
+
     for (int depth = 0; depth < MAX_DEPTH; ++depth) {
+
+        iBounces++;
+        iDepth = uint(depth) + 1u;
         
-        // 1) cast ray r into the scene
-        hit_record closest_rec;
-        bool hit_something = false;
-
-        float closest_hit = POS_MAX;
-        Interval ray_t = Interval(0.001, closest_hit);
-
-        for (int i = 0; i < uSphereCount; ++i) {
-            hit_record temp_rec;
-         
-            if (intersectSphere(r, ray_t, temp_rec, i)) {
-                hit_something = true;
-                closest_hit = temp_rec.t;  
-                ray_t.max = closest_hit;
-                closest_rec = temp_rec; 
-            }
+        // 1) cast ray r into the scene, only the distance and primitive id are tracked
+        int prim_id;
+        Interval ray_t = Interval(0.001, POS_MAX);
+
+        // Planes are unbounded and stay out of the acceleration structure. Testing
+        // them first shortens ray_t, so the grid walk stops at the ground.
+        int plane_id;
+        bool hit_plane = hit_planes(r, ray_t, plane_id);
 
+        bool hit_something = hit_scene(r, ray_t, prim_id);
+        if (!hit_something && hit_plane) {
+            prim_id = plane_id;
+            hit_something = true;
         }
 
         // 2) if we missed, add sky and break
         if (!hit_something) {
             vec3 unit_dir = normalize(r.direction);
             float t = 0.5 * (unit_dir.y + 1.0);
-            vec3 sky = (1.0-t)*vec3(1.0) + t*vec3(0.5, 0.7, 1.0);
-            result += throughput * sky;
+            vec3 sky = uUniformSky ? vec3(1.0) : (1.0-t)*vec3(1.0) + t*vec3(0.5, 0.7, 1.0);
+            result += throughput * sky * uSkyIntensity;
             break;
         }
 
-        // 3) we hit something: scatter
+        // 3) we hit something: build the hit record and fetch the material once
+        hit_record closest_rec = resolve_hit(r, ray_t.max, prim_id);
+        Material mat = unpack_material(closest_rec.matId);
+
+        // Planes are never in the light list, their emission is always counted
+#if HAS_EMISSIVE
+        if (mat.type == MAT_EMISSIVE) {
+            int light = inHittables[prim_id].light;
+            float weight = 1.0;
+            if (!delta_bounce && light >= 0 && uLightCount > 0)
+                weight = power_heuristic(bsdf_pdf_prev, light_pdf(point_prev, normal_prev, light, closest_rec));
+            result += throughput * emitted(mat, closest_rec) * weight;
+        }
+#endif
+
+        // 4) next event estimation: sample a light with a shadow ray, MIS weighted.
+        // Mirrors and glass keep collecting emission through their scattered rays.
+        bool is_delta = bsdf_is_delta(mat);
+#if HAS_EMISSIVE
+        if (!is_delta && uLightCount > 0)
+            result += throughput * direct_light(closest_rec, mat, -normalize(r.direction));
+#endif
+
         vec3 attenuation;
         Ray scattered;
-        if (!scatter(r, closest_rec, attenuation, scattered)) {
+        float pdf;
+        if (!scatter(r, closest_rec, mat, attenuation, scattered, pdf)) {
             break;
         }
 
+        delta_bounce = is_delta;
+        bsdf_pdf_prev = pdf;
+        point_prev = closest_rec.point;
+        normal_prev = closest_rec.normal;
+
         // accumulate the attenuation
         throughput *= attenuation;
+
+        // Russian roulette: once a path has bounced uRouletteDepth times it survives with
+        // probability p from its throughput luminance, survivors are divided by p so the
+        // estimate stays unbiased while dim paths stop early
+        if (depth + 1 >= uRouletteDepth) {
+            float p = min(luminance(throughput), 1.0);
+            float u = uDeterministic ? sample_float(DIM_ROULETTE)
+                                     : random_float(pixel_coords.yx + vec2(iSeed + float(depth), -iSeed));
+            if (u >= p)
+                break;
+            throughput /= p;
+        }
         // continue tracing the scattered ray
         r = scattered;
         
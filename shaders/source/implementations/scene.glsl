@@ -0,0 +1,99 @@
+
+
+#include "/scene.glsl_h"
+#include "/sphere.glsl_h"
+#include "/aabb.glsl_h"
+#include "/grid.glsl_h"
+#include "/plane.glsl_h"
+#include "/ray.glsl_h"
+
+bool hit_scene(Ray r, inout Interval ray_t, out int prim_id) {
+
+    // Uniform for the whole dispatch, no divergence
+    if (uAccel == ACCEL_GRID)
+        return hit_grid(r, ray_t, prim_id, false);
+
+    prim_id = -1;
+    float t;
+
+    // The primitive table is grouped by type, so each loop runs a single
+    // intersection routine and threads of a group never diverge on the type.
+
+    // Spheres: [0, uSphereCount)
+#if HAS_SPHERES
+    for (int i = 0; i < uSphereCount; ++i) {
+        if (intersectSphere(r, ray_t, t, inHittables[i].index)) {
+            ray_t.max = t;
+            prim_id = i;
+        }
+    }
+#endif
+
+    // Cubes: [uSphereCount, uSphereCount + uCubeCount)
+#if HAS_CUBES
+    for (int i = uSphereCount; i < uSphereCount + uCubeCount; ++i) {
+        if (intersectCube(r, ray_t, t, inHittables[i].index)) {
+            ray_t.max = t;
+            prim_id = i;
+        }
+    }
+#endif
+
+    return prim_id >= 0;
+}
+
+bool occluded(Ray r, Interval ray_t) {
+
+    float t;
+
+    // Planes first, a ground plane blocks most shadow rays that hit anything
+#if HAS_PLANES
+    int first_plane = uSphereCount + uCubeCount;
+    for (int i = first_plane; i < first_plane + uPlaneCount; ++i)
+        if (intersectPlane(r, ray_t, t, inHittables[i].index))
+            return true;
+#endif
+
+    if (uAccel == ACCEL_GRID) {
+        int prim_id;
+        return hit_grid(r, ray_t, prim_id, true);
+    }
+
+#if HAS_SPHERES
+    for (int i = 0; i < uSphereCount; ++i)
+        if (intersectSphere(r, ray_t, t, inHittables[i].index))
+            return true;
+#endif
+
+#if HAS_CUBES
+    for (int i = uSphereCount; i < uSphereCount + uCubeCount; ++i)
+        if (intersectCube(r, ray_t, t, inHittables[i].index))
+            return true;
+#endif
+
+    return false;
+}
+
+hit_record resolve_hit(Ray r, float t, int prim_id) {
+
+    hit_record rec;
+    rec.t = t;
+    rec.point = ray_at(r, t);
+
+    PackedHittable h = inHittables[prim_id];
+#if HAS_SPHERES
+    if (h.type == HITTABLE_SPHERE)
+        sphere_hit_record(r, h.index, rec);
+#endif
+#if HAS_CUBES
+    if (h.type == HITTABLE_CUBE)
+        cube_hit_record(r, h.index, rec);
+#endif
+#if HAS_PLANES
+    if (h.type == HITTABLE_PLANE)
+        plane_hit_record(r, h.index, rec);
+#endif
+
+    return rec;
+}
+
@@ -8,23 +8,11 @@ Sphere unpack_sphere(int index) {
     vec4 cr = inSpheres[index].center_radius;
     vec4 cm = inSpheres[index].color_matId;
 
-    int matId = int(cm.w + 0.5);
-
-    // Unpack material
-    vec4 af = inMaterials[matId].albedo_fuzz;
-    vec4 ti = inMaterials[matId].type_ref_pad;
-
-    Material m;
-    m.type             = int(ti.x + 0.5);
-    m.albedo           = af.rgb;
-    m.refraction_index = ti.y;
-    m.fuzz             = af.w;
-
     // Build sphere
     Sphere s;
     s.sphereCenter = cr.xyz;
     s.sphereRadius = cr.w;
-    s.mat          = m;
+    s.matId        = int(cm.w + 0.5);
     return s;
 }
 
@@ -38,16 +26,15 @@ void set_face_normal(in Ray r, inout hit_record rec, in vec3 outward_normal) {
     rec.normal = rec.front_face ? outward_normal : -outward_normal;
 }
 
-bool intersectSphere(Ray r, inout Interval ray_t, out hit_record rec, int index) {
+bool intersectSphere(Ray r, Interval ray_t, out float t, int index) {
 
-        // Save time by unpacking radius/center only and no materials
-        vec3 unpacked_center = inSpheres[index].center_radius.xyz;
-        float unpacked_radius = inSpheres[index].center_radius.w;
+        // Only center/radius are read here, the rest is fetched once for the closest hit
+        vec4 cr = inSpheres[index].center_radius;
         
-        vec3 oc = unpacked_center - r.origin;
+        vec3 oc = cr.xyz - r.origin;
         float a = dot(r.direction, r.direction);
         float h = dot(r.direction, oc);
-        float c = dot(oc, oc) - unpacked_radius*unpacked_radius;
+        float c = dot(oc, oc) - cr.w*cr.w;
 
         float discriminant = h*h - a*c;
         if (discriminant < 0)
@@ -63,15 +50,17 @@ bool intersectSphere(Ray r, inout Interval ray_t, out hit_record rec, int index)
                 return false;
         }
 
+        t = root;
+        return true;
+}
+
+void sphere_hit_record(Ray r, int index, inout hit_record rec) {
+
         Sphere obj = unpack_sphere(index);
 
-        rec.t = root;
-        rec.point = ray_at(r, rec.t);
         vec3 outward_normal = (rec.point - obj.sphereCenter) / obj.sphereRadius;
         set_face_normal(r, rec, outward_normal);
-        rec.mat = obj.mat;
-
-        return true;
+        rec.matId = obj.matId;
 }
 
 #endif // Must end in newline
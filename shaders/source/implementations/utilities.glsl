@@ -45,11 +45,38 @@ vec3 random(float min, float max) {
 // Return random unit-length vector
 vec3 random_unit_vector(){
     vec2 seed = pixel_coords.xy + vec2(iSeed, -iSeed);
-    float r1 = random_float(seed + vec2(1.0, 0.0));
-    float r2 = random_float(seed + vec2(0.0, 0.0));
-    float r3 = random_float(seed + vec2(0.0, 1.0));
+    float z = 1.0 - 2.0 * random_float(seed + vec2(1.0, 0.0));
+    float phi = 2.0 * pi * random_float(seed + vec2(0.0, 1.0));
+    float r = sqrt(max(0.0, 1.0 - z * z));
 
-    return normalize(vec3(r1, r2, r3));
+    return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+uint hash_u32(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float sample_float(uint dimension) {
+    uint h = hash_u32(dimension);
+    h = hash_u32(h ^ iDepth);
+    h = hash_u32(h ^ iSample);
+    h = hash_u32(h ^ uint(pixel_coords.y));
+    h = hash_u32(h ^ uint(pixel_coords.x));
+    h = hash_u32(h ^ uSeedBits);
+    return float(h >> 8) * (1.0 / 16777216.0);
+}
+
+// Stream k of the per bounce random numbers, iBounces moves the seed every bounce
+float random_bounce(float k) {
+    if (uDeterministic)
+        return sample_float(floatBitsToUint(k));
+    float b = float(iBounces);
+    return random_float(pixel_coords.xy + vec2(iSeed + k + 0.618 * b, k - iSeed + 0.414 * b));
 }
 
 // Return random vector on hemisphere around normal
@@ -63,16 +90,17 @@ vec3 random_on_hemisphere(inout vec3 normal) {
 }
 
 // Return random point inside unit disk (for defocus)
+// Polar mapping instead of rejection: the seed does not change inside a rejection
+// loop, so a rejected first sample never terminated.
 vec3 random_in_unit_disk() {
-    vec3 p;
-    do {
-        p = vec3(
-            random_range(pixel_coords.xy + vec2(iSeed, -iSeed), -1.0, 1.0),
-            random_range(pixel_coords.yx + vec2(-iSeed, iSeed), -1.0, 1.0),
-            0.0
-        );
-    } while (dot(p,p) >= 1.0);
-    return p;
+    if (uDeterministic) {
+        float r = sqrt(sample_float(DIM_LENS));
+        float theta = 2.0 * pi * sample_float(DIM_LENS + 1u);
+        return vec3(r * cos(theta), r * sin(theta), 0.0);
+    }
+    float r     = sqrt(random_float(pixel_coords.xy + vec2(iSeed, -iSeed)));
+    float theta = 2.0 * pi * random_float(pixel_coords.yx + vec2(-iSeed, iSeed));
+    return vec3(r * cos(theta), r * sin(theta), 0.0);
 }
 
 
@@ -115,4 +143,17 @@ float reflectance(float cosine, float refraction_index) {
         return r0 + (1-r0)* pow((1 - cosine),5);
 }
 
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void make_basis(vec3 n, out vec3 t, out vec3 b) {
+    // Duff et al. 2017, branchless and continuous except at n.z == 0
+    float s = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + n.z);
+    float c = n.x * n.y * a;
+    t = vec3(1.0 + s * n.x * n.x * a, s * c, -s * n.x);
+    b = vec3(c, s + n.y * n.y * a, -n.y);
+}
+
 
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cfloat>
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box, CPU counterpart of the boxes tested in aabb.glsl
+class AABB {
+
+public:
+	glm::vec3 m_Min = glm::vec3(FLT_MAX);
+	glm::vec3 m_Max = glm::vec3(-FLT_MAX);
+
+	AABB() = default;
+	AABB(const glm::vec3& min, const glm::vec3& max) : m_Min(min), m_Max(max) {}
+
+	void Expand(const AABB& other) {
+		m_Min = glm::min(m_Min, other.m_Min);
+		m_Max = glm::max(m_Max, other.m_Max);
+	}
+
+	bool IsEmpty() const { return m_Min.x > m_Max.x; }
+	glm::vec3 Extent() const { return m_Max - m_Min; }
+	glm::vec3 Center() const { return 0.5f * (m_Min + m_Max); }
+
+	// Length of the longest side
+	float MaxExtent() const {
+		glm::vec3 e = Extent();
+		return glm::max(glm::max(e.x, e.y), e.z);
+	}
+};
@@ -0,0 +1,170 @@
+#include "BSDF.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float PI_F = 3.14159265358979f;
+
+static int material_type(const GPUMaterial& mat) {
+	return int(mat.type_ref_pad.x + 0.5f);
+}
+
+// Schlick's Fresnel with the metal color as reflectance at normal incidence
+static glm::vec3 fresnel_schlick(const glm::vec3& f0, float cos_theta) {
+	float m = 1.f - glm::clamp(cos_theta, 0.f, 1.f);
+	return f0 + (1.f - f0) * (m * m * m * m * m);
+}
+
+static glm::vec3 to_local(const glm::vec3& v, const glm::vec3& t, const glm::vec3& b, const glm::vec3& n) {
+	return glm::vec3(glm::dot(v, t), glm::dot(v, b), glm::dot(v, n));
+}
+
+float ggx_alpha(const GPUMaterial& mat)
+{
+	return mat.albedo_fuzz.w * mat.albedo_fuzz.w;
+}
+
+glm::vec3 sample_cosine_hemisphere(const glm::vec2& u)
+{
+	float r = sqrtf(u.x);
+	float phi = 2.f * PI_F * u.y;
+	return glm::vec3(r * cosf(phi), r * sinf(phi), sqrtf(std::max(0.f, 1.f - u.x)));
+}
+
+float ggx_D(const glm::vec3& h, float alpha)
+{
+	float a2 = alpha * alpha;
+	float d = h.z * h.z * (a2 - 1.f) + 1.f;
+	return a2 / (PI_F * d * d);
+}
+
+float ggx_lambda(const glm::vec3& v, float alpha)
+{
+	float tan2 = (v.x * v.x + v.y * v.y) / std::max(v.z * v.z, 1e-12f);
+	return 0.5f * (sqrtf(1.f + alpha * alpha * tan2) - 1.f);
+}
+
+glm::vec3 sample_ggx_vndf(const glm::vec3& wo, float alpha, const glm::vec2& u)
+{
+	// Stretch to the hemisphere configuration, sample the spherical cap, unstretch
+	glm::vec3 wo_std = glm::normalize(glm::vec3(wo.x * alpha, wo.y * alpha, wo.z));
+	float phi = 2.f * PI_F * u.x;
+	float z = (1.f - u.y) * (1.f + wo_std.z) - wo_std.z;
+	float sin_theta = sqrtf(glm::clamp(1.f - z * z, 0.f, 1.f));
+	glm::vec3 h_std = glm::vec3(sin_theta * cosf(phi), sin_theta * sinf(phi), z) + wo_std;
+	return glm::normalize(glm::vec3(h_std.x * alpha, h_std.y * alpha, std::max(h_std.z, 0.f)));
+}
+
+template <unsigned int MATERIALS>
+bool bsdf_is_delta(const GPUMaterial& mat)
+{
+	// Only Lambertian surfaces left
+	if ((MATERIALS & ~(1u << LAMBERTIAN)) == 0)
+		return false;
+
+	int type = material_type(mat);
+	if (has_material<MATERIALS>(METAL) && type == METAL)
+		return ggx_alpha(mat) < GGX_MIN_ALPHA;
+	return type != LAMBERTIAN;
+}
+
+template <unsigned int MATERIALS>
+glm::vec3 bsdf_eval(const GPUMaterial& mat, const glm::vec3& n, const glm::vec3& wo, const glm::vec3& wi)
+{
+	glm::vec3 t, b;
+	make_basis(n, t, b);
+	glm::vec3 lo = to_local(wo, t, b, n);
+	glm::vec3 li = to_local(wi, t, b, n);
+	if (lo.z <= 0.f || li.z <= 0.f || bsdf_is_delta<MATERIALS>(mat))
+		return glm::vec3(0.f);
+
+	glm::vec3 albedo = glm::vec3(mat.albedo_fuzz);
+	if (material_type(mat) == LAMBERTIAN)
+		return albedo / PI_F * li.z;
+	if (!has_material<MATERIALS>(METAL))
+		return glm::vec3(0.f);
+
+	// GGX with height correlated Smith masking: F D G2 / (4 cos_o cos_i), times cos_i
+	float alpha = ggx_alpha(mat);
+	glm::vec3 h = glm::normalize(lo + li);
+	float G2 = 1.f / (1.f + ggx_lambda(lo, alpha) + ggx_lambda(li, alpha));
+	return fresnel_schlick(albedo, glm::dot(li, h)) * ggx_D(h, alpha) * G2 / (4.f * lo.z);
+}
+
+template <unsigned int MATERIALS>
+float bsdf_pdf(const GPUMaterial& mat, const glm::vec3& n, const glm::vec3& wo, const glm::vec3& wi)
+{
+	glm::vec3 t, b;
+	make_basis(n, t, b);
+	glm::vec3 lo = to_local(wo, t, b, n);
+	glm::vec3 li = to_local(wi, t, b, n);
+	if (lo.z <= 0.f || li.z <= 0.f || bsdf_is_delta<MATERIALS>(mat))
+		return 0.f;
+
+	if (material_type(mat) == LAMBERTIAN)
+		return li.z / PI_F;
+	if (!has_material<MATERIALS>(METAL))
+		return 0.f;
+
+	// Visible normal density times the reflection jacobian 1 / (4 wo.h)
+	float alpha = ggx_alpha(mat);
+	glm::vec3 h = glm::normalize(lo + li);
+	float G1 = 1.f / (1.f + ggx_lambda(lo, alpha));
+	return G1 * ggx_D(h, alpha) / (4.f * lo.z);
+}
+
+template <unsigned int MATERIALS>
+bool bsdf_sample(const GPUMaterial& mat, const glm::vec3& n, const glm::vec3& wo, const glm::vec2& u,
+	glm::vec3& wi, glm::vec3& weight, float& pdf)
+{
+	glm::vec3 t, b;
+	make_basis(n, t, b);
+	glm::vec3 lo = to_local(wo, t, b, n);
+
+	// Grazing hits can see the surface from slightly below
+	lo.z = std::max(lo.z, 1e-4f);
+
+	glm::vec3 albedo = glm::vec3(mat.albedo_fuzz);
+	glm::vec3 li;
+	if (material_type(mat) == LAMBERTIAN) {
+		li = sample_cosine_hemisphere(u);
+		weight = albedo;
+		pdf = li.z / PI_F;
+	}
+	else if (bsdf_is_delta<MATERIALS>(mat)) {
+		li = glm::vec3(-lo.x, -lo.y, lo.z);
+		weight = fresnel_schlick(albedo, lo.z);
+		pdf = 0.f;
+	}
+	else if (!has_material<MATERIALS>(METAL))
+		return false;
+	else {
+		float alpha = ggx_alpha(mat);
+		glm::vec3 h = sample_ggx_vndf(lo, alpha, u);
+		li = glm::reflect(-lo, h);
+		if (li.z <= 0.f)
+			return false;
+
+		// F G2 / G1, D and the jacobian cancel against the pdf
+		float lambda_o = ggx_lambda(lo, alpha);
+		float G1 = 1.f / (1.f + lambda_o);
+		float G2 = 1.f / (1.f + lambda_o + ggx_lambda(li, alpha));
+		weight = fresnel_schlick(albedo, glm::dot(li, h)) * (G2 / G1);
+		pdf = G1 * ggx_D(h, alpha) / (4.f * lo.z);
+	}
+
+	wi = glm::normalize(li.x * t + li.y * b + li.z * n);
+	return true;
+}
+
+// Every material mask, for the specialized kernels of CPUTracer
+#define INSTANTIATE_BSDF(MATERIALS) \
+	template bool bsdf_is_delta<MATERIALS>(const GPUMaterial&); \
+	template glm::vec3 bsdf_eval<MATERIALS>(const GPUMaterial&, const glm::vec3&, const glm::vec3&, const glm::vec3&); \
+	template float bsdf_pdf<MATERIALS>(const GPUMaterial&, const glm::vec3&, const glm::vec3&, const glm::vec3&); \
+	template bool bsdf_sample<MATERIALS>(const GPUMaterial&, const glm::vec3&, const glm::vec3&, const glm::vec2&, glm::vec3&, glm::vec3&, float&);
+
+INSTANTIATE_BSDF(0x0) INSTANTIATE_BSDF(0x1) INSTANTIATE_BSDF(0x2) INSTANTIATE_BSDF(0x3)
+INSTANTIATE_BSDF(0x4) INSTANTIATE_BSDF(0x5) INSTANTIATE_BSDF(0x6) INSTANTIATE_BSDF(0x7)
+INSTANTIATE_BSDF(0x8) INSTANTIATE_BSDF(0x9) INSTANTIATE_BSDF(0xA) INSTANTIATE_BSDF(0xB)
+INSTANTIATE_BSDF(0xC) INSTANTIATE_BSDF(0xD) INSTANTIATE_BSDF(0xE) INSTANTIATE_BSDF(0xF)
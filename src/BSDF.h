@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Material.h"
+
+// CPU twin of bsdf.glsl: cosine weighted Lambertian and GGX metal with visible normal
+// sampling. Directions are world space unit vectors, wo points back along the incoming ray.
+// The CPU tracer and the furnace tests use these, keep them in step with the shader.
+
+// Metals whose GGX alpha is below this are treated as perfect mirrors, GGX_MIN_ALPHA in bsdf.glsl_h
+static const float GGX_MIN_ALPHA = 1e-3f;
+
+// Material types compiled in, bit 1 << Material_Type like VARIANT_MATERIALS. The bsdf_*
+// templates drop the code of missing types, like the HAS_* guards of bsdf.glsl. They are
+// instantiated for every mask in BSDF.cpp.
+static const unsigned int MATERIALS_ALL = 0xF;
+
+template <unsigned int MATERIALS>
+constexpr bool has_material(int type) {
+	return (MATERIALS & (1u << type)) != 0;
+}
+
+// Same basis as make_basis() in utilities.glsl
+inline void make_basis(const glm::vec3& n, glm::vec3& t, glm::vec3& b) {
+	float s = n.z >= 0.f ? 1.f : -1.f;
+	float a = -1.f / (s + n.z);
+	float c = n.x * n.y * a;
+	t = glm::vec3(1.f + s * n.x * n.x * a, s * c, -s * n.x);
+	b = glm::vec3(c, s + n.y * n.y * a, -n.y);
+}
+
+// GGX alpha of a metal, fuzz is its perceptual roughness
+float ggx_alpha(const GPUMaterial& mat);
+
+// Cosine weighted direction around +z, pdf = cos(theta) / pi
+glm::vec3 sample_cosine_hemisphere(const glm::vec2& u);
+
+// GGX normal distribution and Smith lambda in the local frame (normal = +z)
+float ggx_D(const glm::vec3& h, float alpha);
+float ggx_lambda(const glm::vec3& v, float alpha);
+
+// Microfacet normal visible from wo, spherical cap sampling (Dupuy and Benyoub 2023)
+glm::vec3 sample_ggx_vndf(const glm::vec3& wo, float alpha, const glm::vec2& u);
+
+// Mirrors and glass, no density to evaluate
+template <unsigned int MATERIALS = MATERIALS_ALL>
+bool bsdf_is_delta(const GPUMaterial& mat);
+
+// BSDF times the cosine at wi
+template <unsigned int MATERIALS = MATERIALS_ALL>
+glm::vec3 bsdf_eval(const GPUMaterial& mat, const glm::vec3& n, const glm::vec3& wo, const glm::vec3& wi);
+
+// Solid angle density of bsdf_sample() producing wi, 0 for delta materials
+template <unsigned int MATERIALS = MATERIALS_ALL>
+float bsdf_pdf(const GPUMaterial& mat, const glm::vec3& n, const glm::vec3& wo, const glm::vec3& wi);
+
+// Lambertian and metal only. weight = bsdf_eval / pdf, pdf is 0 for mirrors.
+// Returns false when the sample is absorbed.
+template <unsigned int MATERIALS = MATERIALS_ALL>
+bool bsdf_sample(const GPUMaterial& mat, const glm::vec3& n, const glm::vec3& wo, const glm::vec2& u,
+	glm::vec3& wi, glm::vec3& weight, float& pdf);
@@ -0,0 +1,750 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "utilities.h"
+#include "HybridRenderer.h"
+
+static const char* accel_name(Accel_Type type) {
+	return type == ACCEL_GRID ? "grid" : "linear";
+}
+
+// Per pixel running variance of the frame luminance (Welford)
+struct PixelVariance {
+	std::vector<double> m_Mean;
+	std::vector<double> m_M2;
+	int m_Count = 0;
+
+	template <class Frame>
+	void Add(const Frame& frame) {
+		if (m_Mean.empty()) {
+			m_Mean.assign(frame.size(), 0.0);
+			m_M2.assign(frame.size(), 0.0);
+		}
+		m_Count++;
+		for (size_t i = 0; i < frame.size(); i++) {
+			double l = glm::dot(glm::vec3(frame[i]), glm::vec3(0.2126f, 0.7152f, 0.0722f));
+			double delta = l - m_Mean[i];
+			m_Mean[i] += delta / m_Count;
+			m_M2[i] += delta * (l - m_Mean[i]);
+		}
+	}
+
+	// Variance of one frame, averaged over all pixels
+	double Mean() const {
+		if (m_Count < 2)
+			return 0.0;
+		double total = 0.0;
+		for (double m2 : m_M2)
+			total += m2 / (m_Count - 1);
+		return total / m_M2.size();
+	}
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+Benchmark::Benchmark(Scene& scene, Shader& compute, const Camera& cam, unsigned int width, unsigned int height, int samples, int max_depth)
+	: m_Scene(scene), m_Compute(compute), m_Camera(cam), m_CPUTracer(scene),
+	m_Width(width), m_Height(height), m_Samples(samples), m_MaxDepth(max_depth), m_RouletteDepth(max_depth)
+{
+	m_Dispatcher.Init();
+
+	// The frames go to an image of their own so they can be read back
+	glGenTextures(1, &m_Image);
+	glBindTexture(GL_TEXTURE_2D, m_Image);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, m_Width, m_Height);
+	glBindImageTexture(0, m_Image, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+}
+
+Benchmark::~Benchmark()
+{
+	glDeleteTextures(1, &m_Image);
+}
+
+void Benchmark::Run()
+{
+	printf("Benchmark: %d primitives, %ux%u, %d spp, depth %d\n",
+		(int)m_Scene.m_Hittables.size(), m_Width, m_Height, m_Samples, m_MaxDepth);
+
+	RunAcceleration();
+	RunDispatch();
+	RunRoulette();
+	RunLightSampling();
+	RunSphereKernels();
+	RunPackets();
+	RunStreams();
+	RunScheduling();
+	RunNuma();
+	RunHybrid();
+	RunDeterminism();
+	RunKernels();
+}
+
+void Benchmark::RunAcceleration()
+{
+	Accel_Type chosen = m_Scene.ChooseAcceleration();
+	const int builds = 10;
+
+	printf("\n%-8s %12s %14s %14s\n", "accel", "build ms", "gpu ms/frame", "cpu ms/frame");
+
+	for (Accel_Type type : { ACCEL_LINEAR, ACCEL_GRID }) {
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < builds; i++)
+			m_Scene.BuildAcceleration(type);
+		double build_ms = elapsed_ms(start) / builds;
+
+		m_Scene.Upload(m_Compute.m_ProgramId);
+		double gpu_ms = TimeGPU();
+		double cpu_ms = TimeCPU();
+
+		printf("%-8s %12.3f %14.3f %14.3f\n", accel_name(type), build_ms, gpu_ms, cpu_ms);
+
+		if (type == ACCEL_GRID) {
+			const UniformGrid& grid = m_Scene.m_Grid;
+			printf("         %dx%dx%d cells, %d references, %d escaped\n", grid.m_Resolution.x, grid.m_Resolution.y,
+				grid.m_Resolution.z, grid.m_Escape.x, grid.m_Escape.y + grid.m_Escape.z);
+		}
+	}
+
+	printf("chosen from scene statistics: %s\n", accel_name(chosen));
+
+	// Leave the scene as it would be loaded
+	m_Scene.BuildAcceleration(chosen);
+	m_Scene.Upload(m_Compute.m_ProgramId);
+}
+
+void Benchmark::RunDispatch()
+{
+	printf("\n%-18s %8s %14s %12s\n", "dispatch", "groups", "gpu ms/frame", "utilization");
+
+	struct Config { Dispatch_Mode mode; int batch; const char* name; };
+	const Config configs[] = {
+		{ DISPATCH_TILES, 1, "tiles" },
+		{ DISPATCH_PERSISTENT, 1, "persistent x1" },
+		{ DISPATCH_PERSISTENT, 2, "persistent x2" },
+		{ DISPATCH_PERSISTENT, 4, "persistent x4" },
+	};
+
+	for (const Config& config : configs) {
+		m_Dispatcher.m_Mode = config.mode;
+		m_Dispatcher.m_BatchSize = config.batch;
+
+		double gpu_ms = TimeGPU();
+		GroupUtilization util = MeasureUtilization();
+
+		printf("%-18s %8d %14.3f %11.1f%%\n", config.name, util.m_Groups, gpu_ms, util.Utilization() * 100.0);
+	}
+
+	m_Dispatcher.m_Mode = DISPATCH_TILES;
+}
+
+GroupUtilization Benchmark::MeasureUtilization()
+{
+	m_Dispatcher.m_CollectStats = true;
+	m_Compute.use();
+	m_Compute.setFloat("uSeed", random_float());
+	m_Dispatcher.Dispatch(m_Compute.m_ProgramId, m_Width, m_Height);
+
+	GroupUtilization util = m_Dispatcher.ReadUtilization();
+	m_Dispatcher.m_CollectStats = false;
+	return util;
+}
+
+void Benchmark::RunRoulette()
+{
+	// Efficiency is 1 / (variance x seconds per frame): equal noise in less time, or less noise in equal time
+	printf("\n%-10s %14s %12s %12s %14s %12s %12s\n", "roulette", "gpu Mpaths/s", "gpu var", "gpu eff",
+		"cpu Mpaths/s", "cpu var", "cpu eff");
+
+	double paths = double(m_Width) * m_Height * m_Samples;
+
+	// A start depth of m_MaxDepth never plays roulette
+	for (int depth : { m_MaxDepth, 1, 2, 3, 5 }) {
+		if (depth != m_MaxDepth && depth >= m_MaxDepth)
+			continue;
+		m_RouletteDepth = depth;
+
+		NoiseStats gpu = MeasureNoiseGPU();
+		NoiseStats cpu = MeasureNoiseCPU();
+
+		char name[16];
+		if (depth == m_MaxDepth)
+			snprintf(name, sizeof(name), "off");
+		else
+			snprintf(name, sizeof(name), "from %d", depth);
+
+		printf("%-10s %14.2f %12.5f %12.1f %14.2f %12.5f %12.1f\n", name,
+			paths / (gpu.m_Ms * 1e3), gpu.m_Variance, 1e3 / (gpu.m_Variance * gpu.m_Ms),
+			paths / (cpu.m_Ms * 1e3), cpu.m_Variance, 1e3 / (cpu.m_Variance * cpu.m_Ms));
+	}
+
+	// The other suites run without roulette
+	m_RouletteDepth = m_MaxDepth;
+}
+
+void Benchmark::RunLightSampling()
+{
+	if (m_Scene.m_Lights.empty())
+		return;
+
+	// Variance scaled by the frame time relative to uniform selection: the variance
+	// each mode would reach in the time uniform selection needs for one frame
+	printf("\n%-10s %8s %12s %12s %14s %12s %12s %14s\n", "lights", "count", "gpu ms", "gpu var", "gpu var@time",
+		"cpu ms", "cpu var", "cpu var@time");
+
+	Light_Sampling loaded = m_Scene.m_LightSampling;
+	NoiseStats gpu_uniform, cpu_uniform;
+
+	for (Light_Sampling mode : { LIGHT_SAMPLING_UNIFORM, LIGHT_SAMPLING_TREE }) {
+		m_Scene.m_LightSampling = mode;
+
+		NoiseStats gpu = MeasureNoiseGPU();
+		NoiseStats cpu = MeasureNoiseCPU();
+		if (mode == LIGHT_SAMPLING_UNIFORM) {
+			gpu_uniform = gpu;
+			cpu_uniform = cpu;
+		}
+
+		printf("%-10s %8d %12.3f %12.5f %14.5f %12.3f %12.5f %14.5f\n",
+			mode == LIGHT_SAMPLING_TREE ? "tree" : "uniform", (int)m_Scene.m_Lights.size(),
+			gpu.m_Ms, gpu.m_Variance, gpu.m_Variance * gpu.m_Ms / gpu_uniform.m_Ms,
+			cpu.m_Ms, cpu.m_Variance, cpu.m_Variance * cpu.m_Ms / cpu_uniform.m_Ms);
+	}
+
+	m_Scene.m_LightSampling = loaded;
+}
+
+void Benchmark::RunSphereKernels()
+{
+	if (m_Scene.m_Spheres.empty())
+		return;
+
+	// Fixed directions around the camera so every instruction set traces the same rays
+	std::mt19937 generator(1234);
+	std::normal_distribution<float> normal(0.f, 1.f);
+	std::vector<Ray> rays(m_KernelRays);
+	for (Ray& r : rays) {
+		r.origin = m_Camera.m_LookFrom;
+		r.direction = glm::normalize(glm::vec3(normal(generator), normal(generator), normal(generator)));
+	}
+
+	SphereBlocks reference;
+	reference.m_Isa = SIMD_SCALAR;
+	reference.Build(m_Scene);
+	std::vector<Interval> expected(rays.size(), Interval{ 0.001f, FLT_MAX });
+	std::vector<int> expected_prim(rays.size(), -1);
+	for (size_t i = 0; i < rays.size(); i++)
+		reference.Closest(rays[i], expected[i], expected_prim[i]);
+
+	printf("\n%-8s %8s %16s %10s %10s %12s\n", "isa", "spheres", "M isect/s/core", "speedup", "prim diffs", "max t error");
+
+	double scalar_rate = 0.0;
+	for (Simd_Isa isa : { SIMD_SCALAR, SIMD_SSE4, SIMD_AVX2, SIMD_AVX512 }) {
+		if (isa > SphereBlocks::DetectIsa())
+			break;
+
+		SphereBlocks blocks;
+		blocks.m_Isa = isa;
+		blocks.Build(m_Scene);
+
+		// Same hits as the scalar walk. Distances differ by rounding where the compiler fuses
+		// multiply-adds, most near grazing hits.
+		int prim_diffs = 0;
+		float max_error = 0.f;
+		for (size_t i = 0; i < rays.size(); i++) {
+			Interval ray_t = { 0.001f, FLT_MAX };
+			int prim_id = -1;
+			blocks.Closest(rays[i], ray_t, prim_id);
+			if (prim_id != expected_prim[i])
+				prim_diffs++;
+			else if (prim_id >= 0)
+				max_error = std::max(max_error, fabsf(ray_t.max - expected[i].max) / expected[i].max);
+		}
+
+		// Single thread, repeated until the timing is long enough to trust
+		long long tests = 0;
+		auto start = std::chrono::steady_clock::now();
+		do {
+			for (const Ray& r : rays) {
+				Interval ray_t = { 0.001f, FLT_MAX };
+				int prim_id = -1;
+				blocks.Closest(r, ray_t, prim_id);
+			}
+			tests += (long long)rays.size() * blocks.Count();
+		} while (elapsed_ms(start) < 200.0);
+		double rate = tests / (elapsed_ms(start) * 1e3);
+		if (isa == SIMD_SCALAR)
+			scalar_rate = rate;
+
+		printf("%-8s %8d %16.1f %9.2fx %10d %12.2e\n", SphereBlocks::IsaName(isa), blocks.Count(), rate,
+			rate / scalar_rate, prim_diffs, max_error);
+	}
+}
+
+void Benchmark::RunPackets()
+{
+	printf("\n%-8s %-8s %14s %10s %12s\n", "rays", "accel", "M rays/s/core", "speedup", "differences");
+
+	bool loaded = m_CPUTracer.m_UsePackets;
+	std::vector<int> single, packets;
+	double single_rate = 0.0;
+
+	for (bool use_packets : { false, true }) {
+		m_CPUTracer.m_UsePackets = use_packets;
+		std::vector<int>& prims = use_packets ? packets : single;
+
+		int frames = 0;
+		auto start = std::chrono::steady_clock::now();
+		do {
+			m_CPUTracer.PrimaryHits(m_Camera, m_Width, m_Height, prims);
+			frames++;
+		} while (elapsed_ms(start) < 200.0);
+		double rate = double(m_Width) * m_Height * frames / (elapsed_ms(start) * 1e3);
+		if (!use_packets)
+			single_rate = rate;
+
+		// Packets find the same first hits. They search the culled primitives in table order,
+		// against the grid a few exact ties can go the other way.
+		int differences = 0;
+		for (size_t i = 0; i < packets.size(); i++)
+			differences += packets[i] != single[i];
+
+		printf("%-8s %-8s %14.2f %9.2fx %12d\n", use_packets ? "packets" : "single", accel_name(m_Scene.m_AccelType),
+			rate, rate / single_rate, differences);
+	}
+
+	m_CPUTracer.m_UsePackets = loaded;
+}
+
+void Benchmark::RunStreams()
+{
+	printf("\n%-10s %12s %10s %18s %12s %12s\n", "order", "cpu ms", "speedup", "bounce Mrays/s/core", "sort ms", "cpu var");
+
+	bool loaded_streams = m_CPUTracer.m_UseStreams;
+	bool loaded_sort = m_CPUTracer.m_SortStreams;
+	double pixel_ms = 0.0;
+
+	struct Config { bool streams; bool sort; const char* name; };
+	const Config configs[] = {
+		{ false, false, "pixel" },
+		{ true, false, "stream" },
+		{ true, true, "sorted" },
+	};
+
+	for (const Config& config : configs) {
+		m_CPUTracer.m_UseStreams = config.streams;
+		m_CPUTracer.m_SortStreams = config.sort;
+
+		NoiseStats cpu = MeasureNoiseCPU();
+		if (!config.streams)
+			pixel_ms = cpu.m_Ms;
+
+		// Trace time is summed over the workers, the rate is per core
+		const CPUTracer::StreamStats& stats = m_CPUTracer.m_StreamStats;
+		if (config.streams)
+			printf("%-10s %12.3f %9.2fx %18.2f %12.3f %12.5f\n", config.name, cpu.m_Ms, pixel_ms / cpu.m_Ms,
+				stats.m_Rays / (stats.m_TraceMs * 1e3), stats.m_SortMs, cpu.m_Variance);
+		else
+			printf("%-10s %12.3f %9.2fx %18s %12s %12.5f\n", config.name, cpu.m_Ms, 1.0, "-", "-", cpu.m_Variance);
+	}
+
+	m_CPUTracer.m_UseStreams = loaded_streams;
+	m_CPUTracer.m_SortStreams = loaded_sort;
+}
+
+void Benchmark::RunScheduling()
+{
+	TileScheduler& scheduler = m_CPUTracer.m_Scheduler;
+	int loaded_size = m_CPUTracer.m_TileSize;
+	int hardware = (int)std::max(1u, std::thread::hardware_concurrency());
+
+	printf("\n%-10s %6s %12s %10s %10s\n", "tiles", "size", "cpu ms", "speedup", "stolen");
+
+	// Striped rows of tiles without stealing, like the scheduling before the tile queues
+	struct Config { Tile_Order order; bool steal; int size; const char* name; };
+	const Config configs[] = {
+		{ TILE_ORDER_ROWS, false, 16, "rows" },
+		{ TILE_ORDER_HILBERT, true, 8, "hilbert" },
+		{ TILE_ORDER_HILBERT, true, 16, "hilbert" },
+		{ TILE_ORDER_HILBERT, true, 32, "hilbert" },
+		{ TILE_ORDER_HILBERT, true, 64, "hilbert" },
+	};
+
+	double rows_ms = 0.0;
+	for (const Config& config : configs) {
+		scheduler.m_Order = config.order;
+		scheduler.m_Steal = config.steal;
+		m_CPUTracer.m_TileSize = config.size;
+
+		double cpu_ms = TimeCPU();
+		if (config.order == TILE_ORDER_ROWS)
+			rows_ms = cpu_ms;
+
+		int stolen = 0;
+		for (const TileScheduler::WorkerStats& stats : scheduler.m_Stats)
+			stolen += stats.m_Stolen;
+		printf("%-10s %6d %12.3f %9.2fx %10d\n", config.name, config.size, cpu_ms, rows_ms / cpu_ms, stolen);
+	}
+
+	// Efficiency is the busy share of the frame summed over the workers, 1 is perfect scaling
+	printf("\n%-8s %12s %10s %12s %12s %12s %10s\n", "workers", "cpu ms", "scaling", "busy min ms", "busy max ms",
+		"idle max ms", "efficiency");
+
+	scheduler.m_Order = TILE_ORDER_HILBERT;
+	scheduler.m_Steal = true;
+	m_CPUTracer.m_TileSize = loaded_size;
+
+	double single_ms = 0.0;
+	for (int workers = 1; ; workers = std::min(workers * 2, hardware)) {
+		m_CPUTracer.m_ThreadCount = workers;
+		double cpu_ms = TimeCPU();
+		if (workers == 1)
+			single_ms = cpu_ms;
+
+		double busy_min = DBL_MAX, busy_max = 0.0, busy_sum = 0.0, idle_max = 0.0, frame_ms = 0.0;
+		for (const TileScheduler::WorkerStats& stats : scheduler.m_Stats) {
+			busy_min = std::min(busy_min, stats.m_BusyMs);
+			busy_max = std::max(busy_max, stats.m_BusyMs);
+			busy_sum += stats.m_BusyMs;
+			idle_max = std::max(idle_max, stats.m_IdleMs);
+			frame_ms = std::max(frame_ms, stats.m_BusyMs + stats.m_IdleMs);
+		}
+
+		printf("%-8d %12.3f %9.2fx %12.3f %12.3f %12.3f %9.1f%%\n", workers, cpu_ms, single_ms / cpu_ms,
+			busy_min, busy_max, idle_max, 100.0 * busy_sum / (frame_ms * workers));
+
+		if (workers == hardware)
+			break;
+	}
+
+	m_CPUTracer.m_ThreadCount = 0;
+}
+
+void Benchmark::RunNuma()
+{
+	Topology& topology = m_CPUTracer.m_Topology;
+	if (topology.m_Nodes.empty())
+		topology.Detect();
+	int node_count = (int)topology.m_Nodes.size();
+
+	// Efficiency is the work per CPU relative to a single node, 100% is linear scaling
+	printf("\n%-6s %8s %10s %12s %10s %11s\n", "nodes", "workers", "placement", "cpu ms", "scaling", "efficiency");
+
+	struct Config { bool pin; bool replicate; const char* name; };
+	const Config configs[] = {
+		{ true, true, "numa" },
+		{ true, false, "pinned" },
+		{ false, false, "os" },
+	};
+
+	double single_ms = 0.0;
+	int single_cpus = topology.CpuCount(1);
+
+	for (int nodes = 1; nodes <= node_count; nodes++) {
+		for (const Config& config : configs) {
+			// Without placement the workers are only limited in number
+			if (!config.pin && nodes != node_count)
+				continue;
+
+			m_CPUTracer.m_NodeCount = nodes;
+			m_CPUTracer.m_PinThreads = config.pin;
+			m_CPUTracer.m_ReplicateScene = config.replicate;
+			int cpus = topology.CpuCount(nodes);
+			m_CPUTracer.m_ThreadCount = cpus;
+
+			double cpu_ms = TimeCPU();
+			if (nodes == 1 && config.pin && config.replicate)
+				single_ms = cpu_ms;
+
+			printf("%-6d %8d %10s %12.3f %9.2fx %10.1f%%\n", nodes, cpus, config.name, cpu_ms, single_ms / cpu_ms,
+				100.0 * single_ms * single_cpus / (cpu_ms * cpus));
+		}
+	}
+
+	m_CPUTracer.m_NodeCount = 0;
+	m_CPUTracer.m_PinThreads = true;
+	m_CPUTracer.m_ReplicateScene = true;
+	m_CPUTracer.m_ThreadCount = 0;
+}
+
+// Mean luminance of rows [first_row, last_row) of a width wide frame
+static double rows_luminance(const std::vector<glm::vec4>& frame, unsigned int width, int first_row, int last_row) {
+	double total = 0.0;
+	for (size_t i = size_t(first_row) * width; i < size_t(last_row) * width; i++)
+		total += glm::dot(glm::vec3(frame[i]), glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	return last_row > first_row ? total / (double(last_row - first_row) * width) : 0.0;
+}
+
+void Benchmark::RunHybrid()
+{
+	// Sets the tracer uniforms too
+	double gpu_ms = TimeGPU();
+	double cpu_ms = TimeCPU();
+
+	HybridRenderer hybrid;
+	hybrid.Init();
+
+	printf("\n%-6s %10s %9s %9s %10s %10s %10s %10s\n", "hybrid", "gpu share", "gpu rows", "cpu rows", "gpu ms", "cpu ms", "upload ms", "frame ms");
+
+	// Once settled, the CPU rows of every frame are compared with a GPU frame of the same rows
+	double settled_ms = 0.0;
+	int settled_frames = 0;
+	double hybrid_luminance = 0.0;
+	double gpu_luminance = 0.0;
+	std::vector<glm::vec4> frame(size_t(m_Width) * m_Height);
+
+	for (int i = 0; i < m_HybridFrames; i++) {
+		float share = hybrid.m_GpuShare;
+
+		auto start = std::chrono::steady_clock::now();
+		m_Compute.setFloat("uSeed", random_float());
+		m_CPUTracer.m_RouletteDepth = m_RouletteDepth;
+		hybrid.RenderFrame(m_Compute.m_ProgramId, m_Dispatcher, m_CPUTracer, m_Camera, m_Image, m_Width, m_Height, m_Samples, m_MaxDepth);
+		glFinish();
+		double frame_ms = elapsed_ms(start);
+
+		printf("%-6d %9.1f%% %9d %9d %10.3f %10.3f %10.3f %10.3f\n", i, share * 100.0, hybrid.m_GpuRows, hybrid.m_CpuRows,
+			hybrid.m_GpuRows > 0 ? hybrid.m_GpuMs : 0.0, hybrid.m_CpuRows > 0 ? hybrid.m_CpuMs : 0.0, hybrid.m_UploadMs, frame_ms);
+
+		if (i < m_HybridFrames / 2)
+			continue;
+		settled_ms += frame_ms;
+		settled_frames++;
+
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+		glBindTexture(GL_TEXTURE_2D, m_Image);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, frame.data());
+		hybrid_luminance += rows_luminance(frame, m_Width, hybrid.m_GpuRows, m_Height);
+
+		m_Compute.setFloat("uSeed", random_float());
+		m_Dispatcher.Dispatch(m_Compute.m_ProgramId, m_Width, m_Height);
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, frame.data());
+		gpu_luminance += rows_luminance(frame, m_Width, hybrid.m_GpuRows, m_Height);
+	}
+
+	// Both sides busy the whole frame, each at its rate alone
+	double ideal_ms = 1.0 / (1.0 / gpu_ms + 1.0 / cpu_ms);
+	double hybrid_ms = settled_frames > 0 ? settled_ms / settled_frames : 0.0;
+	printf("gpu alone %.3f ms, cpu alone %.3f ms, ideal split %.3f ms, hybrid %.3f ms (%.2fx over the gpu)\n",
+		gpu_ms, cpu_ms, ideal_ms, hybrid_ms, hybrid_ms > 0.0 ? gpu_ms / hybrid_ms : 0.0);
+	printf("cpu rows mean luminance: hybrid %.4f, gpu %.4f\n", hybrid_luminance / std::max(settled_frames, 1),
+		gpu_luminance / std::max(settled_frames, 1));
+}
+
+// Pixels whose bits differ
+static size_t differing_pixels(const glm::vec4* a, const glm::vec4* b, size_t count) {
+	size_t differ = 0;
+	for (size_t i = 0; i < count; i++)
+		differ += memcmp(&a[i], &b[i], sizeof(glm::vec4)) != 0;
+	return differ;
+}
+
+void Benchmark::RunDeterminism()
+{
+	TileScheduler& scheduler = m_CPUTracer.m_Scheduler;
+	int loaded_size = m_CPUTracer.m_TileSize;
+	int workers = std::max(4, (int)std::thread::hardware_concurrency());
+	size_t pixels = size_t(m_Width) * m_Height;
+
+	printf("\n%-14s %14s %14s %12s\n", "deterministic", "reference ms", "other ms", "differing");
+
+	m_CPUTracer.m_RouletteDepth = m_RouletteDepth;
+	m_CPUTracer.m_Deterministic = true;
+	m_CPUTracer.m_Seed = 1;
+
+	struct Config { bool packets; bool streams; const char* name; };
+	const Config configs[] = {
+		{ false, false, "cpu pixels" },
+		{ true, false, "cpu packets" },
+		{ false, true, "cpu streams" },
+	};
+
+	for (const Config& config : configs) {
+		m_CPUTracer.m_UsePackets = config.packets;
+		m_CPUTracer.m_UseStreams = config.streams;
+
+		// One worker walking rows of small tiles
+		scheduler.m_Order = TILE_ORDER_ROWS;
+		scheduler.m_Steal = false;
+		m_CPUTracer.m_TileSize = 16;
+		m_CPUTracer.m_ThreadCount = 1;
+		auto start = std::chrono::steady_clock::now();
+		m_CPUTracer.RenderFrame(m_Camera, m_Width, m_Height, m_Samples, m_MaxDepth);
+		double reference_ms = elapsed_ms(start);
+		std::vector<glm::vec4> reference(m_CPUTracer.m_Framebuffer.begin(), m_CPUTracer.m_Framebuffer.end());
+
+		// Several workers stealing larger Hilbert tiles
+		scheduler.m_Order = TILE_ORDER_HILBERT;
+		scheduler.m_Steal = true;
+		m_CPUTracer.m_TileSize = 32;
+		m_CPUTracer.m_ThreadCount = workers;
+		start = std::chrono::steady_clock::now();
+		m_CPUTracer.RenderFrame(m_Camera, m_Width, m_Height, m_Samples, m_MaxDepth);
+		double other_ms = elapsed_ms(start);
+
+		printf("%-14s %14.3f %14.3f %12zu\n", config.name, reference_ms, other_ms,
+			differing_pixels(reference.data(), m_CPUTracer.m_Framebuffer.data(), pixels));
+	}
+
+	m_CPUTracer.m_Deterministic = false;
+	m_CPUTracer.m_UsePackets = true;
+	m_CPUTracer.m_UseStreams = false;
+	m_CPUTracer.m_TileSize = loaded_size;
+	m_CPUTracer.m_ThreadCount = 0;
+
+	// Persistent threads trace their pixels in whatever order the tiles are fetched, only the
+	// counter based numbers stay the same. The random mode is shown with the same uSeed.
+	m_Compute.use();
+	m_Compute.setInt("SAMPLES", m_Samples);
+	m_Compute.setInt("MAX_DEPTH", m_MaxDepth);
+	m_Compute.setInt("uRouletteDepth", m_RouletteDepth);
+	m_Compute.setInt("uLightSampling", m_Scene.m_LightSampling);
+	m_Compute.setFloat("uSeed", 1.f);
+	m_Compute.setUInt("uSeedBits", 1);
+	m_Camera.setUniforms(m_Compute.m_ProgramId);
+
+	std::vector<glm::vec4> tiles(pixels), persistent(pixels);
+	for (bool deterministic : { true, false }) {
+		m_Compute.setBool("uDeterministic", deterministic);
+		double ms[2];
+		for (int i = 0; i < 2; i++) {
+			m_Dispatcher.m_Mode = i == 0 ? DISPATCH_TILES : DISPATCH_PERSISTENT;
+			auto start = std::chrono::steady_clock::now();
+			m_Dispatcher.Dispatch(m_Compute.m_ProgramId, m_Width, m_Height);
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+			glBindTexture(GL_TEXTURE_2D, m_Image);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, i == 0 ? tiles.data() : persistent.data());
+			ms[i] = elapsed_ms(start);
+		}
+		printf("%-14s %14.3f %14.3f %12zu\n", deterministic ? "gpu persistent" : "gpu random", ms[0], ms[1],
+			differing_pixels(tiles.data(), persistent.data(), pixels));
+	}
+
+	m_Compute.setBool("uDeterministic", false);
+	m_Dispatcher.m_Mode = DISPATCH_TILES;
+}
+
+void Benchmark::RunKernels()
+{
+	size_t pixels = size_t(m_Width) * m_Height;
+
+	printf("\n%-10s %9s %7s %12s %14s %9s %12s\n", "kernel", "materials", "depth", "generic ms",
+		"specialized ms", "speedup", "differing");
+
+	m_CPUTracer.m_Deterministic = true;
+	m_CPUTracer.m_Seed = 1;
+
+	std::vector<GPUMaterial> loaded = Material::gpuMats;
+	for (bool lambertian : { false, true }) {
+		// Emitters become Lambertian too, so both kernels trace the scene without lights
+		if (lambertian) {
+			for (GPUMaterial& mat : Material::gpuMats)
+				mat.type_ref_pad.x = float(LAMBERTIAN);
+			m_Scene.BuildLightList();
+		}
+
+		m_CPUTracer.m_Specialize = false;
+		double generic_ms = TimeCPU();
+		std::vector<glm::vec4> generic(m_CPUTracer.m_Framebuffer.begin(), m_CPUTracer.m_Framebuffer.end());
+
+		m_CPUTracer.m_Specialize = true;
+		double specialized_ms = TimeCPU();
+
+		printf("%-10s %#9x %7d %12.3f %14.3f %8.2fx %12zu\n", lambertian ? "lambertian" : "loaded",
+			m_CPUTracer.m_KernelMaterials, m_CPUTracer.m_KernelDepth, generic_ms, specialized_ms,
+			generic_ms / specialized_ms, differing_pixels(generic.data(), m_CPUTracer.m_Framebuffer.data(), pixels));
+	}
+
+	Material::gpuMats = loaded;
+	m_Scene.BuildLightList();
+	m_CPUTracer.m_Deterministic = false;
+}
+
+Benchmark::NoiseStats Benchmark::MeasureNoiseGPU()
+{
+	NoiseStats stats;
+	stats.m_Ms = TimeGPU();
+
+	PixelVariance variance;
+	std::vector<glm::vec4> frame(size_t(m_Width) * m_Height);
+	for (int i = 0; i < m_VarianceFrames; i++) {
+		m_Compute.setFloat("uSeed", random_float());
+		m_Dispatcher.Dispatch(m_Compute.m_ProgramId, m_Width, m_Height);
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+		glBindTexture(GL_TEXTURE_2D, m_Image);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, frame.data());
+		variance.Add(frame);
+	}
+
+	stats.m_Variance = variance.Mean();
+	return stats;
+}
+
+Benchmark::NoiseStats Benchmark::MeasureNoiseCPU()
+{
+	NoiseStats stats;
+	PixelVariance variance;
+	int frames = std::max(m_CPUFrames, 2);
+
+	double render_ms = 0.0;
+	for (int i = 0; i < frames; i++) {
+		auto start = std::chrono::steady_clock::now();
+		m_CPUTracer.m_RouletteDepth = m_RouletteDepth;
+		m_CPUTracer.RenderFrame(m_Camera, m_Width, m_Height, m_Samples, m_MaxDepth);
+		render_ms += elapsed_ms(start);
+		variance.Add(m_CPUTracer.m_Framebuffer);
+	}
+
+	stats.m_Ms = render_ms / frames;
+	stats.m_Variance = variance.Mean();
+	return stats;
+}
+
+double Benchmark::TimeGPU()
+{
+	m_Compute.use();
+	m_Compute.setInt("SAMPLES", m_Samples);
+	m_Compute.setInt("MAX_DEPTH", m_MaxDepth);
+	m_Compute.setInt("uRouletteDepth", m_RouletteDepth);
+	m_Compute.setInt("uLightSampling", m_Scene.m_LightSampling);
+	m_Camera.setUniforms(m_Compute.m_ProgramId);
+
+	// Warm up, the first dispatch includes driver side work
+	m_Compute.setFloat("uSeed", random_float());
+	m_Dispatcher.Dispatch(m_Compute.m_ProgramId, m_Width, m_Height);
+	glFinish();
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < m_GPUFrames; i++) {
+		m_Compute.setFloat("uSeed", random_float());
+		m_Dispatcher.Dispatch(m_Compute.m_ProgramId, m_Width, m_Height);
+		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+	}
+	glFinish();
+
+	return elapsed_ms(start) / m_GPUFrames;
+}
+
+double Benchmark::TimeCPU()
+{
+	m_CPUTracer.m_RouletteDepth = m_RouletteDepth;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < m_CPUFrames; i++)
+		m_CPUTracer.RenderFrame(m_Camera, m_Width, m_Height, m_Samples, m_MaxDepth);
+
+	return elapsed_ms(start) / m_CPUFrames;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Scene.h"
+#include "shader.h"
+#include "camera.h"
+#include "CPUTracer.h"
+#include "Dispatcher.h"
+
+// Benchmark suite, run with --bench. Renders fixed frames of the loaded scene on
+// both backends and prints the timings to stdout.
+class Benchmark {
+
+public:
+	Benchmark(Scene& scene, Shader& compute, const Camera& cam, unsigned int width, unsigned int height, int samples, int max_depth);
+	~Benchmark();
+
+	void Run();
+
+	// Build and trace time of every acceleration structure
+	void RunAcceleration();
+
+	// GPU frame time and workgroup utilization of tiles vs persistent threads
+	void RunDispatch();
+
+	// Paths per second and noise of Russian roulette at several start depths
+	void RunRoulette();
+
+	// Noise at equal time of uniform light selection vs the light tree, skipped without lights
+	void RunLightSampling();
+
+	// Single core ray-sphere intersections per second of each SphereBlocks instruction set
+	void RunSphereKernels();
+
+	// Single core camera ray first hits per second, one ray at a time vs frustum culled packets
+	void RunPackets();
+
+	// CPU frame time of per pixel recursion vs ray streams, unsorted and sorted, and the closest
+	// hit rate of the secondary rays of the streams
+	void RunStreams();
+
+	// CPU frame time of striped row tiles vs Hilbert ordered tiles with stealing at several tile
+	// sizes, then the scaling of the latter with the worker count and the busy / idle time of the workers
+	void RunScheduling();
+
+	// CPU frame time on the first 1, 2, ... NUMA nodes with pinned workers and per node scene
+	// copies, and the efficiency per node count. At full size also without copies and without pinning.
+	void RunNuma();
+
+	// Split of the rows, frame time and CPU / GPU time of hybrid frames as the split settles, against
+	// GPU and CPU alone, and the mean luminance of the CPU rows next to the GPU rendering of the same rows
+	void RunHybrid();
+
+	// Deterministic frames rendered twice each way: the CPU with one worker on rows of tiles against
+	// several workers on Hilbert tiles with stealing, for pixels, packets and streams, and the GPU
+	// with tiles against persistent threads. Prints the pixels that differ, 0 when bit identical.
+	void RunDeterminism();
+
+	// CPU frame time of the generic kernel vs the one specialized for the materials and depth of
+	// the scene, as loaded and with every material made Lambertian, and the pixels that differ
+	// between the two in deterministic mode, 0 when the specialization only removed dead code
+	void RunKernels();
+
+	// Hybrid frames rendered by RunHybrid()
+	int m_HybridFrames = 12;
+
+	int m_GPUFrames = 20;
+	int m_CPUFrames = 2;
+
+	// Frames rendered to estimate the per pixel variance of one frame
+	int m_VarianceFrames = 8;
+
+	// Random rays from the camera per pass of RunSphereKernels()
+	int m_KernelRays = 4096;
+
+private:
+	Scene& m_Scene;
+	Shader& m_Compute;
+	const Camera& m_Camera;
+	CPUTracer m_CPUTracer;
+	Dispatcher m_Dispatcher;
+	unsigned int m_Width;
+	unsigned int m_Height;
+	int m_Samples;
+	int m_MaxDepth;
+	int m_RouletteDepth;
+
+	// Output of the GPU frames, read back for the variance estimates
+	GLuint m_Image = 0;
+
+	// Average milliseconds per frame
+	double TimeGPU();
+	double TimeCPU();
+
+	// Time and mean per pixel luminance variance of a single frame
+	struct NoiseStats {
+		double m_Ms = 0.0;
+		double m_Variance = 0.0;
+	};
+	NoiseStats MeasureNoiseGPU();
+	NoiseStats MeasureNoiseCPU();
+
+	// Renders one frame with group stats on and reads them back
+	GroupUtilization MeasureUtilization();
+};
@@ -0,0 +1,1132 @@
+#include "CPUTracer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "utilities.h"
+
+// Sample being traced by this thread, the dimension counts the numbers drawn at this bounce
+struct SampleContext {
+	bool m_Deterministic = false;
+	uint32_t m_Seed = 0;
+	glm::ivec2 m_Pixel = glm::ivec2(0);
+	uint32_t m_Sample = 0;
+	uint32_t m_Bounce = 0;
+	uint32_t m_Dimension = 0;
+};
+static thread_local SampleContext sample_context;
+
+// Each worker gets its own generator, random_float() in utilities.h is not thread safe. In
+// deterministic mode the numbers are hashed from the sample context instead.
+static float rand01() {
+	SampleContext& context = sample_context;
+	if (context.m_Deterministic)
+		return sample_float(context.m_Seed, context.m_Pixel, context.m_Sample, context.m_Bounce, context.m_Dimension++);
+
+	thread_local std::mt19937 generator(std::random_device{}());
+	thread_local std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	return distribution(generator);
+}
+
+static glm::vec3 random_in_unit_disk() {
+	glm::vec3 p;
+	do {
+		p = glm::vec3(2.f * rand01() - 1.f, 2.f * rand01() - 1.f, 0.f);
+	} while (glm::dot(p, p) >= 1.f);
+	return p;
+}
+
+// Schlick's approximation for reflectance
+static float reflectance(float cosine, float refraction_index) {
+	float r0 = (1 - refraction_index) / (1 + refraction_index);
+	r0 = r0 * r0;
+	return r0 + (1 - r0) * powf((1 - cosine), 5);
+}
+
+// Rec. 709 luminance, luminance() in utilities.glsl
+static float luminance(const glm::vec3& c) {
+	return glm::dot(c, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// SHADOW_EPSILON in light.glsl_h
+static const float SHADOW_EPSILON = 1e-3f;
+
+// Same as power_heuristic() in light.glsl
+static float power_heuristic(float pdf_a, float pdf_b) {
+	float a2 = pdf_a * pdf_a;
+	return a2 / (a2 + pdf_b * pdf_b);
+}
+
+CPUTracer::CPUTracer(const Scene& scene) : m_Scene(scene)
+{
+	m_SphereBlocks.Build(m_Scene);
+	m_BlocksGeneration = m_Scene.Generation();
+	m_Kernel = MakeKernel<MATERIALS_ALL>(false);
+}
+
+void CPUTracer::RenderFrame(const Camera& cam, unsigned int width, unsigned int height, int samples, int max_depth)
+{
+	Tile frame = { glm::ivec2(0), glm::ivec2(width, height) };
+	RenderRegion(cam, width, height, frame, samples, max_depth);
+}
+
+void CPUTracer::RenderRegion(const Camera& cam, unsigned int width, unsigned int height, const Tile& region, int samples, int max_depth)
+{
+	// Reallocated without copying, so the workers of this frame touch the pages first
+	if (m_Framebuffer.size() != size_t(width) * height) {
+		m_Framebuffer = Framebuffer();
+		m_Framebuffer.resize(size_t(width) * height);
+	}
+	// Repacked when the scene changed, a forced instruction set is checked every frame
+	if (m_BlocksGeneration != m_Scene.Generation()) {
+		m_SphereBlocks.Build(m_Scene);
+		m_BlocksGeneration = m_Scene.Generation();
+	}
+	m_SphereBlocks.m_Isa = std::min(m_SphereBlocks.m_Isa, SphereBlocks::DetectIsa());
+	SelectKernel(max_depth);
+
+	if (m_Topology.m_Nodes.empty())
+		m_Topology.Detect();
+	int thread_count = m_ThreadCount;
+	if (thread_count <= 0)
+		thread_count = m_PinThreads ? m_Topology.CpuCount(m_NodeCount) : (int)std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<Topology::Place> places = m_Topology.Assign(thread_count, m_NodeCount);
+	m_Scheduler.m_Cpus.clear();
+	if (m_PinThreads)
+		for (const Topology::Place& place : places)
+			m_Scheduler.m_Cpus.push_back(place.m_Cpu);
+
+	// Workers of a node read the replica of their node, a single node reads the scene itself
+	int nodes = places.back().m_Node + 1;
+	if (m_ReplicateScene && nodes > 1)
+		UpdateReplicas(nodes);
+	std::vector<const CPUTracer*> node_tracers(nodes, this);
+	for (int n = 0; m_ReplicateScene && nodes > 1 && n < nodes; n++)
+		node_tracers[n] = m_Replicas[n]->m_Tracer.get();
+
+	Film film = MakeFilm(cam, width, height);
+	bool packets = m_UsePackets && !film.m_Defocus;
+	AABB bounds = m_UseStreams ? StreamBounds(film) : AABB();
+	glm::vec4* frame = m_Framebuffer.data();
+
+	// Stream tiles are grown to hold about m_StreamSize paths
+	int tile_size = m_TileSize;
+	if (m_UseStreams) {
+		int side = int(sqrtf(float(m_StreamSize) / float(samples)));
+		tile_size = std::max(m_TileSize, side / m_TileSize * m_TileSize);
+	}
+
+	// Created by the worker that uses them, like the tile queues
+	std::vector<std::unique_ptr<Packet>> worker_packets(thread_count);
+	std::vector<std::unique_ptr<Stream>> worker_streams(thread_count);
+
+	m_Scheduler.Run(region, tile_size, thread_count, [&](int worker, const Tile& tile) {
+		const CPUTracer& tracer = *node_tracers[places[worker].m_Node];
+
+		if (m_UseStreams) {
+			if (!worker_streams[worker])
+				worker_streams[worker].reset(new Stream());
+			tracer.RenderStream(film, tile, frame, width, samples, max_depth, bounds, *worker_streams[worker]);
+			return;
+		}
+
+		if (packets) {
+			if (!worker_packets[worker])
+				worker_packets[worker].reset(new Packet());
+			for (int y = tile.m_Min.y; y < tile.m_Max.y; y += PACKET_TILE) {
+				for (int x = tile.m_Min.x; x < tile.m_Max.x; x += PACKET_TILE) {
+					Tile sub = { glm::ivec2(x, y), glm::min(glm::ivec2(x, y) + PACKET_TILE, tile.m_Max) };
+					tracer.RenderTile(film, sub, frame, width, samples, max_depth, *worker_packets[worker]);
+				}
+			}
+			return;
+		}
+
+		for (int y = tile.m_Min.y; y < tile.m_Max.y; y++) {
+			for (int x = tile.m_Min.x; x < tile.m_Max.x; x++) {
+				glm::vec3 color = tracer.RenderPixel(cam, x, y, width, height, samples, max_depth);
+				frame[size_t(y) * width + x] = glm::vec4(color, 1.f);
+			}
+		}
+	});
+
+	m_StreamStats = StreamStats();
+	for (const std::unique_ptr<Stream>& stream : worker_streams) {
+		if (!stream)
+			continue;
+		m_StreamStats.m_Rays += stream->m_Stats.m_Rays;
+		m_StreamStats.m_TraceMs += stream->m_Stats.m_TraceMs;
+		m_StreamStats.m_SortMs += stream->m_Stats.m_SortMs;
+	}
+}
+
+void CPUTracer::UpdateReplicas(int nodes)
+{
+	if ((int)m_Replicas.size() < nodes)
+		m_Replicas.resize(nodes);
+
+	// One thread per stale node copies the scene while pinned there, assigning into the previous
+	// copy reuses its pages when the sizes did not change
+	std::vector<std::thread> copiers;
+	for (int n = 0; n < nodes; n++) {
+		if (m_Replicas[n] && m_Replicas[n]->m_Generation == m_Scene.Generation())
+			continue;
+
+		copiers.emplace_back([this, n]() {
+			const std::vector<int>& cpus = m_Topology.m_Nodes[n].m_Cpus;
+			if (m_PinThreads)
+				Topology::PinThread(cpus[0]);
+
+			std::unique_ptr<Replica>& replica = m_Replicas[n];
+			if (!replica)
+				replica.reset(new Replica());
+			replica->m_Scene = m_Scene;
+			replica->m_Materials = *m_Materials;
+			replica->m_Generation = m_Scene.Generation();
+			if (!replica->m_Tracer) {
+				replica->m_Tracer.reset(new CPUTracer(replica->m_Scene));
+				replica->m_Tracer->m_Materials = &replica->m_Materials;
+			}
+
+			// The sphere blocks are rebuilt from the copy
+			CPUTracer& tracer = *replica->m_Tracer;
+			tracer.m_SphereBlocks.m_Isa = m_SphereBlocks.m_Isa;
+			tracer.m_SphereBlocks.Build(replica->m_Scene);
+			tracer.m_BlocksGeneration = replica->m_Scene.Generation();
+		});
+	}
+
+	for (std::thread& copier : copiers)
+		copier.join();
+
+	// Settings read while tracing, changed without a new generation
+	for (int n = 0; n < nodes; n++) {
+		Replica& replica = *m_Replicas[n];
+		replica.m_Scene.m_LightSampling = m_Scene.m_LightSampling;
+		replica.m_Scene.m_SkyIntensity = m_Scene.m_SkyIntensity;
+		replica.m_Scene.m_UniformSky = m_Scene.m_UniformSky;
+
+		CPUTracer& tracer = *replica.m_Tracer;
+		tracer.m_RouletteDepth = m_RouletteDepth;
+		tracer.m_Deterministic = m_Deterministic;
+		tracer.m_Seed = m_Seed;
+		tracer.m_FirstSample = m_FirstSample;
+		tracer.m_SortStreams = m_SortStreams;
+		tracer.m_Kernel = m_Kernel;
+		tracer.m_SphereBlocks.m_Isa = m_SphereBlocks.m_Isa;
+	}
+}
+
+AABB CPUTracer::StreamBounds(const Film& film) const
+{
+	// Bounded primitives and the camera, plane hits further out are clamped by the key
+	AABB bounds(film.m_Origin, film.m_Origin);
+	if (m_Scene.m_AccelType == ACCEL_GRID && !m_Scene.m_Grid.m_Cells.empty())
+		bounds.Expand(m_Scene.m_Grid.m_Bounds);
+	else
+		for (int i = 0; i < m_Scene.BoundedCount(); i++)
+			bounds.Expand(m_Scene.PrimitiveBounds(i));
+	return bounds;
+}
+
+void CPUTracer::RenderStream(const Film& film, const Tile& tile, glm::vec4* frame, unsigned int width, int samples, int max_depth, const AABB& bounds, Stream& stream) const
+{
+	glm::ivec2 size = tile.m_Max - tile.m_Min;
+	int count = size.x * size.y;
+	stream.m_Paths.assign(size_t(count) * samples, PathState());
+	stream.m_Live.resize(stream.m_Paths.size());
+
+	// Camera rays, sample after sample of every pixel
+	for (int i = 0; i < count * samples; i++) {
+		int pixel = i / samples;
+		glm::ivec2 xy = tile.m_Min + glm::ivec2(pixel % size.x, pixel / size.x);
+		PathState& path = stream.m_Paths[i];
+		path.m_Pixel = xy;
+		path.m_Sample = uint32_t(m_FirstSample + i % samples);
+		BeginSample(path.m_Pixel, path.m_Sample);
+		path.m_Ray = CameraRay(film, glm::vec2(xy) + glm::vec2(rand01(), rand01()) - 0.5f);
+		stream.m_Live[i] = i;
+	}
+
+	for (int depth = 0; depth < max_depth && !stream.m_Live.empty(); depth++) {
+
+		// Incoherent bounces are sorted, the order is the one hits are searched and shaded in
+		auto start = std::chrono::steady_clock::now();
+		if (m_SortStreams && depth > 0) {
+			stream.m_Keys.resize(stream.m_Live.size());
+			for (size_t i = 0; i < stream.m_Live.size(); i++)
+				stream.m_Keys[i] = RaySorter::Key(stream.m_Paths[stream.m_Live[i]].m_Ray, bounds);
+			stream.m_Sorter.Sort(stream.m_Keys, stream.m_Order);
+			for (int& index : stream.m_Order)
+				index = stream.m_Live[index];
+			stream.m_Live.swap(stream.m_Order);
+		}
+		auto sorted = std::chrono::steady_clock::now();
+
+		// Rays are gathered so the trace loop reads them in sequence
+		stream.m_Rays.resize(stream.m_Live.size());
+		for (size_t i = 0; i < stream.m_Live.size(); i++)
+			stream.m_Rays[i] = stream.m_Paths[stream.m_Live[i]].m_Ray;
+		stream.m_Hits.resize(stream.m_Live.size());
+
+		for (size_t i = 0; i < stream.m_Rays.size(); i++) {
+			const Ray& r = stream.m_Rays[i];
+			FirstHit& hit = stream.m_Hits[i];
+			Interval ray_t = { 0.001f, FLT_MAX };
+
+			// Same order as RayColor(), planes first
+			int plane_id;
+			bool hit_plane = HitPlanes(r, ray_t, plane_id);
+			if (!HitScene(r, ray_t, hit.m_Prim))
+				hit.m_Prim = hit_plane ? plane_id : -1;
+			hit.m_T = ray_t.max;
+		}
+
+		if (depth > 0) {
+			auto traced = std::chrono::steady_clock::now();
+			stream.m_Stats.m_Rays += stream.m_Live.size();
+			stream.m_Stats.m_SortMs += std::chrono::duration<double, std::milli>(sorted - start).count();
+			stream.m_Stats.m_TraceMs += std::chrono::duration<double, std::milli>(traced - sorted).count();
+		}
+
+		stream.m_Next.clear();
+		for (size_t i = 0; i < stream.m_Live.size(); i++)
+			if ((this->*m_Kernel.m_Bounce)(stream.m_Paths[stream.m_Live[i]], stream.m_Hits[i].m_Prim, stream.m_Hits[i].m_T))
+				stream.m_Next.push_back(stream.m_Live[i]);
+		stream.m_Live.swap(stream.m_Next);
+	}
+
+	for (int i = 0; i < count; i++) {
+		glm::vec3 color(0.f);
+		for (int s = 0; s < samples; s++)
+			color += stream.m_Paths[size_t(i) * samples + s].m_Result;
+		glm::ivec2 xy = tile.m_Min + glm::ivec2(i % size.x, i / size.x);
+		frame[size_t(xy.y) * width + xy.x] = glm::vec4(color / float(samples), 1.f);
+	}
+}
+
+void CPUTracer::RenderTile(const Film& film, const Tile& tile, glm::vec4* frame, unsigned int width, int samples, int max_depth, Packet& packet) const
+{
+	BuildTile(film, tile.m_Min.x, tile.m_Min.y, tile.m_Max.x, tile.m_Max.y, packet);
+
+	for (int y = tile.m_Min.y; y < tile.m_Max.y; y += PACKET_SIZE)
+		for (int x = tile.m_Min.x; x < tile.m_Max.x; x += PACKET_SIZE)
+			RenderPacket(film, x, y, std::min(x + PACKET_SIZE, tile.m_Max.x), std::min(y + PACKET_SIZE, tile.m_Max.y), frame, width, samples, max_depth, packet);
+}
+
+void CPUTracer::RenderPacket(const Film& film, int x0, int y0, int x1, int y1, glm::vec4* frame, unsigned int width, int samples, int max_depth, Packet& packet) const
+{
+	BuildPacket(film, x0, y0, x1, y1, packet);
+
+	glm::vec3 colors[PACKET_SIZE * PACKET_SIZE] = {};
+	for (int i = 0; i < samples; i++) {
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				BeginSample(glm::ivec2(x, y), uint32_t(m_FirstSample + i));
+				Ray r = CameraRay(film, glm::vec2(x, y) + glm::vec2(rand01(), rand01()) - 0.5f);
+
+				FirstHit first;
+				Interval ray_t = { 0.001f, FLT_MAX };
+				if (HitPacket(r, packet, ray_t, first.m_Prim))
+					first.m_T = ray_t.max;
+
+				colors[(y - y0) * PACKET_SIZE + (x - x0)] += RayColor(r, max_depth, &first);
+			}
+		}
+	}
+
+	for (int y = y0; y < y1; y++)
+		for (int x = x0; x < x1; x++)
+			frame[size_t(y) * width + x] = glm::vec4(colors[(y - y0) * PACKET_SIZE + (x - x0)] / float(samples), 1.f);
+}
+
+RayFrustum CPUTracer::PixelFrustum(const Film& film, int x0, int y0, int x1, int y1) const
+{
+	// Edge rays of the tile with the jitter of [-0.5, 0.5] pixels at its widest
+	glm::vec2 lo = glm::vec2(x0, y0) - 0.5f;
+	glm::vec2 hi = glm::vec2(x1, y1) - 0.5f;
+	glm::vec2 corners[4] = { lo, glm::vec2(hi.x, lo.y), hi, glm::vec2(lo.x, hi.y) };
+
+	glm::vec3 directions[4];
+	for (int i = 0; i < 4; i++) {
+		glm::vec2 uv = corners[i] / film.m_Size;
+		directions[i] = film.m_LowerLeft + uv.x * film.m_Horizontal + uv.y * film.m_Vertical - film.m_Origin;
+	}
+
+	return RayFrustum(film.m_Origin, directions);
+}
+
+void CPUTracer::BuildTile(const Film& film, int x0, int y0, int x1, int y1, Packet& packet) const
+{
+	// Duplicates are gathered too, the limit of the walk is loose
+	bool grid = m_Scene.m_AccelType == ACCEL_GRID;
+	packet.m_TileWalk = !PixelFrustum(film, x0, y0, x1, y1).Cull(m_Scene, packet.m_TilePrims, grid ? 4 * PACKET_GRID_LIMIT : SIZE_MAX)
+		|| (grid && packet.m_TilePrims.size() > PACKET_GRID_LIMIT * 2);
+}
+
+void CPUTracer::BuildPacket(const Film& film, int x0, int y0, int x1, int y1, Packet& packet) const
+{
+	packet.m_Walk = packet.m_TileWalk;
+	if (packet.m_Walk)
+		return;
+
+	PixelFrustum(film, x0, y0, x1, y1).Cull(m_Scene, packet.m_TilePrims, packet.m_Prims);
+	packet.m_Walk = m_Scene.m_AccelType == ACCEL_GRID && packet.m_Prims.size() > PACKET_GRID_LIMIT;
+	if (packet.m_Walk)
+		return;
+	packet.m_Spheres.m_Isa = m_SphereBlocks.m_Isa;
+	packet.m_Spheres.Build(m_Scene, packet.m_Prims);
+}
+
+bool CPUTracer::HitPacket(const Ray& r, const Packet& packet, Interval& ray_t, int& prim_id) const
+{
+	// Same order as the first bounce of RayColor(): planes, spheres, cubes
+	bool hit_anything = HitPlanes(r, ray_t, prim_id);
+	if (packet.m_Walk) {
+		int scene_id;
+		if (HitScene(r, ray_t, scene_id)) {
+			prim_id = scene_id;
+			hit_anything = true;
+		}
+		return hit_anything;
+	}
+
+	if (packet.m_Spheres.Closest(r, ray_t, prim_id))
+		hit_anything = true;
+
+	float t;
+	for (int prim : packet.m_Prims) {
+		const GPUHittable& h = m_Scene.m_Hittables[prim];
+		if (h.type == HITTABLE_CUBE && IntersectCube(r, ray_t, t, h.index)) {
+			ray_t.max = t;
+			prim_id = prim;
+			hit_anything = true;
+		}
+	}
+
+	return hit_anything;
+}
+
+void CPUTracer::PrimaryHits(const Camera& cam, unsigned int width, unsigned int height, std::vector<int>& prims) const
+{
+	prims.assign(size_t(width) * height, -1);
+	Film film = MakeFilm(cam, width, height);
+
+	if (m_UsePackets && !film.m_Defocus) {
+		Packet packet;
+		for (int ty = 0; ty < (int)height; ty += PACKET_TILE) {
+			for (int tx = 0; tx < (int)width; tx += PACKET_TILE) {
+				int tx1 = std::min(tx + PACKET_TILE, (int)width);
+				int ty1 = std::min(ty + PACKET_TILE, (int)height);
+				BuildTile(film, tx, ty, tx1, ty1, packet);
+
+				for (int y0 = ty; y0 < ty1; y0 += PACKET_SIZE) {
+					for (int x0 = tx; x0 < tx1; x0 += PACKET_SIZE) {
+						int x1 = std::min(x0 + PACKET_SIZE, tx1);
+						int y1 = std::min(y0 + PACKET_SIZE, ty1);
+						BuildPacket(film, x0, y0, x1, y1, packet);
+
+						for (int y = y0; y < y1; y++) {
+							for (int x = x0; x < x1; x++) {
+								Interval ray_t = { 0.001f, FLT_MAX };
+								HitPacket(CameraRay(film, glm::vec2(x, y)), packet, ray_t, prims[size_t(y) * width + x]);
+							}
+						}
+					}
+				}
+			}
+		}
+		return;
+	}
+
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			Ray r = CameraRay(film, glm::vec2(x, y));
+			Interval ray_t = { 0.001f, FLT_MAX };
+			int& prim_id = prims[size_t(y) * width + x];
+			int scene_id;
+			HitPlanes(r, ray_t, prim_id);
+			if (HitScene(r, ray_t, scene_id))
+				prim_id = scene_id;
+		}
+	}
+}
+
+CPUTracer::Film CPUTracer::MakeFilm(const Camera& cam, unsigned int width, unsigned int height) const
+{
+	// Camera basis, same as update_camera() in camera.glsl
+	glm::vec3 camDir = glm::normalize(cam.m_LookFrom - cam.m_LookAt);
+	glm::vec3 camRight = glm::normalize(glm::cross(cam.m_Up, camDir));
+	glm::vec3 camUp = glm::cross(camDir, camRight);
+
+	float aspect = float(width) / float(height);
+	float half_h = tanf(glm::radians(cam.m_Fov) * 0.5f);
+	float half_w = aspect * half_h;
+
+	Film film;
+	film.m_Origin = cam.m_LookFrom;
+	film.m_Horizontal = 2.f * half_w * camRight * cam.m_FocusDist;
+	film.m_Vertical = 2.f * half_h * camUp * cam.m_FocusDist;
+	film.m_LowerLeft = cam.m_LookFrom
+		- camDir * cam.m_FocusDist
+		- camRight * half_w * cam.m_FocusDist
+		- camUp * half_h * cam.m_FocusDist;
+
+	float defocus_radius = cam.m_FocusDist * tanf(glm::radians(cam.m_DefocusAngle / 2));
+	film.m_DefocusU = camRight * defocus_radius;
+	film.m_DefocusV = camUp * defocus_radius;
+	film.m_Defocus = cam.m_DefocusAngle > 0;
+	film.m_Size = glm::vec2(width, height);
+	return film;
+}
+
+Ray CPUTracer::CameraRay(const Film& film, const glm::vec2& pixel) const
+{
+	glm::vec2 uv = pixel / film.m_Size;
+	glm::vec3 filmPoint = film.m_LowerLeft + uv.x * film.m_Horizontal + uv.y * film.m_Vertical;
+
+	Ray r;
+	r.origin = film.m_Origin;
+	if (film.m_Defocus) {
+		glm::vec3 p = random_in_unit_disk();
+		r.origin += p.x * film.m_DefocusU + p.y * film.m_DefocusV;
+	}
+	r.direction = glm::normalize(filmPoint - r.origin);
+	return r;
+}
+
+glm::vec3 CPUTracer::RenderPixel(const Camera& cam, int x, int y, unsigned int width, unsigned int height, int samples, int max_depth) const
+{
+	Film film = MakeFilm(cam, width, height);
+
+	glm::vec3 pixel_color(0.f);
+	for (int i = 0; i < samples; i++) {
+
+		// Jitter in [-0.5, 0.5] for anti-aliasing
+		BeginSample(glm::ivec2(x, y), uint32_t(m_FirstSample + i));
+		Ray r = CameraRay(film, glm::vec2(x, y) + glm::vec2(rand01(), rand01()) - 0.5f);
+		pixel_color += RayColor(r, max_depth);
+	}
+
+	return pixel_color / float(samples);
+}
+
+void CPUTracer::BeginSample(const glm::ivec2& pixel, uint32_t sample) const
+{
+	SampleContext& context = sample_context;
+	context.m_Deterministic = m_Deterministic;
+	context.m_Seed = m_Seed;
+	context.m_Pixel = pixel;
+	context.m_Sample = sample;
+	context.m_Bounce = 0;
+	context.m_Dimension = 0;
+}
+
+template <unsigned int MATERIALS>
+CPUTracer::Kernel CPUTracer::MakeKernel(bool fixed_depth)
+{
+	Kernel kernel;
+	kernel.m_RayColor = fixed_depth ? &CPUTracer::RayColorKernel<MATERIALS, KERNEL_DEPTH> : &CPUTracer::RayColorKernel<MATERIALS, 0>;
+	kernel.m_Bounce = &CPUTracer::Bounce<MATERIALS>;
+	return kernel;
+}
+
+void CPUTracer::SelectKernel(int max_depth)
+{
+	// One entry per material mask
+	using Maker = Kernel (*)(bool);
+	static const Maker makers[MATERIALS_ALL + 1] = {
+		MakeKernel<0x0>, MakeKernel<0x1>, MakeKernel<0x2>, MakeKernel<0x3>,
+		MakeKernel<0x4>, MakeKernel<0x5>, MakeKernel<0x6>, MakeKernel<0x7>,
+		MakeKernel<0x8>, MakeKernel<0x9>, MakeKernel<0xA>, MakeKernel<0xB>,
+		MakeKernel<0xC>, MakeKernel<0xD>, MakeKernel<0xE>, MakeKernel<0xF>,
+	};
+
+	m_KernelMaterials = m_Specialize ? m_Scene.MaterialMask() & MATERIALS_ALL : MATERIALS_ALL;
+	m_KernelDepth = m_Specialize && max_depth == KERNEL_DEPTH ? KERNEL_DEPTH : 0;
+	m_Kernel = makers[m_KernelMaterials](m_KernelDepth != 0);
+}
+
+glm::vec3 CPUTracer::RayColor(Ray r, int max_depth, const FirstHit* first) const
+{
+	if (m_KernelDepth != 0 && max_depth != m_KernelDepth)
+		return RayColorKernel<MATERIALS_ALL, 0>(r, max_depth, first);
+	return (this->*m_Kernel.m_RayColor)(r, max_depth, first);
+}
+
+template <unsigned int MATERIALS, int MAX_DEPTH>
+glm::vec3 CPUTracer::RayColorKernel(Ray r, int max_depth, const FirstHit* first) const
+{
+	PathState path;
+	path.m_Ray = r;
+	path.m_Pixel = sample_context.m_Pixel;
+	path.m_Sample = sample_context.m_Sample;
+
+	// A constant bound lets the compiler see the trip count of the bounce loop
+	const int depth_bound = MAX_DEPTH > 0 ? MAX_DEPTH : max_depth;
+	while (path.m_Depth < depth_bound) {
+
+		int prim_id;
+		Interval ray_t = { 0.001f, FLT_MAX };
+		bool hit_something;
+
+		if (path.m_Depth == 0 && first) {
+			prim_id = first->m_Prim;
+			ray_t.max = first->m_T;
+			hit_something = prim_id >= 0;
+		}
+		else {
+			// Planes first, they shorten ray_t for the acceleration structure
+			int plane_id;
+			bool hit_plane = HitPlanes(path.m_Ray, ray_t, plane_id);
+
+			hit_something = HitScene(path.m_Ray, ray_t, prim_id);
+			if (!hit_something && hit_plane) {
+				prim_id = plane_id;
+				hit_something = true;
+			}
+		}
+
+		if (!Bounce<MATERIALS>(path, hit_something ? prim_id : -1, ray_t.max))
+			break;
+	}
+
+	return path.m_Result;
+}
+
+template <unsigned int MATERIALS>
+bool CPUTracer::Bounce(PathState& path, int prim_id, float t) const
+{
+	const Ray& r = path.m_Ray;
+
+	// Streams interleave the bounces of their paths, every bounce restarts its dimensions
+	SampleContext& context = sample_context;
+	context.m_Pixel = path.m_Pixel;
+	context.m_Sample = path.m_Sample;
+	context.m_Bounce = uint32_t(path.m_Depth + 1);
+	context.m_Dimension = 0;
+
+	// Missed, add sky
+	if (prim_id < 0) {
+		glm::vec3 unit_dir = glm::normalize(r.direction);
+		float blend = 0.5f * (unit_dir.y + 1.f);
+		glm::vec3 sky = m_Scene.m_UniformSky ? glm::vec3(1.f) : (1.f - blend) * glm::vec3(1.f) + blend * glm::vec3(0.5f, 0.7f, 1.f);
+		path.m_Result += path.m_Throughput * sky * m_Scene.m_SkyIntensity;
+		return false;
+	}
+
+	HitRecord closest_rec = ResolveHit(r, t, prim_id);
+	const GPUMaterial& mat = (*m_Materials)[closest_rec.matId];
+	int type = int(mat.type_ref_pad.x + 0.5f);
+
+	// Emitted radiance, lights only emit from their outside. Without emissive materials the
+	// scene has no lights either.
+	if (has_material<MATERIALS>(EMISSIVE) && type == EMISSIVE && closest_rec.front_face) {
+		int light = m_Scene.m_Hittables[prim_id].light;
+		float weight = 1.f;
+		if (!path.m_DeltaBounce && light >= 0 && !m_Scene.m_Lights.empty())
+			weight = power_heuristic(path.m_BsdfPdfPrev, LightPdf(path.m_PointPrev, path.m_NormalPrev, light, closest_rec));
+		path.m_Result += path.m_Throughput * glm::vec3(mat.albedo_fuzz) * mat.type_ref_pad.z * weight;
+	}
+
+	// Next event estimation at non delta hits, MIS weighted
+	bool is_delta = bsdf_is_delta<MATERIALS>(mat);
+	if (has_material<MATERIALS>(EMISSIVE) && !is_delta && !m_Scene.m_Lights.empty())
+		path.m_Result += path.m_Throughput * DirectLight<MATERIALS>(closest_rec, mat, -glm::normalize(r.direction));
+
+	glm::vec3 attenuation;
+	Ray scattered;
+	float pdf;
+	if (!Scatter<MATERIALS>(r, closest_rec, mat, attenuation, scattered, pdf))
+		return false;
+
+	path.m_DeltaBounce = is_delta;
+	path.m_BsdfPdfPrev = pdf;
+	path.m_PointPrev = closest_rec.point;
+	path.m_NormalPrev = closest_rec.normal;
+
+	path.m_Throughput *= attenuation;
+
+	// Russian roulette, survivors are reweighted by 1/p to stay unbiased
+	if (path.m_Depth + 1 >= m_RouletteDepth) {
+		float p = glm::min(luminance(path.m_Throughput), 1.f);
+		if (rand01() >= p)
+			return false;
+		path.m_Throughput /= p;
+	}
+
+	path.m_Ray = scattered;
+	path.m_Depth++;
+	return true;
+}
+
+bool CPUTracer::HitScene(const Ray& r, Interval& ray_t, int& prim_id) const
+{
+	if (m_Scene.m_AccelType == ACCEL_GRID)
+		return HitGrid(r, ray_t, prim_id);
+
+	prim_id = -1;
+	float t;
+	const std::vector<GPUHittable>& table = m_Scene.m_Hittables;
+
+	// Same grouped walk over the primitive table as the shader, spheres a block at a time
+	m_SphereBlocks.Closest(r, ray_t, prim_id);
+
+	int begin = m_Scene.TypeOffset(HITTABLE_CUBE);
+	int end = begin + m_Scene.TypeCount(HITTABLE_CUBE);
+	for (int i = begin; i < end; i++) {
+		if (IntersectCube(r, ray_t, t, table[i].index)) {
+			ray_t.max = t;
+			prim_id = i;
+		}
+	}
+
+	return prim_id >= 0;
+}
+
+bool CPUTracer::HitPlanes(const Ray& r, Interval& ray_t, int& prim_id) const
+{
+	prim_id = -1;
+	float t;
+
+	int begin = m_Scene.TypeOffset(HITTABLE_PLANE);
+	int end = begin + m_Scene.TypeCount(HITTABLE_PLANE);
+	for (int i = begin; i < end; i++) {
+		if (IntersectPlane(r, ray_t, t, m_Scene.m_Hittables[i].index)) {
+			ray_t.max = t;
+			prim_id = i;
+		}
+	}
+
+	return prim_id >= 0;
+}
+
+bool CPUTracer::HitCell(const Ray& r, const glm::ivec4& cell, Interval& ray_t, int& prim_id, bool any_hit) const
+{
+	bool hit_anything = false;
+	float t;
+	const std::vector<int>& prims = m_Scene.m_Grid.m_CellPrims;
+
+	// Cell ranges are grouped by type like the primitive table
+	int sphere_end = cell.x + cell.y;
+	for (int i = cell.x; i < sphere_end; i++) {
+		if (IntersectSphere(r, ray_t, t, m_Scene.m_Hittables[prims[i]].index)) {
+			ray_t.max = t;
+			prim_id = prims[i];
+			hit_anything = true;
+			if (any_hit)
+				return true;
+		}
+	}
+
+	for (int i = sphere_end; i < sphere_end + cell.z; i++) {
+		if (IntersectCube(r, ray_t, t, m_Scene.m_Hittables[prims[i]].index)) {
+			ray_t.max = t;
+			prim_id = prims[i];
+			hit_anything = true;
+			if (any_hit)
+				return true;
+		}
+	}
+
+	return hit_anything;
+}
+
+bool CPUTracer::HitGrid(const Ray& r, Interval& ray_t, int& prim_id, bool any_hit) const
+{
+	const UniformGrid& grid = m_Scene.m_Grid;
+	prim_id = -1;
+
+	// Oversized primitives live outside the grid
+	if (HitCell(r, grid.m_Escape, ray_t, prim_id, any_hit) && any_hit)
+		return true;
+
+	if (grid.m_Cells.empty())
+		return prim_id >= 0;
+
+	// Slab test against the grid bounds
+	glm::vec3 inv_dir = 1.f / r.direction;
+	glm::vec3 t0 = (grid.m_Bounds.m_Min - r.origin) * inv_dir;
+	glm::vec3 t1 = (grid.m_Bounds.m_Max - r.origin) * inv_dir;
+	glm::vec3 t_small = glm::min(t0, t1);
+	glm::vec3 t_big = glm::max(t0, t1);
+	float t_enter = glm::max(glm::max(t_small.x, t_small.y), t_small.z);
+	float t_exit = glm::min(glm::min(t_big.x, t_big.y), t_big.z);
+	if (t_enter > t_exit || t_exit <= ray_t.min || t_enter >= ray_t.max)
+		return prim_id >= 0;
+
+	// Starting cell
+	glm::vec3 cell_size = grid.m_Bounds.Extent() / glm::vec3(grid.m_Resolution);
+	glm::vec3 start = r.at(glm::max(t_enter, ray_t.min));
+	glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor((start - grid.m_Bounds.m_Min) / cell_size)), glm::ivec3(0), grid.m_Resolution - 1);
+
+	// Distance to the next cell boundary on each axis and between boundaries
+	glm::ivec3 step = glm::ivec3(glm::sign(r.direction));
+	glm::vec3 t_max(FLT_MAX), t_delta(FLT_MAX);
+	for (int axis = 0; axis < 3; axis++) {
+		if (step[axis] == 0)
+			continue;
+		float next_boundary = grid.m_Bounds.m_Min[axis] + (cell[axis] + (step[axis] > 0 ? 1 : 0)) * cell_size[axis];
+		t_max[axis] = (next_boundary - r.origin[axis]) * inv_dir[axis];
+		t_delta[axis] = fabsf(cell_size[axis] * inv_dir[axis]);
+	}
+
+	while (true) {
+
+		if (HitCell(r, grid.m_Cells[grid.CellIndex(cell.x, cell.y, cell.z)], ray_t, prim_id, any_hit) && any_hit)
+			break;
+
+		// A hit before the cell exit cannot be beaten by later cells
+		float t_cell_exit = glm::min(glm::min(t_max.x, t_max.y), t_max.z);
+		if (ray_t.max <= t_cell_exit)
+			break;
+
+		// Step along the axis with the closest boundary
+		int axis = (t_max.x < t_max.y && t_max.x < t_max.z) ? 0 : (t_max.y < t_max.z ? 1 : 2);
+		cell[axis] += step[axis];
+		if (cell[axis] < 0 || cell[axis] >= grid.m_Resolution[axis])
+			break;
+		t_max[axis] += t_delta[axis];
+	}
+
+	return prim_id >= 0;
+}
+
+bool CPUTracer::Occluded(const Ray& r, const Interval& ray_t) const
+{
+	float t;
+	const std::vector<GPUHittable>& table = m_Scene.m_Hittables;
+
+	int begin = m_Scene.TypeOffset(HITTABLE_PLANE);
+	int end = begin + m_Scene.TypeCount(HITTABLE_PLANE);
+	for (int i = begin; i < end; i++)
+		if (IntersectPlane(r, ray_t, t, table[i].index))
+			return true;
+
+	if (m_Scene.m_AccelType == ACCEL_GRID) {
+		Interval grid_t = ray_t;
+		int prim_id;
+		return HitGrid(r, grid_t, prim_id, true);
+	}
+
+	if (m_SphereBlocks.Occluded(r, ray_t))
+		return true;
+
+	begin = m_Scene.TypeOffset(HITTABLE_CUBE);
+	end = begin + m_Scene.TypeCount(HITTABLE_CUBE);
+	for (int i = begin; i < end; i++)
+		if (IntersectCube(r, ray_t, t, table[i].index))
+			return true;
+
+	return false;
+}
+
+bool CPUTracer::SampleSphereLight(const glm::vec3& p, int index, glm::vec3& wi, float& dist, float& pdf) const
+{
+	const glm::vec4& cr = m_Scene.m_Spheres[index].center_radius;
+	glm::vec3 to_center = glm::vec3(cr) - p;
+	float dist2 = glm::dot(to_center, to_center);
+	float sin2_max = cr.w * cr.w / dist2;
+	if (sin2_max >= 1.f)
+		return false;
+
+	// 1 - cos_max without the cancellation for small or distant lights
+	float cos_max = sqrtf(1.f - sin2_max);
+	float one_minus_cos_max = sin2_max / (1.f + cos_max);
+
+	float cos_theta = 1.f - rand01() * one_minus_cos_max;
+	float sin_theta = sqrtf(glm::max(0.f, 1.f - cos_theta * cos_theta));
+	float phi = 2.f * float(PI) * rand01();
+
+	glm::vec3 w = to_center / sqrtf(dist2);
+	glm::vec3 u, v;
+	make_basis(w, u, v);
+	wi = glm::normalize(u * (cosf(phi) * sin_theta) + v * (sinf(phi) * sin_theta) + w * cos_theta);
+
+	if (!IntersectSphere({ p, wi }, { 0.f, FLT_MAX }, dist, index))
+		return false;
+
+	pdf = 1.f / (2.f * float(PI) * one_minus_cos_max);
+	return true;
+}
+
+bool CPUTracer::SampleCubeLight(const glm::vec3& p, int index, glm::vec3& wi, float& dist, float& pdf) const
+{
+	const GPUCube& cube = m_Scene.m_Cubes[index];
+	glm::vec3 box_min = glm::vec3(cube.min_pad);
+	glm::vec3 box_max = glm::vec3(cube.max_matId);
+	glm::vec3 size = box_max - box_min;
+
+	// Uniform point on the surface, faces picked by area
+	glm::vec3 face_area(size.y * size.z, size.x * size.z, size.x * size.y);
+	float total_area = 2.f * (face_area.x + face_area.y + face_area.z);
+
+	float pick = rand01() * (face_area.x + face_area.y + face_area.z);
+	int axis = pick < face_area.x ? 0 : (pick < face_area.x + face_area.y ? 1 : 2);
+
+	glm::vec3 q = box_min + size * glm::vec3(rand01(), rand01(), rand01());
+	bool max_side = rand01() < 0.5f;
+	q[axis] = max_side ? box_max[axis] : box_min[axis];
+
+	glm::vec3 n(0.f);
+	n[axis] = max_side ? 1.f : -1.f;
+
+	glm::vec3 d = q - p;
+	float dist2 = glm::dot(d, d);
+	dist = sqrtf(dist2);
+	wi = d / dist;
+
+	float cos_light = -glm::dot(wi, n);
+	if (cos_light <= 0.f)
+		return false;
+
+	pdf = dist2 / (cos_light * total_area);
+	return true;
+}
+
+bool CPUTracer::SampleLight(const glm::vec3& p, const glm::vec3& n, glm::vec3& wi, float& dist, glm::vec3& Le, float& pdf) const
+{
+	const std::vector<GPULight>& lights = m_Scene.m_Lights;
+	if (lights.empty())
+		return false;
+
+	int light;
+	float pmf;
+	if (m_Scene.m_LightSampling == LIGHT_SAMPLING_TREE) {
+		light = m_Scene.m_LightTree.Sample(p, n, rand01(), pmf);
+		if (light < 0)
+			return false;
+	}
+	else {
+		light = glm::min(int(rand01() * lights.size()), (int)lights.size() - 1);
+		pmf = 1.f / float(lights.size());
+	}
+
+	const GPUHittable& h = m_Scene.m_Hittables[int(lights[light].emission_primId.w + 0.5f)];
+	Le = glm::vec3(lights[light].emission_primId);
+
+	bool valid = h.type == HITTABLE_SPHERE
+		? SampleSphereLight(p, h.index, wi, dist, pdf)
+		: SampleCubeLight(p, h.index, wi, dist, pdf);
+
+	pdf *= pmf;
+	return valid;
+}
+
+float CPUTracer::LightPdf(const glm::vec3& p, const glm::vec3& n, int light, const HitRecord& light_rec) const
+{
+	const GPULight& entry = m_Scene.m_Lights[light];
+	float pmf = m_Scene.m_LightSampling == LIGHT_SAMPLING_TREE
+		? m_Scene.m_LightTree.Pmf(p, n, entry.trail_pad.x)
+		: 1.f / float(m_Scene.m_Lights.size());
+
+	const GPUHittable& h = m_Scene.m_Hittables[int(entry.emission_primId.w + 0.5f)];
+	if (h.type == HITTABLE_SPHERE) {
+
+		// Same cone as SampleSphereLight(), no density from inside the sphere
+		const glm::vec4& cr = m_Scene.m_Spheres[h.index].center_radius;
+		glm::vec3 to_center = glm::vec3(cr) - p;
+		float sin2_max = cr.w * cr.w / glm::dot(to_center, to_center);
+		if (sin2_max >= 1.f)
+			return 0.f;
+		float one_minus_cos_max = sin2_max / (1.f + sqrtf(1.f - sin2_max));
+		return pmf / (2.f * float(PI) * one_minus_cos_max);
+	}
+
+	// Area density converted to solid angle, see SampleCubeLight()
+	const GPUCube& cube = m_Scene.m_Cubes[h.index];
+	glm::vec3 size = glm::vec3(cube.max_matId) - glm::vec3(cube.min_pad);
+	float total_area = 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	glm::vec3 d = light_rec.point - p;
+	float dist2 = glm::dot(d, d);
+	float cos_light = fabsf(glm::dot(d, light_rec.normal)) / sqrtf(dist2);
+	return pmf * dist2 / (glm::max(cos_light, 1e-6f) * total_area);
+}
+
+template <unsigned int MATERIALS>
+glm::vec3 CPUTracer::DirectLight(const HitRecord& rec, const GPUMaterial& mat, const glm::vec3& wo) const
+{
+	glm::vec3 wi, Le;
+	float dist, pdf;
+	if (!SampleLight(rec.point, rec.normal, wi, dist, Le, pdf))
+		return glm::vec3(0.f);
+
+	glm::vec3 f = bsdf_eval<MATERIALS>(mat, rec.normal, wo, wi);
+	if (f == glm::vec3(0.f))
+		return glm::vec3(0.f);
+
+	if (Occluded({ rec.point, wi }, { 0.001f, dist - SHADOW_EPSILON }))
+		return glm::vec3(0.f);
+
+	return f * Le * power_heuristic(pdf, bsdf_pdf<MATERIALS>(mat, rec.normal, wo, wi)) / pdf;
+}
+
+HitRecord CPUTracer::ResolveHit(const Ray& r, float t, int prim_id) const
+{
+	HitRecord rec;
+	rec.t = t;
+	rec.point = r.at(t);
+
+	const GPUHittable& h = m_Scene.m_Hittables[prim_id];
+	if (h.type == HITTABLE_SPHERE)
+		SphereHitRecord(r, h.index, rec);
+	else if (h.type == HITTABLE_CUBE)
+		CubeHitRecord(r, h.index, rec);
+	else
+		PlaneHitRecord(r, h.index, rec);
+
+	return rec;
+}
+
+bool CPUTracer::IntersectSphere(const Ray& r, const Interval& ray_t, float& t, int index) const
+{
+	const glm::vec4& cr = m_Scene.m_Spheres[index].center_radius;
+	glm::vec3 oc = glm::vec3(cr) - r.origin;
+	float a = glm::dot(r.direction, r.direction);
+	float h = glm::dot(r.direction, oc);
+	float c = glm::dot(oc, oc) - cr.w * cr.w;
+
+	float discriminant = h * h - a * c;
+	if (discriminant < 0)
+		return false;
+
+	float sqrtd = sqrtf(discriminant);
+
+	// Find the nearest root that lies in the acceptable range.
+	float root = (h - sqrtd) / a;
+	if (!ray_t.surrounds(root)) {
+		root = (h + sqrtd) / a;
+		if (!ray_t.surrounds(root))
+			return false;
+	}
+
+	t = root;
+	return true;
+}
+
+void CPUTracer::SphereHitRecord(const Ray& r, int index, HitRecord& rec) const
+{
+	const GPUSphere& sphere = m_Scene.m_Spheres[index];
+	rec.set_face_normal(r, (rec.point - glm::vec3(sphere.center_radius)) / sphere.center_radius.w);
+	rec.matId = int(sphere.color_matId.w + 0.5f);
+}
+
+bool CPUTracer::IntersectCube(const Ray& r, const Interval& ray_t, float& t, int index) const
+{
+	const GPUCube& cube = m_Scene.m_Cubes[index];
+	glm::vec3 box_min = glm::vec3(cube.min_pad);
+	glm::vec3 box_max = glm::vec3(cube.max_matId);
+
+	// Slab test, hit_aabb() in aabb.glsl
+	glm::vec3 inv_dir = 1.f / r.direction;
+	glm::vec3 t0 = (box_min - r.origin) * inv_dir;
+	glm::vec3 t1 = (box_max - r.origin) * inv_dir;
+	glm::vec3 t_small = glm::min(t0, t1);
+	glm::vec3 t_big = glm::max(t0, t1);
+
+	float t_enter = glm::max(glm::max(t_small.x, t_small.y), t_small.z);
+	float t_exit = glm::min(glm::min(t_big.x, t_big.y), t_big.z);
+	if (t_enter > t_exit)
+		return false;
+
+	float root = t_enter;
+	if (!ray_t.surrounds(root)) {
+		root = t_exit;
+		if (!ray_t.surrounds(root))
+			return false;
+	}
+
+	t = root;
+	return true;
+}
+
+void CPUTracer::CubeHitRecord(const Ray& r, int index, HitRecord& rec) const
+{
+	const GPUCube& cube = m_Scene.m_Cubes[index];
+	glm::vec3 box_min = glm::vec3(cube.min_pad);
+	glm::vec3 box_max = glm::vec3(cube.max_matId);
+
+	// The face hit is the axis on which the point is furthest from the center
+	glm::vec3 local = (rec.point - 0.5f * (box_min + box_max)) / (0.5f * (box_max - box_min));
+	glm::vec3 a = glm::abs(local);
+
+	glm::vec3 outward_normal;
+	if (a.x > a.y && a.x > a.z)
+		outward_normal = glm::vec3(glm::sign(local.x), 0.f, 0.f);
+	else if (a.y > a.z)
+		outward_normal = glm::vec3(0.f, glm::sign(local.y), 0.f);
+	else
+		outward_normal = glm::vec3(0.f, 0.f, glm::sign(local.z));
+
+	rec.set_face_normal(r, outward_normal);
+	rec.matId = int(cube.max_matId.w + 0.5f);
+}
+
+bool CPUTracer::IntersectPlane(const Ray& r, const Interval& ray_t, float& t, int index) const
+{
+	const glm::vec4& no = m_Scene.m_Planes[index].normal_offset;
+
+	// Rays parallel to the plane never hit it
+	float denom = glm::dot(glm::vec3(no), r.direction);
+	if (denom == 0.f)
+		return false;
+
+	float root = (no.w - glm::dot(glm::vec3(no), r.origin)) / denom;
+	if (!ray_t.surrounds(root))
+		return false;
+
+	t = root;
+	return true;
+}
+
+void CPUTracer::PlaneHitRecord(const Ray& r, int index, HitRecord& rec) const
+{
+	const GPUPlane& plane = m_Scene.m_Planes[index];
+	rec.set_face_normal(r, glm::vec3(plane.normal_offset));
+	rec.matId = int(plane.color_matId.w + 0.5f);
+}
+
+template <unsigned int MATERIALS>
+bool CPUTracer::Scatter(const Ray& r_in, const HitRecord& rec, const GPUMaterial& mat, glm::vec3& attenuation, Ray& scattered, float& pdf) const
+{
+	int type = int(mat.type_ref_pad.x + 0.5f);
+	pdf = 0.f;
+
+	// Lambertian and metal: cosine weighted and GGX visible normal sampling
+	if ((has_material<MATERIALS>(LAMBERTIAN) || has_material<MATERIALS>(METAL)) && (type == LAMBERTIAN || type == METAL)) {
+		glm::vec3 wi;
+		if (!bsdf_sample<MATERIALS>(mat, rec.normal, -glm::normalize(r_in.direction), glm::vec2(rand01(), rand01()), wi, attenuation, pdf))
+			return false;
+
+		scattered = { rec.point, wi };
+		return true;
+	}
+
+	// Dielectric
+	if (has_material<MATERIALS>(DIELECTRIC) && type == DIELECTRIC) {
+		attenuation = glm::vec3(1.f);
+		float refraction_index = mat.type_ref_pad.y;
+		float ri = rec.front_face ? (1.f / refraction_index) : refraction_index;
+
+		glm::vec3 unit_direction = glm::normalize(r_in.direction);
+		float cos_theta = fminf(glm::dot(-unit_direction, rec.normal), 1.f);
+		float sin_theta = sqrtf(1.f - cos_theta * cos_theta);
+
+		bool cannot_refract = ri * sin_theta > 1.f;
+		glm::vec3 direction;
+
+		if (cannot_refract || reflectance(cos_theta, ri) > rand01())
+			direction = glm::reflect(unit_direction, rec.normal);
+		else
+			direction = glm::refract(unit_direction, rec.normal, ri);
+
+		scattered = { rec.point, direction };
+		return true;
+	}
+
+	return false;
+}
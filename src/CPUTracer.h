@@ -0,0 +1,280 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <climits>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Ray.h"
+#include "Scene.h"
+#include "BSDF.h"
+#include "camera.h"
+#include "SphereBlocks.h"
+#include "RayFrustum.h"
+#include "RaySorter.h"
+#include "TileScheduler.h"
+#include "Topology.h"
+
+// CPU mirror of comp.glsl. It walks the same packed buffers as the compute shader
+// (Scene::m_Spheres, m_Cubes, m_Planes, m_Hittables and Material::gpuMats) so both paths can be
+// compared pixel for pixel and profiled without a GPU.
+class CPUTracer {
+
+public:
+	CPUTracer(const Scene& scene);
+
+	// First hit of a path found before it starts, by a packet
+	struct FirstHit {
+		int m_Prim = -1;	// -1 for the sky
+		float m_T = 0.f;
+	};
+
+	// Renders one frame into m_Framebuffer, tiles are handed to the workers by m_Scheduler
+	void RenderFrame(const Camera& cam, unsigned int width, unsigned int height, int samples, int max_depth);
+
+	// Same for the pixels of region only, the rest of m_Framebuffer is left as it is
+	void RenderRegion(const Camera& cam, unsigned int width, unsigned int height, const Tile& region, int samples, int max_depth);
+
+	// Color of a single pixel, averaged over samples (same steps as main() in comp.glsl)
+	glm::vec3 RenderPixel(const Camera& cam, int x, int y, unsigned int width, unsigned int height, int samples, int max_depth) const;
+
+	// Mirrors ray_color() in ray.glsl, first skips the closest hit search of the first bounce.
+	// Runs the kernel picked by the last frame, the generic one for another max_depth.
+	glm::vec3 RayColor(Ray r, int max_depth, const FirstHit* first = nullptr) const;
+
+	// First hit primitive of the ray through the center of every pixel, -1 for the sky.
+	// Single threaded, with or without packets, for the benchmark.
+	void PrimaryHits(const Camera& cam, unsigned int width, unsigned int height, std::vector<int>& prims) const;
+
+	// Mirrors hit_scene() in scene.glsl, tracks only the distance (ray_t.max) and primitive id
+	bool HitScene(const Ray& r, Interval& ray_t, int& prim_id) const;
+
+	// Mirrors hit_planes() in plane.glsl, planes are tested outside the acceleration structure
+	bool HitPlanes(const Ray& r, Interval& ray_t, int& prim_id) const;
+
+	// Mirrors hit_grid() in grid.glsl, any_hit stops at the first hit
+	bool HitGrid(const Ray& r, Interval& ray_t, int& prim_id, bool any_hit = false) const;
+
+	// Mirrors occluded() in scene.glsl, any-hit test for shadow rays
+	bool Occluded(const Ray& r, const Interval& ray_t) const;
+
+	// Mirror sample_light(), light_pdf() and direct_light() in light.glsl
+	bool SampleLight(const glm::vec3& p, const glm::vec3& n, glm::vec3& wi, float& dist, glm::vec3& Le, float& pdf) const;
+	float LightPdf(const glm::vec3& p, const glm::vec3& n, int light, const HitRecord& light_rec) const;
+	template <unsigned int MATERIALS = MATERIALS_ALL>
+	glm::vec3 DirectLight(const HitRecord& rec, const GPUMaterial& mat, const glm::vec3& wo) const;
+
+	// Mirrors resolve_hit() in scene.glsl
+	HitRecord ResolveHit(const Ray& r, float t, int prim_id) const;
+
+	// Bounces before Russian roulette starts (uRouletteDepth), max_depth or more turns it off
+	int m_RouletteDepth = INT_MAX;
+
+	// Deterministic mode: every random number is hashed from m_Seed, the pixel, the sample
+	// index, the bounce and how many numbers the bounce drew before (sample_float() in
+	// utilities.h), so frames are bit identical whatever the thread count, tile order or mode
+	// of the scheduler. Samples are numbered from m_FirstSample, for frames traced in parts.
+	bool m_Deterministic = false;
+	uint32_t m_Seed = 0;
+	int m_FirstSample = 0;
+
+	// Specialized kernels, the CPU side of ShaderVariants: the path loop is instantiated for
+	// every set of material types (bit 1 << Material_Type), without the shading of the missing
+	// ones, and with a constant bounce bound for max_depth KERNEL_DEPTH. Every frame runs the
+	// instantiation for Scene::MaterialMask() and its max_depth, or the generic one without
+	// m_Specialize. Materials and depth bound (0 for the runtime one) of the last frame:
+	bool m_Specialize = true;
+	unsigned int m_KernelMaterials = MATERIALS_ALL;
+	int m_KernelDepth = 0;
+	static const int KERNEL_DEPTH = 10;
+
+	// RGBA32F, row major from the bottom row, same layout as imageTexture
+	using Framebuffer = std::vector<glm::vec4, FirstTouchAllocator<glm::vec4>>;
+	Framebuffer m_Framebuffer;
+
+	// SoA copy of the spheres for the linear walk, repacked at the start of every frame.
+	// Set m_SphereBlocks.m_Isa to force an instruction set.
+	SphereBlocks m_SphereBlocks;
+
+	// Camera rays of PACKET_SIZE x PACKET_SIZE pixel tiles are traced as packets: primitives
+	// outside the frustum of the tile are culled once and the first hit of every ray is searched
+	// among the rest. The scene is culled per PACKET_TILE x PACKET_TILE tile first, packets only
+	// filter the primitives of their tile. Later bounces diverge and trace alone. Without packets,
+	// or with defocus blur where the rays do not share an origin, every camera ray walks the
+	// scene alone. With a grid, a tile or packet whose frustum holds more than PACKET_GRID_LIMIT
+	// primitives (looking along the ground) walks the grid per ray, which stops at the first hit.
+	bool m_UsePackets = true;
+	static const int PACKET_SIZE = 4;
+	static const int PACKET_TILE = 16;
+	static const int PACKET_GRID_LIMIT = 64;
+
+	// Stream mode: the paths of a tile advance one bounce at a time, stream tiles are grown from
+	// m_TileSize to hold about m_StreamSize paths. Every bounce first finds the closest hits of
+	// all live rays, in RaySorter order when m_SortStreams is set, then shades them. Camera rays
+	// are coherent and are traced in pixel order.
+	bool m_UseStreams = false;
+	bool m_SortStreams = true;
+	int m_StreamSize = 1 << 16;
+
+	// Secondary rays of the last stream frame, summed over the workers
+	struct StreamStats {
+		long long m_Rays = 0;
+		double m_TraceMs = 0.0;		// closest hit searches
+		double m_SortMs = 0.0;		// keys and radix sort
+	};
+	StreamStats m_StreamStats;
+
+	// Tiles of m_TileSize pixels, Hilbert ordered with work stealing unless m_Scheduler is told
+	// otherwise. Busy and idle time of every worker of the last frame are in m_Scheduler.m_Stats.
+	TileScheduler m_Scheduler;
+	int m_TileSize = 16;
+
+	// Workers per frame, 0 for one per CPU of the nodes used (per hardware thread without pinning)
+	int m_ThreadCount = 0;
+
+	// NUMA placement. Workers are spread node by node over the first m_NodeCount nodes (0 for
+	// all) and pinned to their CPUs. With m_ReplicateScene every node traces its own copy of
+	// the scene and acceleration structure, made at the start of every frame by a thread on
+	// that node. The framebuffer pages are placed by the workers writing them first.
+	Topology m_Topology;
+	bool m_PinThreads = true;
+	bool m_ReplicateScene = true;
+	int m_NodeCount = 0;
+
+private:
+	const Scene& m_Scene;
+
+	// Camera basis, same as update_camera() in camera.glsl
+	struct Film {
+		glm::vec3 m_Origin;
+		glm::vec3 m_LowerLeft;
+		glm::vec3 m_Horizontal;
+		glm::vec3 m_Vertical;
+		glm::vec3 m_DefocusU;
+		glm::vec3 m_DefocusV;
+		bool m_Defocus;
+		glm::vec2 m_Size;		// pixels
+	};
+
+	// Material table read by Bounce(), Material::gpuMats or the copy of a replica
+	const std::vector<GPUMaterial>* m_Materials = &Material::gpuMats;
+
+	// Scene::Generation() m_SphereBlocks was built from
+	unsigned int m_BlocksGeneration = 0;
+
+	// Read-only copy of the scene and materials for the workers of one node
+	struct Replica {
+		Scene m_Scene;
+		std::vector<GPUMaterial> m_Materials;
+		unsigned int m_Generation = 0;
+		std::unique_ptr<CPUTracer> m_Tracer;
+	};
+	std::vector<std::unique_ptr<Replica>> m_Replicas;
+
+	// Copies the scene and materials to the first nodes when they changed since the last copy,
+	// on threads pinned to them, and the tracing settings every frame
+	void UpdateReplicas(int nodes);
+
+	// Locals of ray_color() that live from one bounce to the next
+	struct PathState {
+		Ray m_Ray;
+		glm::vec3 m_Throughput = glm::vec3(1.f);
+		glm::vec3 m_Result = glm::vec3(0.f);
+		int m_Depth = 0;
+
+		// Previous vertex for the MIS weight of emission found by BSDF sampling
+		bool m_DeltaBounce = true;
+		float m_BsdfPdfPrev = 0.f;
+		glm::vec3 m_PointPrev = glm::vec3(0.f);
+		glm::vec3 m_NormalPrev = glm::vec3(0.f);
+
+		// Keys of the random numbers in deterministic mode
+		glm::ivec2 m_Pixel = glm::ivec2(0);
+		uint32_t m_Sample = 0;
+	};
+
+	// Points the random numbers of this thread at a new sample, before its camera ray
+	void BeginSample(const glm::ivec2& pixel, uint32_t sample) const;
+
+	// One iteration of ray_color(): shades the closest hit (prim_id -1 for the sky) and moves the
+	// path to the scattered ray. False when the path ends.
+	template <unsigned int MATERIALS>
+	bool Bounce(PathState& path, int prim_id, float t) const;
+
+	// RayColor() for the materials of MATERIALS, MAX_DEPTH bounces or max_depth when 0
+	template <unsigned int MATERIALS, int MAX_DEPTH>
+	glm::vec3 RayColorKernel(Ray r, int max_depth, const FirstHit* first) const;
+
+	// Instantiations run by this frame, copied to the replicas
+	struct Kernel {
+		glm::vec3 (CPUTracer::*m_RayColor)(Ray, int, const FirstHit*) const;
+		bool (CPUTracer::*m_Bounce)(PathState&, int, float) const;
+	};
+	Kernel m_Kernel;
+
+	template <unsigned int MATERIALS>
+	static Kernel MakeKernel(bool fixed_depth);
+
+	// Picks m_Kernel, m_KernelMaterials and m_KernelDepth for the scene and max_depth
+	void SelectKernel(int max_depth);
+
+	// Paths and buffers of one stream, kept per worker to reuse the allocations
+	struct Stream {
+		std::vector<PathState> m_Paths;
+		std::vector<int> m_Live;		// paths still bouncing
+		std::vector<int> m_Next;
+		std::vector<uint32_t> m_Keys;
+		std::vector<int> m_Order;
+		std::vector<Ray> m_Rays;			// of the live paths, in m_Live order
+		std::vector<FirstHit> m_Hits;
+		RaySorter m_Sorter;
+		StreamStats m_Stats;
+	};
+
+	// Scene bounds for RaySorter::Key()
+	AABB StreamBounds(const Film& film) const;
+
+	// Traces the samples of the pixels of tile as one stream
+	void RenderStream(const Film& film, const Tile& tile, glm::vec4* frame, unsigned int width, int samples, int max_depth, const AABB& bounds, Stream& stream) const;
+
+	// Culled primitives of one tile and one of its packets, kept per worker to reuse the allocations
+	struct Packet {
+		std::vector<int> m_TilePrims;
+		std::vector<int> m_Prims;
+		SphereBlocks m_Spheres;
+		bool m_TileWalk = false;	// trace the rays of the tile through the grid instead
+		bool m_Walk = false;		// same for the packet
+	};
+
+	Film MakeFilm(const Camera& cam, unsigned int width, unsigned int height) const;
+
+	// make_ray() in ray.glsl through pixel, jitter included
+	Ray CameraRay(const Film& film, const glm::vec2& pixel) const;
+
+	// Frustum of the camera rays of the pixels [x0, x1) x [y0, y1), jitter included
+	RayFrustum PixelFrustum(const Film& film, int x0, int y0, int x1, int y1) const;
+
+	// Culls the scene to the tile [x0, x1) x [y0, y1) and every packet to its part of the tile
+	void BuildTile(const Film& film, int x0, int y0, int x1, int y1, Packet& packet) const;
+	void BuildPacket(const Film& film, int x0, int y0, int x1, int y1, Packet& packet) const;
+
+	// Closest hit among the planes and the culled primitives of packet
+	bool HitPacket(const Ray& r, const Packet& packet, Interval& ray_t, int& prim_id) const;
+
+	// A tile of at most PACKET_TILE pixels and one packet [x0, x1) x [y0, y1) of it
+	void RenderTile(const Film& film, const Tile& tile, glm::vec4* frame, unsigned int width, int samples, int max_depth, Packet& packet) const;
+	void RenderPacket(const Film& film, int x0, int y0, int x1, int y1, glm::vec4* frame, unsigned int width, int samples, int max_depth, Packet& packet) const;
+
+	bool HitCell(const Ray& r, const glm::ivec4& cell, Interval& ray_t, int& prim_id, bool any_hit) const;
+	bool IntersectSphere(const Ray& r, const Interval& ray_t, float& t, int index) const;
+	bool IntersectCube(const Ray& r, const Interval& ray_t, float& t, int index) const;
+	bool IntersectPlane(const Ray& r, const Interval& ray_t, float& t, int index) const;
+	void SphereHitRecord(const Ray& r, int index, HitRecord& rec) const;
+	void CubeHitRecord(const Ray& r, int index, HitRecord& rec) const;
+	void PlaneHitRecord(const Ray& r, int index, HitRecord& rec) const;
+	bool SampleSphereLight(const glm::vec3& p, int index, glm::vec3& wi, float& dist, float& pdf) const;
+	bool SampleCubeLight(const glm::vec3& p, int index, glm::vec3& wi, float& dist, float& pdf) const;
+	template <unsigned int MATERIALS>
+	bool Scatter(const Ray& r_in, const HitRecord& rec, const GPUMaterial& mat, glm::vec3& attenuation, Ray& scattered, float& pdf) const;
+};
@@ -0,0 +1,19 @@
+#include "Cube.h"
+
+Cube::Cube(glm::vec3 min_corner, glm::vec3 max_corner, glm::vec3 color) {
+    minCorner = glm::min(min_corner, max_corner);
+    maxCorner = glm::max(min_corner, max_corner);
+    m_Color = color;
+
+    // Keep the Object fields meaningful for code that only looks at position/radius
+    m_Position = 0.5f * (minCorner + maxCorner);
+    m_Radius = 0.5f * glm::length(maxCorner - minCorner);
+    m_MatId = 0.f;
+}
+
+GPUCube Cube::GetGPUCube() {
+    GPUCube gpuCube;
+    gpuCube.min_pad = glm::vec4(minCorner, 0.f);
+    gpuCube.max_matId = glm::vec4(maxCorner, static_cast<float>(m_MatId));
+    return gpuCube;
+}
@@ -2,11 +2,17 @@
 
 #include "Object.h"
 
+struct GPUCube {             // 32 bytes (two vec4s)
+    glm::vec4 min_pad;       // xyz = minCorner, w = unused
+    glm::vec4 max_matId;     // xyz = maxCorner, w = matId (as float)
+};
+
 struct Cube : public Object {
     glm::vec3 minCorner;
     glm::vec3 maxCorner;
-    glm::vec3 color;
-    int m_MatId;
+
+    // Axis aligned box spanning [min_corner, max_corner]
+    Cube(glm::vec3 min_corner, glm::vec3 max_corner, glm::vec3 color);
 
     // overrides
 
@@ -16,10 +22,7 @@ struct Cube : public Object {
 
     // Type 1 is considered a Cube
     int type_id() const override { return 1; }
-};
 
-struct GPUCube {             // 32 bytes (two vec4s)
-    glm::vec4 min_pad;       // xyz = minCorner, w = unused
-    glm::vec4 max_matId;     // xyz = maxCorner, w = matId (as float)
+    GPUCube GetGPUCube();
 };
 
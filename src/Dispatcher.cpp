@@ -0,0 +1,96 @@
+#include "Dispatcher.h"
+
+#include <cstring>
+#include <vector>
+
+// Must match WorkQueueBuf in buffers.glsl_h
+static const GLuint WORK_QUEUE_BINDING = 7;
+static const GLintptr GROUP_STATS_OFFSET = 8;
+
+// GL_NV_shader_thread_group query, not part of the glad loader
+static const GLenum SM_COUNT_NV = 0x933B;
+// Resident 256 thread groups per multiprocessor, enough to hide latency
+static const int GROUPS_PER_SM = 4;
+// Used when the device does not report its multiprocessor count
+static const int DEFAULT_PERSISTENT_GROUPS = 128;
+
+static bool has_extension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
+	return false;
+}
+
+void Dispatcher::Init()
+{
+	m_PersistentGroups = DEFAULT_PERSISTENT_GROUPS;
+	if (has_extension("GL_NV_shader_thread_group")) {
+		GLint sm_count = 0;
+		glGetIntegerv(SM_COUNT_NV, &sm_count);
+		if (sm_count > 0)
+			m_PersistentGroups = sm_count * GROUPS_PER_SM;
+	}
+
+	glGenBuffers(1, &m_WorkQueue);
+	Reserve(m_PersistentGroups);
+}
+
+void Dispatcher::Reserve(int groups)
+{
+	if (groups <= m_Capacity)
+		return;
+
+	m_Capacity = groups;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_WorkQueue);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, GROUP_STATS_OFFSET + groups * 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, WORK_QUEUE_BINDING, m_WorkQueue);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Dispatcher::Dispatch(GLuint program_id, unsigned int width, unsigned int height)
+{
+	GLuint groups_x = (width + GROUP_WIDTH - 1) / GROUP_WIDTH;
+	GLuint groups_y = (height + GROUP_WIDTH - 1) / GROUP_WIDTH;
+	if (m_Mode == DISPATCH_PERSISTENT) {
+		groups_x = m_PersistentGroups;
+		groups_y = 1;
+	}
+
+	m_LastGroups = int(groups_x * groups_y);
+	Reserve(m_LastGroups);
+
+	// Reset the work counter, after the previous frame is done with it
+	GLuint zero = 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_WorkQueue);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUniform1i(glGetUniformLocation(program_id, "uDispatchMode"), m_Mode);
+	glUniform1i(glGetUniformLocation(program_id, "uBatchSize"), m_BatchSize);
+	glUniform1i(glGetUniformLocation(program_id, "uCollectStats"), m_CollectStats);
+	glUniform1i(glGetUniformLocation(program_id, "uRowCount"), int(height));
+
+	glDispatchCompute(groups_x, groups_y, 1);
+}
+
+GroupUtilization Dispatcher::ReadUtilization()
+{
+	if (!m_CollectStats || m_LastGroups == 0)
+		return GroupUtilization();
+
+	std::vector<GLuint> stats(size_t(m_LastGroups) * 2);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_WorkQueue);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, GROUP_STATS_OFFSET, stats.size() * sizeof(GLuint), stats.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Bounces are the work measure, pixels alone hide how deep their paths went
+	std::vector<GLuint> work(m_LastGroups);
+	for (int i = 0; i < m_LastGroups; i++)
+		work[i] = stats[i * 2 + 1];
+
+	return GroupUtilization::FromWork(work);
+}
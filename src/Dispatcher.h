@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "Profiler.h"
+
+// How workgroups are mapped to pixels, must match the DISPATCH_* constants in comp.glsl
+enum Dispatch_Mode {
+	DISPATCH_TILES,			// 0, one 16x16 pixel tile per workgroup
+	DISPATCH_PERSISTENT,	// 1, device filling groups pull tiles from a global counter
+};
+
+// Launches the path tracing compute shader. In DISPATCH_PERSISTENT only enough groups
+// to fill the device are started. They fetch batches of tiles from an atomic counter
+// until the frame is done, so a few expensive tiles no longer decide the frame time.
+class Dispatcher {
+
+public:
+	// Creates the work queue buffer and sizes the persistent launch for this device
+	void Init();
+
+	// Dispatches one frame with the program currently in use. A height below the image height
+	// traces only the bottom rows, the image size itself comes from SCR_WIDTH and SCR_HEIGHT.
+	void Dispatch(GLuint program_id, unsigned int width, unsigned int height);
+
+	// Work per group of the last Dispatch(), needs m_CollectStats. Waits for the GPU.
+	GroupUtilization ReadUtilization();
+
+	Dispatch_Mode m_Mode = DISPATCH_TILES;
+	int m_PersistentGroups = 0;
+	int m_BatchSize = 2;		// tiles per fetch
+	bool m_CollectStats = false;
+
+private:
+	static const int GROUP_WIDTH = 16;
+
+	GLuint m_WorkQueue = 0;
+	int m_Capacity = 0;			// groups the stats array can hold
+	int m_LastGroups = 0;
+
+	void Reserve(int groups);
+};
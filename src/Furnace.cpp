@@ -0,0 +1,174 @@
+#include "Furnace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+#include "BSDF.h"
+#include "CPUTracer.h"
+#include "utilities.h"
+
+struct FurnaceMaterial {
+	const char* m_Name;
+	Material m_Material;
+};
+
+static std::vector<FurnaceMaterial> furnace_materials() {
+	return {
+		{ "lambertian", Material::MakeLambertian(glm::vec3(1.f)) },
+		{ "metal 0.2", Material::MakeMetal(glm::vec3(1.f), 0.2f) },
+		{ "metal 0.5", Material::MakeMetal(glm::vec3(1.f), 0.5f) },
+		{ "metal 1.0", Material::MakeMetal(glm::vec3(1.f), 1.f) },
+		{ "glass", Material::MakeDielectric(1.5f) },
+	};
+}
+
+static GPUMaterial pack(const Material& mat) {
+	return { glm::vec4(mat.m_Albedo, mat.m_Fuzz), glm::vec4(float(mat.m_Type), mat.m_RefractionIndex, mat.m_Emission, 0.f) };
+}
+
+Furnace::Furnace(Shader& compute, unsigned int width, unsigned int height)
+	: m_Compute(compute), m_Width(width), m_Height(height)
+{
+	m_Dispatcher.Init();
+
+	glGenTextures(1, &m_Image);
+	glBindTexture(GL_TEXTURE_2D, m_Image);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, m_Width, m_Height);
+	glBindImageTexture(0, m_Image, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+	// Sphere of radius 1 at the origin fills most of the frame
+	m_Camera.m_LookFrom = glm::vec3(0.f, 0.f, 4.f);
+	m_Camera.m_LookAt = glm::vec3(0.f);
+	m_Camera.m_Fov = 40.f;
+	m_Camera.m_DefocusAngle = 0.f;
+	m_Scene.m_UniformSky = true;
+}
+
+Furnace::~Furnace()
+{
+	glDeleteTextures(1, &m_Image);
+}
+
+void Furnace::Run()
+{
+	RunBSDF();
+	RunScene();
+}
+
+void Furnace::RunBSDF()
+{
+	printf("%-12s %8s %12s %12s %12s %12s\n", "bsdf", "cos_o", "sampled", "evaluated", "pdf mass", "valid");
+
+	std::mt19937 generator(7);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	const glm::vec3 n(0.f, 0.f, 1.f);
+	const float two_pi = 2.f * float(PI);
+
+	for (const FurnaceMaterial& entry : furnace_materials()) {
+		GPUMaterial mat = pack(entry.m_Material);
+		if (entry.m_Material.m_Type == DIELECTRIC)
+			continue;
+
+		for (float cos_o : { 1.f, 0.5f, 0.1f }) {
+			glm::vec3 wo(sqrtf(1.f - cos_o * cos_o), 0.f, cos_o);
+
+			// Importance sampled albedo and the fraction of samples above the horizon
+			double sampled = 0.0, valid = 0.0;
+			for (int i = 0; i < m_BSDFSamples; i++) {
+				glm::vec3 wi, weight;
+				float pdf;
+				if (bsdf_sample(mat, n, wo, glm::vec2(uniform(generator), uniform(generator)), wi, weight, pdf)) {
+					sampled += weight.x;
+					valid += 1.0;
+				}
+			}
+
+			// Uniform hemisphere estimates of the same albedo and of the integrated density
+			double evaluated = 0.0, mass = 0.0;
+			for (int i = 0; i < m_BSDFSamples; i++) {
+				float z = uniform(generator);
+				float phi = two_pi * uniform(generator);
+				float r = sqrtf(std::max(0.f, 1.f - z * z));
+				glm::vec3 wi(r * cosf(phi), r * sinf(phi), z);
+				evaluated += bsdf_eval(mat, n, wo, wi).x * two_pi;
+				mass += bsdf_pdf(mat, n, wo, wi) * two_pi;
+			}
+
+			// Mirrors have no density, only the sampled albedo is meaningful
+			bool delta = bsdf_is_delta(mat);
+			printf("%-12s %8.2f %12.4f %12.4f %12.4f %12.4f\n", entry.m_Name, cos_o, sampled / m_BSDFSamples,
+				delta ? 0.0 : evaluated / m_BSDFSamples, delta ? 0.0 : mass / m_BSDFSamples, valid / m_BSDFSamples);
+		}
+	}
+}
+
+void Furnace::RunScene()
+{
+	printf("\n%-12s %10s %10s %10s %10s %10s %10s\n", "scene", "gpu min", "gpu mean", "gpu max", "cpu min", "cpu mean", "cpu max");
+
+	size_t pixels = size_t(m_Width) * m_Height;
+	std::vector<glm::vec4> frame(pixels), gpu(pixels), cpu(pixels);
+
+	for (const FurnaceMaterial& entry : furnace_materials()) {
+
+		Material::gpuMats.clear();
+		m_Scene.m_Spheres.clear();
+		Sphere ball(glm::vec3(0.f), glm::vec3(1.f), 1.f);
+		ball.SetMaterial(entry.m_Material);
+		m_Scene.AddSphere(ball);
+		m_Scene.Build();
+
+		m_Compute.use();
+		m_Scene.Upload(m_Compute.m_ProgramId);
+		m_Compute.setInt("SCR_WIDTH", m_Width);
+		m_Compute.setInt("SCR_HEIGHT", m_Height);
+		m_Compute.setInt("SAMPLES", m_Samples);
+		m_Compute.setInt("MAX_DEPTH", m_MaxDepth);
+		m_Compute.setInt("uRouletteDepth", m_MaxDepth);
+		m_Camera.setUniforms(m_Compute.m_ProgramId);
+
+		std::fill(gpu.begin(), gpu.end(), glm::vec4(0.f));
+		for (int i = 0; i < m_Frames; i++) {
+			m_Compute.setFloat("uSeed", random_float());
+			m_Dispatcher.Dispatch(m_Compute.m_ProgramId, m_Width, m_Height);
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+			glBindTexture(GL_TEXTURE_2D, m_Image);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, frame.data());
+			for (size_t p = 0; p < pixels; p++)
+				gpu[p] += frame[p] / float(m_Frames);
+		}
+
+		CPUTracer tracer(m_Scene);
+		std::fill(cpu.begin(), cpu.end(), glm::vec4(0.f));
+		for (int i = 0; i < m_Frames; i++) {
+			tracer.RenderFrame(m_Camera, m_Width, m_Height, m_Samples, m_MaxDepth);
+			for (size_t p = 0; p < pixels; p++)
+				cpu[p] += tracer.m_Framebuffer[p] / float(m_Frames);
+		}
+
+		ImageStats g = Stats(gpu), c = Stats(cpu);
+		printf("%-12s %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f\n", entry.m_Name,
+			g.m_Min, g.m_Mean, g.m_Max, c.m_Min, c.m_Mean, c.m_Max);
+	}
+}
+
+Furnace::ImageStats Furnace::Stats(const std::vector<glm::vec4>& image)
+{
+	ImageStats stats;
+	stats.m_Min = image.empty() ? 0.0 : image[0].x;
+	stats.m_Max = stats.m_Min;
+
+	double total = 0.0;
+	for (const glm::vec4& pixel : image) {
+		for (int c = 0; c < 3; c++) {
+			stats.m_Min = std::min(stats.m_Min, double(pixel[c]));
+			stats.m_Max = std::max(stats.m_Max, double(pixel[c]));
+			total += pixel[c];
+		}
+	}
+
+	stats.m_Mean = image.empty() ? 0.0 : total / (3.0 * image.size());
+	return stats;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "Scene.h"
+#include "shader.h"
+#include "camera.h"
+#include "Dispatcher.h"
+
+// White furnace tests, run with --furnace. A surface with white albedo inside a uniform
+// environment of radiance 1 must return exactly 1 unless its BSDF loses energy, so any
+// bias in sampling, weights or PDFs shows up as a number that is not 1.
+class Furnace {
+
+public:
+	Furnace(Shader& compute, unsigned int width, unsigned int height);
+	~Furnace();
+
+	void Run();
+
+	// Directional albedo of each BSDF at several incident angles on the CPU twin, estimated
+	// by importance sampling and by uniform hemisphere integration of bsdf_eval. The density
+	// integrated over the hemisphere must match the fraction of samples that are not absorbed.
+	void RunBSDF();
+
+	// Renders a white sphere of each material under a white sky on both tracers
+	void RunScene();
+
+	int m_BSDFSamples = 1 << 18;
+	int m_Samples = 4;
+	int m_Frames = 4;
+	int m_MaxDepth = 64;
+
+private:
+	Shader& m_Compute;
+	Scene m_Scene;
+	Camera m_Camera;
+	Dispatcher m_Dispatcher;
+	unsigned int m_Width;
+	unsigned int m_Height;
+	GLuint m_Image = 0;
+
+	// Min, mean and max over the pixels and channels of an averaged frame
+	struct ImageStats {
+		double m_Min = 0.0;
+		double m_Mean = 0.0;
+		double m_Max = 0.0;
+	};
+	static ImageStats Stats(const std::vector<glm::vec4>& image);
+};
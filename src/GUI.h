@@ -4,11 +4,29 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
+#include "Profiler.h"
+#include "HybridRenderer.h"
+#include "ShaderVariants.h"
+
 static bool isWindowHidden = false;
 static int number_of_samples = 5;
 static int ray_depth = 10;
-
-void display_gui(double deltaTime) {
+static bool use_cpu_tracer = false;
+static bool use_hybrid = false;
+static bool use_ray_streams = false;
+static bool sort_ray_streams = true;
+static bool use_russian_roulette = false;
+static int roulette_depth = 5;
+static bool use_light_tree = true;
+static bool use_persistent_threads = false;
+static int persistent_batch_size = 2;
+static bool collect_group_stats = false;
+static bool use_shader_variants = true;
+static bool use_deterministic = false;
+static int render_seed = 1;
+
+void display_gui(double deltaTime, double trace_ms, const GroupUtilization& groups, const HybridRenderer& hybrid,
+    const ShaderVariants& variants, bool variant_active) {
 
     if (isWindowHidden) {
 
@@ -21,6 +39,7 @@ void display_gui(double deltaTime) {
         // Rendering
         ImGui::Begin("OpenGL Project");
         ImGui::Text("%.3f fps", (1.0f / static_cast<float>(deltaTime)));
+        ImGui::Text("Trace: %.3f ms (%s)", trace_ms, use_cpu_tracer ? "CPU" : (use_hybrid ? "hybrid" : "GPU"));
 
         ImGui::Text("# of Samples");
         ImGui::DragInt("##samples", &number_of_samples, 1.f, 1, 5);
@@ -28,6 +47,52 @@ void display_gui(double deltaTime) {
         ImGui::Text("Ray Depth");
         ImGui::DragInt("##ray_depth", &ray_depth, 1.f, 1, 10);
 
+        ImGui::Checkbox("Russian Roulette", &use_russian_roulette);
+        if (use_russian_roulette) {
+            ImGui::Text("Roulette Start Depth");
+            ImGui::DragInt("##roulette_depth", &roulette_depth, 1.f, 1, 10);
+        }
+
+        ImGui::Checkbox("Light Tree", &use_light_tree);
+
+        ImGui::Checkbox("Deterministic", &use_deterministic);
+        if (use_deterministic) {
+            ImGui::Text("Seed");
+            ImGui::DragInt("##render_seed", &render_seed, 1.f, 0, 1 << 20);
+        }
+
+        ImGui::Checkbox("CPU Tracer", &use_cpu_tracer);
+        if (!use_cpu_tracer) {
+            ImGui::Checkbox("Hybrid CPU+GPU", &use_hybrid);
+            if (use_hybrid) {
+                ImGui::Text("GPU %d rows %.2f ms, CPU %d rows %.2f ms", hybrid.m_GpuRows, hybrid.m_GpuMs, hybrid.m_CpuRows, hybrid.m_CpuMs);
+                ImGui::Text("Upload %.2f ms", hybrid.m_UploadMs);
+            }
+        }
+        if (use_cpu_tracer || use_hybrid) {
+            ImGui::Checkbox("Ray Streams", &use_ray_streams);
+            if (use_ray_streams)
+                ImGui::Checkbox("Sort Streams", &sort_ray_streams);
+        }
+
+        ImGui::Checkbox("Specialized Shaders", &use_shader_variants);
+        if (use_shader_variants) {
+            ImGui::Text("%s kernel%s, %d cached", variant_active ? "Specialized" : "Generic",
+                variants.IsPending() ? " (variant pending)" : "", variants.Size());
+        }
+
+        ImGui::Checkbox("Persistent Threads", &use_persistent_threads);
+        if (use_persistent_threads) {
+            ImGui::Text("Tiles per Fetch");
+            ImGui::DragInt("##batch_size", &persistent_batch_size, 1.f, 1, 16);
+        }
+
+        ImGui::Checkbox("Group Stats", &collect_group_stats);
+        if (collect_group_stats && groups.m_Groups > 0) {
+            ImGui::Text("%d groups, utilization %.1f%%", groups.m_Groups, groups.Utilization() * 100.0);
+            ImGui::Text("Bounces/group: min %.0f  mean %.0f  max %.0f", groups.m_MinWork, groups.m_MeanWork, groups.m_MaxWork);
+        }
+
         ImGui::End();
 
         ImGui::Render();
@@ -0,0 +1,285 @@
+#include "Golden.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "CPUTracer.h"
+#include "ImageCompare.h"
+
+// Seed of the deterministic random numbers, CPU and GPU
+static const uint32_t GOLDEN_SEED = 1;
+
+// The CPU renders are deterministic and made the golden images, their thresholds only leave
+// room for the rounding of other compilers and FMA contraction (below 0.001 either)
+static const double CPU_MAX_RMSE = 0.002;
+static const double CPU_MAX_FLIP = 0.004;
+
+struct GoldenScene {
+	const char* m_Name;
+	void (*m_Build)(Scene& scene, Camera& cam);
+	int m_Samples;
+	int m_MaxDepth;
+	int m_RouletteDepth;	// m_MaxDepth or more for none
+	Accel_Type m_Accel;
+	double m_MaxRmse;		// of the GPU render
+	double m_MaxFlip;		// mean over the pixels
+};
+
+static void make_directory(const std::string& path) {
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+static void add_sphere(Scene& scene, glm::vec3 center, float radius, const Material& material) {
+	Sphere sphere(center, material.m_Albedo, radius);
+	sphere.SetMaterial(material);
+	scene.AddSphere(sphere);
+}
+
+static void add_cube(Scene& scene, glm::vec3 min, glm::vec3 max, const Material& material) {
+	Cube cube(min, max, material.m_Albedo);
+	cube.SetMaterial(material);
+	scene.AddCube(cube);
+}
+
+static void add_ground(Scene& scene) {
+	Plane ground(glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.5f));
+	ground.SetMaterial(Material::MakeLambertian(glm::vec3(0.5f)));
+	scene.AddPlane(ground);
+}
+
+// One sphere of every material and a box on the ground, under the sky gradient
+static void build_materials(Scene& scene, Camera& cam) {
+	add_ground(scene);
+	add_sphere(scene, glm::vec3(-2.2f, 1.f, 0.f), 1.f, Material::MakeLambertian(glm::vec3(0.7f, 0.3f, 0.2f)));
+	add_sphere(scene, glm::vec3(0.f, 1.f, 0.f), 1.f, Material::MakeDielectric(1.5f));
+	add_sphere(scene, glm::vec3(2.2f, 1.f, 0.f), 1.f, Material::MakeMetal(glm::vec3(0.8f, 0.7f, 0.6f), 0.2f));
+	add_cube(scene, glm::vec3(-0.4f, 0.f, 1.4f), glm::vec3(0.4f, 0.5f, 2.2f), Material::MakeLambertian(glm::vec3(0.2f, 0.4f, 0.7f)));
+
+	cam.m_LookFrom = glm::vec3(0.f, 2.f, 8.f);
+	cam.m_LookAt = glm::vec3(0.f, 0.8f, 0.f);
+	cam.m_Fov = 35.f;
+	cam.m_DefocusAngle = 0.f;
+}
+
+// Same with a thin lens focused on the glass sphere
+static void build_defocus(Scene& scene, Camera& cam) {
+	build_materials(scene, cam);
+	cam.m_DefocusAngle = 3.f;
+	cam.m_FocusDist = glm::length(glm::vec3(0.f, 1.f, 0.f) - cam.m_LookFrom);
+}
+
+// Closed box lit by a small emissive sphere, next event estimation does most of the work
+static void build_cornell(Scene& scene, Camera& cam) {
+	const float wall = 0.05f;
+	glm::vec3 white(0.73f), red(0.65f, 0.05f, 0.05f), green(0.12f, 0.45f, 0.15f);
+	add_cube(scene, glm::vec3(-1.f - wall, 0.f, -1.f), glm::vec3(-1.f, 2.f, 1.f), Material::MakeLambertian(red));
+	add_cube(scene, glm::vec3(1.f, 0.f, -1.f), glm::vec3(1.f + wall, 2.f, 1.f), Material::MakeLambertian(green));
+	add_cube(scene, glm::vec3(-1.f, -wall, -1.f), glm::vec3(1.f, 0.f, 1.f), Material::MakeLambertian(white));
+	add_cube(scene, glm::vec3(-1.f, 2.f, -1.f), glm::vec3(1.f, 2.f + wall, 1.f), Material::MakeLambertian(white));
+	add_cube(scene, glm::vec3(-1.f, 0.f, -1.f - wall), glm::vec3(1.f, 2.f, -1.f), Material::MakeLambertian(white));
+	add_cube(scene, glm::vec3(-1.f, 0.f, 1.f), glm::vec3(1.f, 2.f, 1.f + wall), Material::MakeLambertian(white));
+	add_cube(scene, glm::vec3(-0.6f, 0.f, -0.6f), glm::vec3(-0.1f, 1.1f, -0.1f), Material::MakeLambertian(white));
+	add_sphere(scene, glm::vec3(0.45f, 0.35f, 0.2f), 0.35f, Material::MakeMetal(glm::vec3(0.8f), 0.1f));
+	add_sphere(scene, glm::vec3(0.f, 1.8f, 0.f), 0.12f, Material::MakeEmissive(glm::vec3(1.f, 0.9f, 0.75f), 40.f));
+
+	cam.m_LookFrom = glm::vec3(0.f, 1.f, 0.95f);
+	cam.m_LookAt = glm::vec3(0.f, 1.f, -1.f);
+	cam.m_Fov = 70.f;
+	cam.m_DefocusAngle = 0.f;
+}
+
+// Small spheres and boxes scattered over the ground, some of them lights, under a night sky.
+// Enough primitives for the grid and the light tree.
+static void build_scatter(Scene& scene, Camera& cam, float emissive_fraction) {
+	std::mt19937 generator(11);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	auto color = [&]() { return glm::vec3(uniform(generator), uniform(generator), uniform(generator)); };
+
+	add_ground(scene);
+	for (int a = -6; a < 6; a++) {
+		for (int b = -6; b < 6; b++) {
+			float choose = uniform(generator);
+			glm::vec3 center(a + 0.9f * uniform(generator), 0.2f, b + 0.9f * uniform(generator));
+			if (choose < 0.15f)
+				add_cube(scene, center - glm::vec3(0.18f, 0.2f, 0.18f), center + glm::vec3(0.18f, 0.16f, 0.18f), Material::MakeLambertian(color() * color()));
+			else if (choose < 0.7f && uniform(generator) < emissive_fraction)
+				add_sphere(scene, center, 0.2f, Material::MakeEmissive(0.5f + 0.5f * color(), 4.f));
+			else if (choose < 0.7f)
+				add_sphere(scene, center, 0.2f, Material::MakeLambertian(color() * color()));
+			else if (choose < 0.9f)
+				add_sphere(scene, center, 0.2f, Material::MakeMetal(0.5f + 0.5f * color(), 0.5f * uniform(generator)));
+			else
+				add_sphere(scene, center, 0.2f, Material::MakeDielectric(1.5f));
+		}
+	}
+	add_sphere(scene, glm::vec3(0.f, 1.f, 0.f), 1.f, Material::MakeDielectric(1.5f));
+
+	cam.m_LookFrom = glm::vec3(9.f, 3.f, 6.f);
+	cam.m_LookAt = glm::vec3(0.f, 0.3f, 0.f);
+	cam.m_Fov = 35.f;
+	cam.m_DefocusAngle = 0.f;
+}
+
+static void build_grid(Scene& scene, Camera& cam) {
+	build_scatter(scene, cam, 0.f);
+}
+
+static void build_lights(Scene& scene, Camera& cam) {
+	build_scatter(scene, cam, 0.35f);
+	scene.m_SkyIntensity = 0.02f;
+}
+
+// Thresholds sit above the difference between the CPU and GPU renders, which differ in their
+// random numbers only, and below the error of a render 5% brighter or darker. The noisy
+// scenes take more samples to keep the two apart.
+static std::vector<GoldenScene> golden_scenes() {
+	return {
+		{ "materials", build_materials, 256, 10, 10, ACCEL_LINEAR, 0.015, 0.03 },
+		{ "defocus", build_defocus, 256, 10, 10, ACCEL_LINEAR, 0.016, 0.032 },
+		{ "cornell", build_cornell, 4096, 10, 3, ACCEL_LINEAR, 0.024, 0.07 },
+		{ "grid", build_grid, 256, 10, 10, ACCEL_GRID, 0.02, 0.04 },
+		{ "lights", build_lights, 1024, 10, 3, ACCEL_GRID, 0.02, 0.019 },
+	};
+}
+
+Golden::Golden(Shader* compute)
+	: m_Compute(compute)
+{
+	if (!m_Compute)
+		return;
+
+	m_Dispatcher.Init();
+	glGenTextures(1, &m_Image);
+	glBindTexture(GL_TEXTURE_2D, m_Image);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, WIDTH, HEIGHT);
+	glBindImageTexture(0, m_Image, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+}
+
+Golden::~Golden()
+{
+	if (m_Image)
+		glDeleteTextures(1, &m_Image);
+}
+
+int Golden::Run()
+{
+	printf("%-10s %-8s %10s %10s %10s %10s %8s\n", "scene", "backend", "rmse", "max rmse", "flip", "max flip", "result");
+
+	int failed = 0;
+	std::vector<glm::vec3> golden, cpu, gpu;
+	for (const GoldenScene& entry : golden_scenes()) {
+
+		// The scene keeps its GL buffers, only its contents are replaced
+		Material::gpuMats.clear();
+		m_Scene.m_Spheres.clear();
+		m_Scene.m_Cubes.clear();
+		m_Scene.m_Planes.clear();
+		m_Scene.m_SkyIntensity = 1.f;
+		m_Camera = Camera();
+		entry.m_Build(m_Scene, m_Camera);
+		m_Scene.Build();
+		if (m_Scene.m_AccelType != entry.m_Accel)
+			m_Scene.BuildAcceleration(entry.m_Accel);
+
+		std::string path = m_Directory + "/" + entry.m_Name + ".pfm";
+		RenderCPU(entry.m_Samples, entry.m_MaxDepth, entry.m_RouletteDepth, cpu);
+		if (m_Update) {
+			make_directory(m_Directory);
+			bool written = write_pfm(path, WIDTH, HEIGHT, cpu);
+			printf("%-10s %-8s %s %s\n", entry.m_Name, "cpu", written ? "wrote" : "cannot write", path.c_str());
+			failed += !written;
+			continue;
+		}
+
+		unsigned int width = 0, height = 0;
+		bool found = read_pfm(path, width, height, golden) && width == WIDTH && height == HEIGHT;
+		if (!found)
+			printf("%-10s %-8s no %ux%u image at %s\n", entry.m_Name, "", WIDTH, HEIGHT, path.c_str());
+
+		failed += !(found && Compare(entry.m_Name, "cpu", golden, cpu, CPU_MAX_RMSE, CPU_MAX_FLIP));
+		if (m_Compute) {
+			RenderGPU(entry.m_Samples, entry.m_MaxDepth, entry.m_RouletteDepth, gpu);
+			failed += !(found && Compare(entry.m_Name, "gpu", golden, gpu, entry.m_MaxRmse, entry.m_MaxFlip));
+		}
+	}
+
+	return failed;
+}
+
+void Golden::RenderCPU(int samples, int max_depth, int roulette_depth, std::vector<glm::vec3>& image)
+{
+	CPUTracer tracer(m_Scene);
+	tracer.m_RouletteDepth = roulette_depth;
+	tracer.m_Deterministic = true;
+	tracer.m_Seed = GOLDEN_SEED;
+	tracer.RenderFrame(m_Camera, WIDTH, HEIGHT, samples, max_depth);
+
+	image.resize(tracer.m_Framebuffer.size());
+	for (size_t i = 0; i < image.size(); i++)
+		image[i] = glm::vec3(tracer.m_Framebuffer[i]);
+}
+
+void Golden::RenderGPU(int samples, int max_depth, int roulette_depth, std::vector<glm::vec3>& image)
+{
+	m_Compute->use();
+	m_Scene.Upload(m_Compute->m_ProgramId);
+	m_Compute->setInt("SCR_WIDTH", WIDTH);
+	m_Compute->setInt("SCR_HEIGHT", HEIGHT);
+	m_Compute->setInt("MAX_DEPTH", max_depth);
+	m_Compute->setInt("uRouletteDepth", roulette_depth);
+	m_Compute->setBool("uDeterministic", true);
+	m_Camera.setUniforms(m_Compute->m_ProgramId);
+
+	// Dispatches are kept short for the driver watchdog, each has a seed of its own
+	size_t pixels = size_t(WIDTH) * HEIGHT;
+	std::vector<glm::vec4> frame(pixels);
+	image.assign(pixels, glm::vec3(0.f));
+	for (int first = 0, dispatch = 0; first < samples; first += m_SamplesPerDispatch, dispatch++) {
+		int count = std::min(m_SamplesPerDispatch, samples - first);
+		m_Compute->setInt("SAMPLES", count);
+		m_Compute->setFloat("uSeed", float(GOLDEN_SEED + dispatch));
+		m_Compute->setUInt("uSeedBits", GOLDEN_SEED + dispatch);
+		m_Dispatcher.Dispatch(m_Compute->m_ProgramId, WIDTH, HEIGHT);
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+		glBindTexture(GL_TEXTURE_2D, m_Image);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, frame.data());
+		for (size_t p = 0; p < pixels; p++)
+			image[p] += glm::vec3(frame[p]) * (float(count) / float(samples));
+	}
+
+	m_Compute->setBool("uDeterministic", false);
+}
+
+bool Golden::Compare(const char* name, const char* backend, const std::vector<glm::vec3>& golden,
+	const std::vector<glm::vec3>& image, double max_rmse, double max_flip)
+{
+	std::vector<float> errors;
+	image_flip(golden, image, WIDTH, HEIGHT, m_PixelsPerDegree, errors);
+	double flip = 0.0;
+	for (float e : errors)
+		flip += e;
+	flip /= std::max<size_t>(errors.size(), 1);
+	double rmse = image_rmse(golden, image);
+
+	bool passed = rmse <= max_rmse && flip <= max_flip;
+	printf("%-10s %-8s %10.5f %10.5f %10.5f %10.5f %8s\n", name, backend, rmse, max_rmse, flip, max_flip, passed ? "pass" : "FAIL");
+	if (passed)
+		return true;
+
+	make_directory(m_OutputDirectory);
+	std::string base = m_OutputDirectory + "/" + name + "." + backend;
+	if (!write_pfm(base + ".pfm", WIDTH, HEIGHT, image) || !write_heatmap(base + ".flip.ppm", WIDTH, HEIGHT, errors))
+		printf("cannot write %s.*\n", base.c_str());
+	return false;
+}
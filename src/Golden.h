@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+#include "shader.h"
+#include "camera.h"
+#include "Dispatcher.h"
+
+// Golden image tests, run with --golden. Renders a catalogue of small scenes at high sample
+// counts in deterministic mode on the CPU tracer and, given a compute program, on the GPU, and
+// compares every render with the float image stored for its scene in m_Directory. A render
+// fails when its RMSE or its mean FLIP error (ImageCompare.h) exceeds the thresholds of the
+// scene, near zero for the CPU tracer that made the images, it is then written to
+// m_OutputDirectory with a heatmap of its FLIP error.
+// With m_Update the CPU renders replace the stored images instead.
+class Golden {
+
+public:
+	// Without a compute program only the CPU tracer runs and no GL context is needed
+	Golden(Shader* compute);
+	~Golden();
+
+	// Number of failed renders, a missing golden image fails every render of its scene
+	int Run();
+
+	// Size of the renders and of the stored images
+	static const unsigned int WIDTH = 128;
+	static const unsigned int HEIGHT = 72;
+
+	std::string m_Directory = "golden";
+	std::string m_OutputDirectory = "golden_diff";
+	bool m_Update = false;
+
+	// Samples per GPU dispatch, the dispatches of a render are averaged
+	int m_SamplesPerDispatch = 32;
+
+	// Viewing distance of the FLIP error, 67 for a 24" 1440p screen at 70 cm
+	float m_PixelsPerDegree = 67.f;
+
+private:
+	Shader* m_Compute;
+	Scene m_Scene;
+	Camera m_Camera;
+	Dispatcher m_Dispatcher;
+	GLuint m_Image = 0;
+
+	void RenderCPU(int samples, int max_depth, int roulette_depth, std::vector<glm::vec3>& image);
+	void RenderGPU(int samples, int max_depth, int roulette_depth, std::vector<glm::vec3>& image);
+
+	// Prints the errors of image against golden, writes the failures, true when it passes
+	bool Compare(const char* name, const char* backend, const std::vector<glm::vec3>& golden,
+		const std::vector<glm::vec3>& image, double max_rmse, double max_flip);
+};
@@ -0,0 +1,109 @@
+#include "Grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+glm::ivec3 UniformGrid::CellOf(const glm::vec3& p) const
+{
+	glm::vec3 local = (p - m_Bounds.m_Min) / m_Bounds.Extent() * glm::vec3(m_Resolution);
+	return glm::clamp(glm::ivec3(glm::floor(local)), glm::ivec3(0), m_Resolution - 1);
+}
+
+void UniformGrid::Build(const std::vector<AABB>& bounds, const std::vector<GPUHittable>& table)
+{
+	int count = (int)bounds.size();
+	m_Cells.clear();
+	m_CellPrims.clear();
+	m_Bounds = AABB();
+	m_Resolution = glm::ivec3(0);
+	m_Escape = glm::ivec4(0);
+
+	if (count == 0)
+		return;
+
+	// Median extent is the reference size for the escape test
+	std::vector<float> extents(count);
+	for (int i = 0; i < count; i++)
+		extents[i] = bounds[i].MaxExtent();
+
+	std::vector<float> sorted = extents;
+	std::nth_element(sorted.begin(), sorted.begin() + count / 2, sorted.end());
+	float escape_extent = ESCAPE_FACTOR * sorted[count / 2];
+
+	std::vector<bool> escaped(count);
+	int grid_count = 0;
+	for (int i = 0; i < count; i++) {
+		escaped[i] = extents[i] > escape_extent;
+		if (!escaped[i]) {
+			m_Bounds.Expand(bounds[i]);
+			grid_count++;
+		}
+	}
+
+	if (grid_count > 0) {
+
+		// Pad so flat scenes still get a non zero volume
+		glm::vec3 pad = glm::vec3(1e-3f * m_Bounds.MaxExtent() + 1e-4f);
+		m_Bounds.m_Min -= pad;
+		m_Bounds.m_Max += pad;
+
+		// Cells as close to cubes as possible, CELL_DENSITY cells per primitive
+		glm::vec3 extent = m_Bounds.Extent();
+		float volume = extent.x * extent.y * extent.z;
+		float cells_per_unit = cbrtf(CELL_DENSITY * grid_count / volume);
+		m_Resolution = glm::clamp(glm::ivec3(glm::round(extent * cells_per_unit)), glm::ivec3(1), glm::ivec3(MAX_RESOLUTION));
+
+		int cell_count = m_Resolution.x * m_Resolution.y * m_Resolution.z;
+		m_Cells.assign(cell_count, glm::ivec4(0));
+
+		// Pass 1: count the primitives of each type overlapping every cell
+		for (int i = 0; i < count; i++) {
+			if (escaped[i])
+				continue;
+
+			glm::ivec3 lo = CellOf(bounds[i].m_Min);
+			glm::ivec3 hi = CellOf(bounds[i].m_Max);
+			int slot = table[i].type == HITTABLE_SPHERE ? 1 : 2;
+
+			for (int z = lo.z; z <= hi.z; z++)
+				for (int y = lo.y; y <= hi.y; y++)
+					for (int x = lo.x; x <= hi.x; x++)
+						m_Cells[CellIndex(x, y, z)][slot]++;
+		}
+
+		// Prefix sum into cell ranges
+		int offset = 0;
+		for (glm::ivec4& cell : m_Cells) {
+			cell.x = offset;
+			offset += cell.y + cell.z;
+		}
+		m_CellPrims.resize(offset);
+
+		// Pass 2: scatter ids, the table is grouped by type so each range is too
+		std::vector<int> cursor(cell_count);
+		for (int c = 0; c < cell_count; c++)
+			cursor[c] = m_Cells[c].x;
+
+		for (int i = 0; i < count; i++) {
+			if (escaped[i])
+				continue;
+
+			glm::ivec3 lo = CellOf(bounds[i].m_Min);
+			glm::ivec3 hi = CellOf(bounds[i].m_Max);
+
+			for (int z = lo.z; z <= hi.z; z++)
+				for (int y = lo.y; y <= hi.y; y++)
+					for (int x = lo.x; x <= hi.x; x++)
+						m_CellPrims[cursor[CellIndex(x, y, z)]++] = i;
+		}
+	}
+
+	// Escape list goes after all the cell ranges
+	m_Escape.x = (int)m_CellPrims.size();
+	for (int i = 0; i < count; i++) {
+		if (escaped[i]) {
+			m_CellPrims.push_back(i);
+			m_Escape[table[i].type == HITTABLE_SPHERE ? 1 : 2]++;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "Hittable.h"
+
+// Uniform grid over the primitive table, traversed with a 3D-DDA in grid.glsl.
+//
+// Cells are filled with a counting sort: one pass counts the primitives overlapping
+// each cell, a prefix sum turns the counts into ranges of m_CellPrims and a second
+// pass scatters the primitive ids. Primitives are visited in table order so each
+// cell range is grouped by type (spheres, then cubes), like the primitive table.
+//
+// Primitives much larger than the typical one (a large sphere) would land in
+// every cell, so they are moved to an escape list that is tested on its own.
+class UniformGrid {
+
+public:
+	// Primitives bigger than ESCAPE_FACTOR * median extent go to the escape list
+	static constexpr float ESCAPE_FACTOR = 16.f;
+	// Target number of cells per primitive
+	static constexpr float CELL_DENSITY = 4.f;
+	static const int MAX_RESOLUTION = 128;
+
+	// bounds[i] are the bounds of primitive table entry i
+	void Build(const std::vector<AABB>& bounds, const std::vector<GPUHittable>& table);
+
+	// Flattened cell index
+	int CellIndex(int x, int y, int z) const { return x + m_Resolution.x * (y + m_Resolution.y * z); }
+
+	AABB m_Bounds;
+	glm::ivec3 m_Resolution = glm::ivec3(0);
+
+	// x = first entry in m_CellPrims, y = sphere count, z = cube count, w = unused
+	std::vector<glm::ivec4> m_Cells;
+	std::vector<int> m_CellPrims;
+
+	// Same layout as a cell, stored after the cell ranges in m_CellPrims
+	glm::ivec4 m_Escape = glm::ivec4(0);
+
+private:
+	glm::ivec3 CellOf(const glm::vec3& p) const;
+};
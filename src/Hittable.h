@@ -23,7 +23,17 @@ struct Hittable {
 	*/
 };
 
-struct GPUHittable {        // 8 bytes
-	int type;                // 0 = sphere, 1 = cube
-	int index;               // index into spheres[] or cubes[]
+// Matches the values returned by type_id() and the HITTABLE_* constants in scene.glsl_h
+enum Hittable_Type {
+	HITTABLE_SPHERE,	// 0
+	HITTABLE_CUBE,		// 1
+	HITTABLE_PLANE,		// 2, unbounded, never inside the acceleration structure
+	HITTABLE_TYPE_COUNT
+};
+
+struct GPUHittable {        // 16 bytes
+	int type;                // 0 = sphere, 1 = cube, 2 = plane
+	int index;               // index into spheres[], cubes[] or planes[]
+	int light;               // index into the light list, -1 when not emissive
+	int pad;
 };
\ No newline at end of file
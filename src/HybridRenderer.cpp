@@ -0,0 +1,99 @@
+#include "HybridRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Moves rate towards the rows per millisecond of the last frame, a side without rows keeps its rate
+static void smooth_rate(double& rate, int rows, double ms, float weight) {
+	if (rows <= 0 || ms <= 0.0)
+		return;
+	double measured = rows / ms;
+	rate = rate > 0.0 ? rate + weight * (measured - rate) : measured;
+}
+
+HybridRenderer::~HybridRenderer()
+{
+	glDeleteBuffers(1, &m_Pbo);
+}
+
+void HybridRenderer::Init()
+{
+	glGenBuffers(1, &m_Pbo);
+}
+
+void HybridRenderer::RenderFrame(GLuint program_id, Dispatcher& dispatcher, CPUTracer& tracer, const Camera& cam,
+	GLuint image, unsigned int width, unsigned int height, int samples, int max_depth)
+{
+	int rows = int(height);
+	m_GpuRows = int(std::lround(m_GpuShare * rows / ROW_ALIGN)) * ROW_ALIGN;
+	m_GpuRows = std::min(std::max(m_GpuRows, 0), rows);
+	m_CpuRows = rows - m_GpuRows;
+
+	// The CPU side starts first, the main thread only queues the GPU work and then waits for it
+	auto start = std::chrono::steady_clock::now();
+	std::thread cpu;
+	if (m_CpuRows > 0) {
+		cpu = std::thread([&]() {
+			Tile rows = { glm::ivec2(0, m_GpuRows), glm::ivec2(width, height) };
+			tracer.RenderRegion(cam, width, height, rows, samples, max_depth);
+			m_CpuMs = elapsed_ms(start);
+		});
+	}
+
+	// Timed on the wall clock with a fence, time queries of software drivers do not cover the dispatch
+	if (m_GpuRows > 0) {
+		dispatcher.Dispatch(program_id, width, m_GpuRows);
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+		m_GpuMs = elapsed_ms(start);
+	}
+
+	m_UploadMs = 0.0;
+	if (cpu.joinable()) {
+		cpu.join();
+		Upload(tracer, image, width);
+	}
+
+	Rebalance();
+}
+
+void HybridRenderer::Rebalance()
+{
+	smooth_rate(m_GpuRate, m_GpuRows, m_GpuMs, m_Smoothing);
+	smooth_rate(m_CpuRate, m_CpuRows, m_CpuMs, m_Smoothing);
+
+	// Rows in proportion to the rates end both sides together, as long as a row costs about the same everywhere
+	if (m_GpuRate > 0.0 && m_CpuRate > 0.0)
+		m_GpuShare = float(m_GpuRate / (m_GpuRate + m_CpuRate));
+}
+
+void HybridRenderer::Upload(const CPUTracer& tracer, GLuint image, unsigned int width)
+{
+	auto start = std::chrono::steady_clock::now();
+	size_t bytes = size_t(width) * m_CpuRows * sizeof(glm::vec4);
+
+	// Orphaning the storage lets the driver keep the previous upload alive until it has been read
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+	void* pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (pixels) {
+		memcpy(pixels, tracer.m_Framebuffer.data() + size_t(m_GpuRows) * width, bytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		// The rows do not overlap the image stores of the dispatch, the barrier only orders the two
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+		glBindTexture(GL_TEXTURE_2D, image);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, m_GpuRows, width, m_CpuRows, GL_RGBA, GL_FLOAT, nullptr);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	m_UploadMs = elapsed_ms(start);
+}
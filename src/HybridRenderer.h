@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "camera.h"
+#include "CPUTracer.h"
+#include "Dispatcher.h"
+
+// Splits every frame between the compute shader and the CPU tracer. The GPU traces the bottom
+// rows while a thread runs the CPU tracer on the rows above, which are then copied into the
+// image through a pixel buffer. Both sides trace the same paths, so the expected image has no
+// seam. After every frame the split moves towards the rows per millisecond each side reached,
+// so that both finish at about the same time.
+class HybridRenderer {
+
+public:
+	~HybridRenderer();
+
+	// Creates the pixel buffer
+	void Init();
+
+	// Traces one width x height frame into image. Every uniform of program_id except the
+	// row count must already be set, the tracer settings are those of tracer.
+	void RenderFrame(GLuint program_id, Dispatcher& dispatcher, CPUTracer& tracer, const Camera& cam,
+		GLuint image, unsigned int width, unsigned int height, int samples, int max_depth);
+
+	// Fraction of the rows the GPU traces, from the smoothed rates of both sides
+	float m_GpuShare = 0.5f;
+
+	// Weight of the newest frame in the smoothed rates
+	float m_Smoothing = 0.25f;
+
+	// Rows per millisecond of each side, 0 until measured
+	double m_GpuRate = 0.0;
+	double m_CpuRate = 0.0;
+
+	// Split and timings of the last frame, both sides timed from the start of the frame
+	int m_GpuRows = 0;
+	int m_CpuRows = 0;
+	double m_GpuMs = 0.0;
+	double m_CpuMs = 0.0;
+	double m_UploadMs = 0.0;
+
+private:
+	// GPU rows are whole rows of workgroup tiles
+	static const int ROW_ALIGN = 16;
+
+	GLuint m_Pbo = 0;
+
+	void Rebalance();
+	void Upload(const CPUTracer& tracer, GLuint image, unsigned int width);
+};
@@ -0,0 +1,284 @@
+#include "ImageCompare.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Largest side read_pfm() accepts
+static const unsigned int MAX_PFM_SIDE = 1u << 15;
+
+bool write_pfm(const std::string& path, unsigned int width, unsigned int height, const std::vector<glm::vec3>& image)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	fprintf(file, "PF\n%u %u\n-1.0\n", width, height);
+	bool written = fwrite(image.data(), sizeof(glm::vec3), image.size(), file) == image.size();
+	return fclose(file) == 0 && written;
+}
+
+bool read_pfm(const std::string& path, unsigned int& width, unsigned int& height, std::vector<glm::vec3>& image)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	// A single whitespace character ends the header
+	char magic[3] = {};
+	float scale = 0.f;
+	bool read = fscanf(file, "%2s %u %u %f", magic, &width, &height, &scale) == 4 && strcmp(magic, "PF") == 0
+		&& width > 0 && height > 0 && width <= MAX_PFM_SIDE && height <= MAX_PFM_SIDE && fgetc(file) != EOF;
+	if (read) {
+		image.resize(size_t(width) * height);
+		read = fread(image.data(), sizeof(glm::vec3), image.size(), file) == image.size();
+	}
+	fclose(file);
+	if (!read)
+		return false;
+
+	// A positive scale marks big endian floats
+	if (scale > 0.f) {
+		unsigned char* bytes = reinterpret_cast<unsigned char*>(image.data());
+		for (size_t i = 0; i < image.size() * 3; i++) {
+			std::swap(bytes[i * 4], bytes[i * 4 + 3]);
+			std::swap(bytes[i * 4 + 1], bytes[i * 4 + 2]);
+		}
+	}
+	return true;
+}
+
+double image_rmse(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& test)
+{
+	if (reference.size() != test.size() || reference.empty())
+		return HUGE_VAL;
+
+	double total = 0.0;
+	for (size_t i = 0; i < reference.size(); i++) {
+		glm::dvec3 d = glm::dvec3(reference[i]) - glm::dvec3(test[i]);
+		total += glm::dot(d, d);
+	}
+	return sqrt(total / (3.0 * reference.size()));
+}
+
+// D65 white, the XYZ of linear rgb (1, 1, 1)
+static const glm::vec3 WHITE_XYZ(0.950470f, 1.f, 1.088830f);
+
+static float srgb_to_linear(float c) {
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static glm::vec3 linear_to_xyz(const glm::vec3& c) {
+	return glm::vec3(
+		0.4124564f * c.r + 0.3575761f * c.g + 0.1804375f * c.b,
+		0.2126729f * c.r + 0.7151522f * c.g + 0.0721750f * c.b,
+		0.0193339f * c.r + 0.1191920f * c.g + 0.9503041f * c.b);
+}
+
+static glm::vec3 xyz_to_linear(const glm::vec3& c) {
+	return glm::vec3(
+		3.2404542f * c.x - 1.5371385f * c.y - 0.4985314f * c.z,
+		-0.9692660f * c.x + 1.8760108f * c.y + 0.0415560f * c.z,
+		0.0556434f * c.x - 0.2040259f * c.y + 1.0572252f * c.z);
+}
+
+// Linear opponent space the contrast sensitivity filters work in
+static glm::vec3 xyz_to_ycxcz(const glm::vec3& xyz) {
+	glm::vec3 n = xyz / WHITE_XYZ;
+	return glm::vec3(116.f * n.y - 16.f, 500.f * (n.x - n.y), 200.f * (n.y - n.z));
+}
+
+static glm::vec3 ycxcz_to_xyz(const glm::vec3& c) {
+	float y = (c.x + 16.f) / 116.f;
+	return glm::vec3(c.y / 500.f + y, y, y - c.z / 200.f) * WHITE_XYZ;
+}
+
+static float lab_f(float t) {
+	const float d = 6.f / 29.f;
+	return t > d * d * d ? cbrtf(t) : t / (3.f * d * d) + 4.f / 29.f;
+}
+
+// L*a*b* with a* and b* scaled by the lightness (Hunt effect)
+static glm::vec3 hunt_lab(const glm::vec3& xyz) {
+	glm::vec3 n = xyz / WHITE_XYZ;
+	float fx = lab_f(n.x), fy = lab_f(n.y), fz = lab_f(n.z);
+	float l = 116.f * fy - 16.f;
+	return glm::vec3(l, 0.01f * l * 500.f * (fx - fy), 0.01f * l * 200.f * (fy - fz));
+}
+
+static float hyab(const glm::vec3& a, const glm::vec3& b) {
+	glm::vec3 d = a - b;
+	return fabsf(d.x) + sqrtf(d.y * d.y + d.z * d.z);
+}
+
+// Square kernel of 2 m_Radius + 1 taps a side
+struct Kernel {
+	int m_Radius = 0;
+	std::vector<float> m_Weights;
+
+	float At(int x, int y) const { return m_Weights[size_t(y + m_Radius) * (2 * m_Radius + 1) + x + m_Radius]; }
+};
+
+// Normalized Gaussian, sigma in pixels
+static Kernel gaussian_kernel(float sigma) {
+	Kernel kernel;
+	kernel.m_Radius = std::max(1, int(ceilf(3.f * sigma)));
+	int r = kernel.m_Radius;
+
+	float sum = 0.f;
+	for (int y = -r; y <= r; y++) {
+		for (int x = -r; x <= r; x++) {
+			kernel.m_Weights.push_back(expf(-float(x * x + y * y) / (2.f * sigma * sigma)));
+			sum += kernel.m_Weights.back();
+		}
+	}
+	for (float& w : kernel.m_Weights)
+		w /= sum;
+	return kernel;
+}
+
+// First (edges) or second (points) derivative of a Gaussian along x. The positive and the
+// negative weights are normalized apart so a step or a dot of contrast 1 responds with 1.
+static Kernel feature_kernel(float sigma, bool second) {
+	Kernel kernel;
+	kernel.m_Radius = std::max(1, int(ceilf(3.f * sigma)));
+	int r = kernel.m_Radius;
+
+	float positive = 0.f, negative = 0.f;
+	for (int y = -r; y <= r; y++) {
+		for (int x = -r; x <= r; x++) {
+			float g = expf(-float(x * x + y * y) / (2.f * sigma * sigma));
+			float w = second ? (float(x * x) / (sigma * sigma) - 1.f) * g : -float(x) * g;
+			kernel.m_Weights.push_back(w);
+			(w > 0.f ? positive : negative) += w;
+		}
+	}
+	for (float& w : kernel.m_Weights)
+		w /= w > 0.f ? positive : -negative;
+	return kernel;
+}
+
+// Standard deviation in pixels of the Gaussian exp(-pi^2 x^2 / b) of the FLIP filters, x in degrees
+static float flip_sigma(float b, float pixels_per_degree) {
+	return sqrtf(b / (2.f * 3.14159265f * 3.14159265f)) * pixels_per_degree;
+}
+
+// Edge and point strength of the luminance at every pixel, borders clamped
+static void features(const std::vector<float>& luminance, int width, int height, const Kernel& edge, const Kernel& point,
+	std::vector<float>& edges, std::vector<float>& points) {
+	edges.resize(luminance.size());
+	points.resize(luminance.size());
+	int r = edge.m_Radius;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			glm::vec2 e(0.f), p(0.f);
+			for (int dy = -r; dy <= r; dy++) {
+				for (int dx = -r; dx <= r; dx++) {
+					float l = luminance[size_t(glm::clamp(y + dy, 0, height - 1)) * width + glm::clamp(x + dx, 0, width - 1)];
+					e += l * glm::vec2(edge.At(dx, dy), edge.At(dy, dx));
+					p += l * glm::vec2(point.At(dx, dy), point.At(dy, dx));
+				}
+			}
+			edges[size_t(y) * width + x] = glm::length(e);
+			points[size_t(y) * width + x] = glm::length(p);
+		}
+	}
+}
+
+void image_flip(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& test,
+	unsigned int width, unsigned int height, float pixels_per_degree, std::vector<float>& errors)
+{
+	size_t pixels = size_t(width) * height;
+	errors.assign(pixels, 1.f);
+	if (reference.size() != pixels || test.size() != pixels)
+		return;
+
+	// Achromatic, red-green and blue-yellow contrast sensitivity, feature width 0.082 degrees
+	Kernel filters[3] = {
+		gaussian_kernel(flip_sigma(0.0047f, pixels_per_degree)),
+		gaussian_kernel(flip_sigma(0.0053f, pixels_per_degree)),
+		gaussian_kernel(flip_sigma(0.04f, pixels_per_degree)),
+	};
+	float feature_sigma = 0.5f * 0.082f * pixels_per_degree;
+	Kernel edge = feature_kernel(feature_sigma, false);
+	Kernel point = feature_kernel(feature_sigma, true);
+
+	// Both images as displayed, in YCxCz, and their normalized luminance
+	const std::vector<glm::vec3>* images[2] = { &reference, &test };
+	std::vector<glm::vec3> opponent[2];
+	std::vector<float> luminance[2];
+	for (int i = 0; i < 2; i++) {
+		opponent[i].resize(pixels);
+		luminance[i].resize(pixels);
+		for (size_t p = 0; p < pixels; p++) {
+			glm::vec3 display = glm::clamp((*images[i])[p], 0.f, 1.f);
+			glm::vec3 linear(srgb_to_linear(display.r), srgb_to_linear(display.g), srgb_to_linear(display.b));
+			opponent[i][p] = xyz_to_ycxcz(linear_to_xyz(linear));
+			luminance[i][p] = (opponent[i][p].x + 16.f) / 116.f;
+		}
+	}
+
+	std::vector<float> edges[2], points[2];
+	for (int i = 0; i < 2; i++)
+		features(luminance[i], int(width), int(height), edge, point, edges[i], points[i]);
+
+	// Largest HyAB distance between display colors, green against blue
+	const float qc = 0.7f, pc = 0.4f, pt = 0.95f;
+	float cmax = powf(hyab(hunt_lab(linear_to_xyz(glm::vec3(0.f, 1.f, 0.f))), hunt_lab(linear_to_xyz(glm::vec3(0.f, 0.f, 1.f)))), qc);
+
+	int w = int(width), h = int(height);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+
+			// Filtered colors, clamped to the display gamut again
+			glm::vec3 lab[2];
+			for (int i = 0; i < 2; i++) {
+				glm::vec3 filtered(0.f);
+				for (int c = 0; c < 3; c++) {
+					const Kernel& k = filters[c];
+					for (int dy = -k.m_Radius; dy <= k.m_Radius; dy++)
+						for (int dx = -k.m_Radius; dx <= k.m_Radius; dx++)
+							filtered[c] += k.At(dx, dy) * opponent[i][size_t(glm::clamp(y + dy, 0, h - 1)) * w + glm::clamp(x + dx, 0, w - 1)][c];
+				}
+				glm::vec3 linear = glm::clamp(xyz_to_linear(ycxcz_to_xyz(filtered)), 0.f, 1.f);
+				lab[i] = hunt_lab(linear_to_xyz(linear));
+			}
+
+			// Small differences are compressed, the largest ones reach 1
+			float color = powf(hyab(lab[0], lab[1]), qc);
+			if (color < pc * cmax)
+				color *= pt / (pc * cmax);
+			else
+				color = pt + (color - pc * cmax) / (cmax - pc * cmax) * (1.f - pt);
+
+			size_t p = size_t(y) * w + x;
+			float feature = std::max(fabsf(edges[0][p] - edges[1][p]), fabsf(points[0][p] - points[1][p]));
+			feature = sqrtf(std::min(feature / sqrtf(2.f), 1.f));
+
+			errors[p] = powf(std::min(color, 1.f), 1.f - feature);
+		}
+	}
+}
+
+bool write_heatmap(const std::string& path, unsigned int width, unsigned int height, const std::vector<float>& errors)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+	std::vector<unsigned char> row(size_t(width) * 3);
+	bool written = errors.size() == size_t(width) * height;
+	for (unsigned int y = height; written && y-- > 0; ) {
+		for (unsigned int x = 0; x < width; x++) {
+			float e = glm::clamp(errors[size_t(y) * width + x], 0.f, 1.f);
+			glm::vec3 color = glm::clamp(glm::vec3(3.f * e, 3.f * e - 1.f, 3.f * e - 2.f), 0.f, 1.f);
+			for (int c = 0; c < 3; c++)
+				row[x * 3 + c] = (unsigned char)(color[c] * 255.f + 0.5f);
+		}
+		written = fwrite(row.data(), 1, row.size(), file) == row.size();
+	}
+	return fclose(file) == 0 && written;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Float images for the golden image tests: rgb, row major from the bottom row like the framebuffer.
+
+// Portable float map, a negative scale marks little endian floats
+bool write_pfm(const std::string& path, unsigned int width, unsigned int height, const std::vector<glm::vec3>& image);
+bool read_pfm(const std::string& path, unsigned int& width, unsigned int& height, std::vector<glm::vec3>& image);
+
+// Root mean square difference over the pixels and channels
+double image_rmse(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& test);
+
+// Per pixel perceptual error in [0, 1] of test against reference as shown on screen (clamped to
+// [0, 1] like the display shader), after LDR FLIP (Andersson et al. 2020): both images are
+// filtered by a contrast sensitivity model for pixels_per_degree, the color difference is HyAB
+// in a Hunt adjusted L*a*b* and is raised where edges or points of the luminance differ.
+// Single Gaussians per channel stand in for the sums of the paper.
+void image_flip(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& test,
+	unsigned int width, unsigned int height, float pixels_per_degree, std::vector<float>& errors);
+
+// Errors in [0, 1] as a black, red, yellow, white ramp, binary PPM from the top row
+bool write_heatmap(const std::string& path, unsigned int width, unsigned int height, const std::vector<float>& errors);
@@ -0,0 +1,248 @@
+#include "LightTree.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float PI_F = 3.14159265358979f;
+
+// Half the surface area, enough to compare split candidates
+static float half_area(const AABB& box) {
+	glm::vec3 e = box.Extent();
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// cos(max(0, a - b)) from the sines and cosines of a and b
+static float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+	if (cos_a > cos_b)
+		return 1.f;
+	return cos_a * cos_b + sin_a * sin_b;
+}
+
+// Smallest cone holding both cones, as in pbrt's DirectionCone::Union
+static void merge_cones(glm::vec3& axis, float& cos_theta, const glm::vec3& other_axis, float other_cos) {
+
+	float theta_a = acosf(glm::clamp(cos_theta, -1.f, 1.f));
+	float theta_b = acosf(glm::clamp(other_cos, -1.f, 1.f));
+	float theta_d = acosf(glm::clamp(glm::dot(axis, other_axis), -1.f, 1.f));
+
+	if (std::min(theta_d + theta_b, PI_F) <= theta_a)
+		return;
+	if (std::min(theta_d + theta_a, PI_F) <= theta_b) {
+		axis = other_axis;
+		cos_theta = other_cos;
+		return;
+	}
+
+	float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+	glm::vec3 k = glm::cross(axis, other_axis);
+	if (theta_o >= PI_F || glm::dot(k, k) == 0.f) {
+		cos_theta = -1.f;
+		return;
+	}
+
+	// Rotate axis toward other_axis around k, k is orthogonal to axis
+	float theta_r = theta_o - theta_a;
+	k = glm::normalize(k);
+	axis = glm::normalize(axis * cosf(theta_r) + glm::cross(k, axis) * sinf(theta_r));
+	cos_theta = cosf(theta_o);
+}
+
+void LightTree::Build(const std::vector<LightBounds>& lights)
+{
+	m_Nodes.clear();
+	m_Order.resize(lights.size());
+	m_Trails.assign(lights.size(), 0u);
+	if (lights.empty())
+		return;
+
+	for (int i = 0; i < (int)lights.size(); i++)
+		m_Order[i] = i;
+
+	m_Nodes.reserve(2 * lights.size() - 1);
+	m_Nodes.resize(1);
+	BuildNode(lights, 0, 0, (int)lights.size(), 0, 0u);
+}
+
+void LightTree::BuildNode(const std::vector<LightBounds>& lights, int node, int begin, int end, int depth, unsigned int trail)
+{
+	// Bounds, power and emission cone of the whole range
+	AABB bounds, centroids;
+	float power = 0.f;
+	glm::vec3 axis = lights[m_Order[begin]].m_Axis;
+	float cos_theta = lights[m_Order[begin]].m_CosTheta;
+
+	for (int i = begin; i < end; i++) {
+		const LightBounds& light = lights[m_Order[i]];
+		bounds.Expand(light.m_Bounds);
+		glm::vec3 c = light.m_Bounds.Center();
+		centroids.Expand(AABB(c, c));
+		power += light.m_Power;
+		merge_cones(axis, cos_theta, light.m_Axis, light.m_CosTheta);
+	}
+
+	GPULightNode result = { glm::vec4(bounds.m_Min, power), glm::vec4(bounds.m_Max, 0.f), glm::vec4(axis, cos_theta) };
+
+	if (end - begin == 1) {
+		result.max_child.w = -float(m_Order[begin] + 1);
+		m_Trails[m_Order[begin]] = trail;
+		m_Nodes[node] = result;
+		return;
+	}
+
+	// Bin the centroids along the longest axis and pick the cheapest plane
+	glm::vec3 extent = centroids.Extent();
+	int split_axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	int mid = begin + (end - begin) / 2;
+
+	// Balanced splits from here on when an uneven one could run out of trail bits
+	int balanced_depth = depth;
+	for (int count = end - begin; count > 1; count = (count + 1) / 2)
+		balanced_depth++;
+
+	if (extent[split_axis] > 0.f && balanced_depth < MAX_DEPTH - 1) {
+
+		AABB bin_bounds[SPLIT_BINS];
+		float bin_power[SPLIT_BINS] = {};
+		auto bin_of = [&](int light) {
+			float c = lights[light].m_Bounds.Center()[split_axis];
+			int bin = int(SPLIT_BINS * (c - centroids.m_Min[split_axis]) / extent[split_axis]);
+			return std::min(bin, SPLIT_BINS - 1);
+		};
+
+		for (int i = begin; i < end; i++) {
+			int bin = bin_of(m_Order[i]);
+			bin_bounds[bin].Expand(lights[m_Order[i]].m_Bounds);
+			bin_power[bin] += lights[m_Order[i]].m_Power;
+		}
+
+		float best_cost = INFINITY;
+		int best_split = -1;
+		for (int split = 1; split < SPLIT_BINS; split++) {
+			AABB left, right;
+			float left_power = 0.f, right_power = 0.f;
+			for (int b = 0; b < split; b++) {
+				left.Expand(bin_bounds[b]);
+				left_power += bin_power[b];
+			}
+			for (int b = split; b < SPLIT_BINS; b++) {
+				right.Expand(bin_bounds[b]);
+				right_power += bin_power[b];
+			}
+			if (left.IsEmpty() || right.IsEmpty())
+				continue;
+
+			float cost = left_power * half_area(left) + right_power * half_area(right);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_split = split;
+			}
+		}
+
+		if (best_split > 0)
+			mid = int(std::partition(m_Order.begin() + begin, m_Order.begin() + end,
+				[&](int light) { return bin_of(light) < best_split; }) - m_Order.begin());
+	}
+
+	// Coincident centroids or no valid plane, split the range in half
+	if (mid == begin || mid == end)
+		mid = begin + (end - begin) / 2;
+
+	int left = (int)m_Nodes.size();
+	m_Nodes.resize(left + 2);
+	BuildNode(lights, left, begin, mid, depth + 1, trail);
+	BuildNode(lights, left + 1, mid, end, depth + 1, trail | (1u << depth));
+
+	result.max_child.w = float(left);
+	m_Nodes[node] = result;
+}
+
+float LightTree::Importance(const GPULightNode& node, const glm::vec3& p, const glm::vec3& n)
+{
+	glm::vec3 box_min = glm::vec3(node.min_power);
+	glm::vec3 box_max = glm::vec3(node.max_child);
+	glm::vec3 center = 0.5f * (box_min + box_max);
+
+	// Distance clamped to the bounding sphere so points inside the bounds do not blow up
+	glm::vec3 to_light = center - p;
+	float r2 = 0.25f * glm::dot(box_max - box_min, box_max - box_min);
+	float d2 = std::max(glm::dot(to_light, to_light), r2);
+	glm::vec3 wi = to_light * (1.f / sqrtf(std::max(glm::dot(to_light, to_light), 1e-12f)));
+
+	// Half angle of the directions the bounds cover as seen from p
+	bool inside = glm::all(glm::greaterThanEqual(p, box_min)) && glm::all(glm::lessThanEqual(p, box_max));
+	float cos_b = inside || d2 <= r2 ? -1.f : sqrtf(1.f - r2 / d2);
+	float sin_b = sqrtf(std::max(0.f, 1.f - cos_b * cos_b));
+
+	// Emission toward p: angle to the cone, less the cone and the bounds spread
+	glm::vec3 axis = glm::vec3(node.axis_cosTheta);
+	float cos_o = node.axis_cosTheta.w;
+	float sin_o = sqrtf(std::max(0.f, 1.f - cos_o * cos_o));
+	float cos_w = glm::dot(axis, -wi);
+	float sin_w = sqrtf(std::max(0.f, 1.f - cos_w * cos_w));
+	float cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, cos_o);
+	float sin_x = sqrtf(std::max(0.f, 1.f - cos_x * cos_x));
+	float cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+
+	// Every surface point emits over its hemisphere
+	if (cos_p <= 0.f)
+		return 0.f;
+
+	// Receiver cosine, widened by the bounds spread
+	float cos_i = glm::dot(n, wi);
+	float sin_i = sqrtf(std::max(0.f, 1.f - cos_i * cos_i));
+	float cos_ip = std::max(cos_sub_clamped(sin_i, cos_i, sin_b, cos_b), 0.f);
+
+	return node.min_power.w * cos_p * cos_ip / d2;
+}
+
+int LightTree::Sample(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const
+{
+	pmf = 1.f;
+	if (m_Nodes.empty())
+		return -1;
+
+	int node = 0;
+	while (m_Nodes[node].max_child.w >= 0.f) {
+
+		int left = int(m_Nodes[node].max_child.w + 0.5f);
+		float w_left = Importance(m_Nodes[left], p, n);
+		float w_right = Importance(m_Nodes[left + 1], p, n);
+		if (w_left + w_right <= 0.f)
+			return -1;
+
+		float p_left = w_left / (w_left + w_right);
+		if (u < p_left) {
+			u = std::min(u / p_left, 0.99999994f);
+			pmf *= p_left;
+			node = left;
+		}
+		else {
+			u = std::min((u - p_left) / (1.f - p_left), 0.99999994f);
+			pmf *= 1.f - p_left;
+			node = left + 1;
+		}
+	}
+
+	return int(-m_Nodes[node].max_child.w + 0.5f) - 1;
+}
+
+float LightTree::Pmf(const glm::vec3& p, const glm::vec3& n, unsigned int trail) const
+{
+	float pmf = 1.f;
+	int node = 0;
+	while (m_Nodes[node].max_child.w >= 0.f) {
+
+		int left = int(m_Nodes[node].max_child.w + 0.5f);
+		float w_left = Importance(m_Nodes[left], p, n);
+		float w_right = Importance(m_Nodes[left + 1], p, n);
+		if (w_left + w_right <= 0.f)
+			return 0.f;
+
+		bool right = (trail & 1u) != 0u;
+		pmf *= (right ? w_right : w_left) / (w_left + w_right);
+		node = right ? left + 1 : left;
+		trail >>= 1;
+	}
+
+	return pmf;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+// How sample_light() picks a light, must match the LIGHT_SAMPLING_* constants in light.glsl_h
+enum Light_Sampling {
+	LIGHT_SAMPLING_UNIFORM,	// 0, every light is equally likely
+	LIGHT_SAMPLING_TREE,	// 1, descend the light tree by estimated contribution
+};
+
+struct GPULightNode {             // 48 bytes
+	glm::vec4 min_power;          // xyz = bounds min, w = emitted power of the subtree
+	glm::vec4 max_child;          // xyz = bounds max, w = first child index, -(light + 1) for a leaf (as float)
+	glm::vec4 axis_cosTheta;      // xyz = emission cone axis, w = cos of the cone half angle
+};
+
+// Binary tree over the light list in the spirit of Conty Estevez and Kulla, "Importance
+// Sampling of Many Lights with Adaptive Tree Splitting". Every node bounds the position,
+// the total power and the emitted directions of its lights, so a shading point can
+// estimate the contribution of both children and descend stochastically.
+//
+// Children are stored next to each other, an interior node only keeps the first one.
+// Each leaf holds one light. Splits minimize power x surface area over binned centroids.
+class LightTree {
+
+public:
+	static const int SPLIT_BINS = 12;
+	// Trails are 32 bit masks, deeper ranges fall back to balanced splits
+	static const int MAX_DEPTH = 32;
+
+	// Everything the tree needs to know about one light
+	struct LightBounds {
+		AABB m_Bounds;
+		float m_Power = 0.f;
+		glm::vec3 m_Axis = glm::vec3(0.f, 0.f, 1.f);
+		float m_CosTheta = -1.f;	// -1 emits in every direction
+	};
+
+	// lights[i] bounds entry i of the light list
+	void Build(const std::vector<LightBounds>& lights);
+
+	// Estimated contribution of a node to point p with normal n, mirrors light_importance() in light.glsl
+	static float Importance(const GPULightNode& node, const glm::vec3& p, const glm::vec3& n);
+
+	// Light list index picked with probability pmf, -1 when no light can contribute.
+	// u in [0, 1) is rescaled at every level so one random number drives the descent.
+	int Sample(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const;
+
+	// Probability of Sample() picking the light with the given trail, mirrors light_tree_pmf()
+	float Pmf(const glm::vec3& p, const glm::vec3& n, unsigned int trail) const;
+
+	std::vector<GPULightNode> m_Nodes;
+
+	// Path from the root to each light's leaf, bit i set = right child at depth i
+	std::vector<unsigned int> m_Trails;
+
+private:
+	std::vector<int> m_Order;
+
+	// Fills m_Nodes[node] from the lights m_Order[begin, end), trail leads from the root to node
+	void BuildNode(const std::vector<LightBounds>& lights, int node, int begin, int end, int depth, unsigned int trail);
+};
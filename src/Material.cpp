@@ -9,6 +9,7 @@ Material::Material()
 	m_Type = LAMBERTIAN;
 	m_RefractionIndex = 0.0f;
 	m_Fuzz = 0.0f;
+	m_Emission = 0.0f;
 	m_Albedo = glm::vec3(1.f);
 }
 
@@ -17,6 +18,7 @@ Material::Material(const glm::vec3& albedo) {
 	m_Type = LAMBERTIAN;
 	m_RefractionIndex = 0.0f;
 	m_Fuzz = 0.0f;
+	m_Emission = 0.0f;
 	m_Albedo = albedo;
 }
 
@@ -25,6 +27,7 @@ Material::Material(const glm::vec3& albedo, const float fuzz) {
 	m_Type = METAL;
 	m_RefractionIndex = 0.0f;
 	m_Fuzz = fuzz;
+	m_Emission = 0.0f;
 	m_Albedo = albedo;
 }
 
@@ -33,6 +36,7 @@ Material::Material(const float rf) {
 	m_Type = DIELECTRIC;
 	m_RefractionIndex = rf;
 	m_Fuzz = 0.0f;
+	m_Emission = 0.0f;
 	m_Albedo = glm::vec3(1.f);
 }
 
@@ -69,13 +73,23 @@ Material Material::MakeDielectric(const float rf) {
 	return mat;
 }
 
+// Emissive
+Material Material::MakeEmissive(const glm::vec3& color, const float strength) {
+
+	Material mat;
+	mat.m_Type = EMISSIVE;
+	mat.m_Emission = strength;
+	mat.m_Albedo = color;
+	return mat;
+}
+
 void Material::CreateGPUMaterial()
 {
 	GPUMaterial gpuMat;
 	gpuMat.type_ref_pad.x = static_cast<float>(m_Type);
 	gpuMat.type_ref_pad.y = m_RefractionIndex;
 	gpuMat.type_ref_pad.w = 0.f;
-	gpuMat.type_ref_pad.z = 0.f;
+	gpuMat.type_ref_pad.z = m_Emission;
 	gpuMat.albedo_fuzz = glm::vec4(m_Albedo, m_Fuzz);
 
 	gpuMats.push_back(gpuMat);
@@ -7,12 +7,13 @@ enum Material_Type {
 	LAMBERTIAN,	// 0
 	METAL,		// 1
 	DIELECTRIC,	// 2
+	EMISSIVE,	// 3, emits albedo * strength and does not scatter
 };
 
 // std430 32 bytes
 struct GPUMaterial {
-	glm::vec4 albedo_fuzz;   // rgb = albedo, w = fuzz
-	glm::vec4 type_ref_pad;  // x = type (as float), y = ior, z,w = padding
+	glm::vec4 albedo_fuzz;   // rgb = albedo, w = fuzz (metal roughness, GGX alpha = fuzz^2)
+	glm::vec4 type_ref_pad;  // x = type (as float), y = ior, z = emission strength, w = padding
 };
 
 class Material{
@@ -21,6 +22,7 @@ public:
 	Material_Type m_Type;
 	float m_Fuzz;
 	float m_RefractionIndex;
+	float m_Emission;
 	glm::vec3 m_Albedo;
 
 	// Default White Sphere
@@ -38,6 +40,9 @@ public:
 	Material(const float rf);
 	static Material MakeDielectric(const float rf);
 
+	// Emissive, radiance is color * strength
+	static Material MakeEmissive(const glm::vec3& color, const float strength);
+
 	static std::vector<GPUMaterial> gpuMats;
 
 	void CreateGPUMaterial();
@@ -0,0 +1,16 @@
+#include "Plane.h"
+
+Plane::Plane(glm::vec3 point, glm::vec3 normal, glm::vec3 color) {
+    m_Position = point;
+    m_Normal = glm::normalize(normal);
+    m_Radius = 0.f;
+    m_Color = color;
+    m_MatId = 0.f;
+}
+
+GPUPlane Plane::GetGPUPlane() {
+    GPUPlane gpuPlane;
+    gpuPlane.normal_offset = glm::vec4(m_Normal, glm::dot(m_Normal, m_Position));
+    gpuPlane.color_matId = glm::vec4(m_Color, static_cast<float>(m_MatId));
+    return gpuPlane;
+}
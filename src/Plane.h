@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Object.h"
+
+struct GPUPlane {            // 32 bytes (two vec4s)
+	glm::vec4 normal_offset; // xyz = unit normal, w = offset (dot(normal, p) == offset on the plane)
+	glm::vec4 color_matId;   // rgb = color,  w = matId (as float)
+};
+
+// Infinite plane through m_Position. It has no bounds, so the scene keeps planes
+// out of the acceleration structure and tests them on their own.
+class Plane : public Object {
+
+	public:
+		glm::vec3 m_Normal;
+
+		// Type 2 is considered a plane
+		int type_id() const override { return 2; }
+
+		Plane(glm::vec3 point, glm::vec3 normal, glm::vec3 color);
+
+		GPUPlane GetGPUPlane();
+};
@@ -0,0 +1,50 @@
+#include "Profiler.h"
+
+#include <algorithm>
+
+void GPUTimer::Init()
+{
+	glGenQueries(QUERY_COUNT, m_Queries);
+}
+
+void GPUTimer::Begin()
+{
+	GLuint query = m_Queries[m_Frame % QUERY_COUNT];
+
+	// This query was issued QUERY_COUNT frames ago, its result is usually ready by now
+	if (m_Frame >= QUERY_COUNT) {
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			m_LastMs = double(elapsed) / 1.0e6;
+		}
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void GPUTimer::End()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	m_Frame++;
+}
+
+GroupUtilization GroupUtilization::FromWork(const std::vector<GLuint>& work)
+{
+	GroupUtilization util;
+	if (work.empty())
+		return util;
+
+	util.m_Groups = (int)work.size();
+	util.m_MinWork = *std::min_element(work.begin(), work.end());
+	util.m_MaxWork = *std::max_element(work.begin(), work.end());
+
+	double total = 0.0;
+	for (GLuint w : work)
+		total += w;
+	util.m_MeanWork = total / work.size();
+
+	return util;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <glad/glad.h>
+
+// Measures GPU time with GL_TIME_ELAPSED queries. Results are read back a few
+// frames late so the CPU never stalls waiting for the GPU.
+class GPUTimer {
+
+public:
+	void Init();
+	void Begin();
+	void End();
+
+	// Last available measurement in milliseconds
+	double m_LastMs = 0.0;
+
+private:
+	static const int QUERY_COUNT = 4;
+	GLuint m_Queries[QUERY_COUNT] = {};
+	unsigned int m_Frame = 0;
+};
+
+// Balance of the work done by each compute workgroup in one frame
+struct GroupUtilization {
+	int m_Groups = 0;
+	double m_MinWork = 0.0;		// bounces traced by the least busy group
+	double m_MeanWork = 0.0;
+	double m_MaxWork = 0.0;		// the frame lasts at least as long as this group
+
+	// Average busy fraction if every group runs until the busiest one finishes
+	double Utilization() const { return m_MaxWork > 0.0 ? m_MeanWork / m_MaxWork : 0.0; }
+
+	static GroupUtilization FromWork(const std::vector<GLuint>& work);
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// CPU mirrors of the structs in types.glsl_h
+
+struct Interval {
+	float min; // Lower bound (t_min)
+	float max; // Upper bound (t_max)
+
+	bool contains(float x) const { return min <= x && x <= max; }
+	bool surrounds(float x) const { return min < x && x < max; }
+};
+
+struct Ray {
+	glm::vec3 origin;      // Ray start point
+	glm::vec3 direction;   // Ray direction vector
+
+	glm::vec3 at(float t) const { return origin + t * direction; }
+};
+
+struct HitRecord {
+	glm::vec3 point;       // Intersection point
+	glm::vec3 normal;      // Surface normal at hit
+	float t;               // Ray parameter at hit
+	bool front_face;       // Did we hit front-facing side?
+	int matId;             // Index into Material::gpuMats, unpacked by Scatter()
+
+	void set_face_normal(const Ray& r, const glm::vec3& outward_normal) {
+		front_face = glm::dot(r.direction, outward_normal) < 0;
+		normal = front_face ? outward_normal : -outward_normal;
+	}
+};
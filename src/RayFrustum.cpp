@@ -0,0 +1,107 @@
+#include "RayFrustum.h"
+#include "Scene.h"
+
+#include <algorithm>
+
+// Slack for the rounding of the ray directions, in scene units
+static const float FRUSTUM_EPSILON = 1e-4f;
+
+RayFrustum::RayFrustum(const glm::vec3& origin, const glm::vec3 corners[4])
+	: m_Origin(origin)
+{
+	// Adjacent corners span a side plane, the sum of all points inside
+	glm::vec3 center = corners[0] + corners[1] + corners[2] + corners[3];
+
+	for (int i = 0; i < 4; i++) {
+		glm::vec3 normal = glm::normalize(glm::cross(corners[i], corners[(i + 1) % 4]));
+		if (glm::dot(normal, center) < 0.f)
+			normal = -normal;
+		m_Planes[i] = glm::vec4(normal, -glm::dot(normal, origin));
+	}
+}
+
+bool RayFrustum::OverlapsSphere(const glm::vec3& center, float radius) const
+{
+	for (const glm::vec4& plane : m_Planes)
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -(radius + FRUSTUM_EPSILON))
+			return false;
+	return true;
+}
+
+bool RayFrustum::OverlapsBox(const AABB& box) const
+{
+	// The corner furthest along each normal decides, the box is outside when even it is
+	for (const glm::vec4& plane : m_Planes) {
+		glm::vec3 normal(plane);
+		glm::vec3 corner = glm::mix(box.m_Min, box.m_Max, glm::vec3(glm::greaterThan(normal, glm::vec3(0.f))));
+		if (glm::dot(normal, corner) + plane.w < -FRUSTUM_EPSILON)
+			return false;
+	}
+	return true;
+}
+
+bool RayFrustum::Overlaps(const Scene& scene, int prim) const
+{
+	const GPUHittable& h = scene.m_Hittables[prim];
+	if (h.type == HITTABLE_SPHERE) {
+		const glm::vec4& cr = scene.m_Spheres[h.index].center_radius;
+		return OverlapsSphere(glm::vec3(cr), cr.w);
+	}
+	return OverlapsBox(scene.PrimitiveBounds(prim));
+}
+
+bool RayFrustum::Cull(const Scene& scene, std::vector<int>& prims, size_t limit) const
+{
+	prims.clear();
+	const UniformGrid& grid = scene.m_Grid;
+
+	if (scene.m_AccelType != ACCEL_GRID || grid.m_Cells.empty()) {
+		for (int i = 0; i < scene.BoundedCount(); i++)
+			if (Overlaps(scene, i))
+				prims.push_back(i);
+		return true;
+	}
+
+	// Primitives span several cells, duplicates are removed after the walk
+	for (int i = grid.m_Escape.x; i < grid.m_Escape.x + grid.m_Escape.y + grid.m_Escape.z; i++)
+		prims.push_back(grid.m_CellPrims[i]);
+	if (!CullCells(scene, glm::ivec3(0), grid.m_Resolution, prims, limit))
+		return false;
+
+	std::sort(prims.begin(), prims.end());
+	prims.erase(std::unique(prims.begin(), prims.end()), prims.end());
+	prims.erase(std::remove_if(prims.begin(), prims.end(), [&](int prim) { return !Overlaps(scene, prim); }), prims.end());
+	return true;
+}
+
+bool RayFrustum::CullCells(const Scene& scene, const glm::ivec3& lo, const glm::ivec3& hi, std::vector<int>& prims, size_t limit) const
+{
+	const UniformGrid& grid = scene.m_Grid;
+	glm::vec3 cell_size = grid.m_Bounds.Extent() / glm::vec3(grid.m_Resolution);
+	AABB box(grid.m_Bounds.m_Min + glm::vec3(lo) * cell_size, grid.m_Bounds.m_Min + glm::vec3(hi) * cell_size);
+	if (!OverlapsBox(box))
+		return true;
+
+	glm::ivec3 size = hi - lo;
+	if (size.x * size.y * size.z == 1) {
+		const glm::ivec4& cell = grid.m_Cells[grid.CellIndex(lo.x, lo.y, lo.z)];
+		for (int i = cell.x; i < cell.x + cell.y + cell.z; i++)
+			prims.push_back(grid.m_CellPrims[i]);
+		return prims.size() <= limit;
+	}
+
+	// Halve the longest side of the range
+	int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+	glm::ivec3 mid_hi = hi, mid_lo = lo;
+	mid_hi[axis] = lo[axis] + size[axis] / 2;
+	mid_lo[axis] = mid_hi[axis];
+	return CullCells(scene, lo, mid_hi, prims, limit) && CullCells(scene, mid_lo, hi, prims, limit);
+}
+
+void RayFrustum::Cull(const Scene& scene, const std::vector<int>& candidates, std::vector<int>& prims) const
+{
+	prims.clear();
+	for (int prim : candidates)
+		if (Overlaps(scene, prim))
+			prims.push_back(prim);
+}
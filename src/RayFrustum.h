@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+class Scene;
+
+// Pyramid around a packet of rays leaving one origin, the camera rays of a tile. A primitive
+// outside of it cannot be hit by any ray of the packet, so the packet is traced against the
+// few primitives left instead of walking the acceleration structure once per ray.
+struct RayFrustum {
+
+	// corners are the directions of the four edge rays, in order around the packet
+	RayFrustum(const glm::vec3& origin, const glm::vec3 corners[4]);
+
+	// Conservative, a primitive grazing a side plane is kept
+	bool OverlapsSphere(const glm::vec3& center, float radius) const;
+	bool OverlapsBox(const AABB& box) const;
+
+	// Spheres and cubes of the primitive table that overlap, in table order. With a grid only
+	// the cells inside the frustum are visited, found by splitting the cell range in halves.
+	// Gives up and returns false once the cells gathered more than limit primitives.
+	bool Cull(const Scene& scene, std::vector<int>& prims, size_t limit = SIZE_MAX) const;
+
+	// The entries of candidates (ascending primitive table indices) that overlap
+	void Cull(const Scene& scene, const std::vector<int>& candidates, std::vector<int>& prims) const;
+
+	glm::vec3 m_Origin;
+	glm::vec4 m_Planes[4];	// unit normals pointing inside, w = -dot(normal, origin)
+
+private:
+	bool Overlaps(const Scene& scene, int prim) const;
+	bool CullCells(const Scene& scene, const glm::ivec3& lo, const glm::ivec3& hi, std::vector<int>& prims, size_t limit) const;
+};
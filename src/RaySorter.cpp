@@ -0,0 +1,78 @@
+#include "RaySorter.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Spreads the low 6 bits of v to every third bit
+static uint32_t spreadBits(uint32_t v) {
+	v = (v | (v << 8)) & 0x0000F00Fu;
+	v = (v | (v << 4)) & 0x000C30C3u;
+	v = (v | (v << 2)) & 0x00249249u;
+	return v;
+}
+
+// Position of x in [lo, lo + extent) on a lattice of cells steps, clamped
+static uint32_t quantize(float x, float lo, float extent, int cells) {
+	int cell = int((x - lo) / extent * float(cells));
+	return uint32_t(cell < 0 ? 0 : (cell >= cells ? cells - 1 : cell));
+}
+
+uint32_t RaySorter::Key(const Ray& r, const AABB& bounds)
+{
+	const glm::vec3& d = r.direction;
+	uint32_t octant = (d.x < 0.f ? 1u : 0u) | (d.y < 0.f ? 2u : 0u) | (d.z < 0.f ? 4u : 0u);
+
+	glm::vec3 extent = glm::max(bounds.Extent(), glm::vec3(1e-6f));
+	uint32_t morton = spreadBits(quantize(r.origin.x, bounds.m_Min.x, extent.x, 64))
+		| (spreadBits(quantize(r.origin.y, bounds.m_Min.y, extent.y, 64)) << 1)
+		| (spreadBits(quantize(r.origin.z, bounds.m_Min.z, extent.z, 64)) << 2);
+
+	// Direction projected on the plane |x| + |y| + |z| = 1, the octant gives the signs back
+	float l1 = std::max(fabsf(d.x) + fabsf(d.y) + fabsf(d.z), 1e-20f);
+	uint32_t u = quantize(fabsf(d.x), 0.f, l1, 32);
+	uint32_t v = quantize(fabsf(d.y), 0.f, l1, 32);
+
+	return (octant << 28) | (morton << 10) | (u << 5) | v;
+}
+
+void RaySorter::Sort(const std::vector<uint32_t>& keys, std::vector<int>& order)
+{
+	const int buckets = 1 << RADIX_BITS;
+	size_t count = keys.size();
+
+	order.resize(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = int(i);
+	if (count < 2)
+		return;
+
+	m_Keys.assign(keys.begin(), keys.end());
+	m_KeysTmp.resize(count);
+	m_OrderTmp.resize(count);
+
+	for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+		size_t offsets[buckets] = {};
+		for (uint32_t key : m_Keys)
+			offsets[(key >> shift) & (buckets - 1)]++;
+
+		// Every key has the same digit, the pass would not move anything
+		if (offsets[(m_Keys[0] >> shift) & (buckets - 1)] == count)
+			continue;
+
+		size_t sum = 0;
+		for (size_t& offset : offsets) {
+			size_t bucket_count = offset;
+			offset = sum;
+			sum += bucket_count;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			size_t slot = offsets[(m_Keys[i] >> shift) & (buckets - 1)]++;
+			m_KeysTmp[slot] = m_Keys[i];
+			m_OrderTmp[slot] = order[i];
+		}
+
+		m_Keys.swap(m_KeysTmp);
+		order.swap(m_OrderTmp);
+	}
+}
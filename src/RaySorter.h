@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Ray.h"
+#include "AABB.h"
+
+// Orders a stream of rays so that rays traced one after another start close together and
+// point the same way, and walk the same cells and spheres while they are still in cache.
+//
+// The key is, from the top bit down: the direction octant (3 bits), the origin on a 64^3
+// lattice over the scene bounds in Morton order (18 bits), then the direction inside its
+// octant on a 32x32 lattice (10 bits). Keys are sorted with an LSD radix sort.
+class RaySorter {
+
+public:
+	// Origins outside bounds are clamped to its faces
+	static uint32_t Key(const Ray& r, const AABB& bounds);
+
+	// order receives the indices of keys in ascending key order, equal keys keep their order
+	void Sort(const std::vector<uint32_t>& keys, std::vector<int>& order);
+
+	static const int RADIX_BITS = 11;
+
+private:
+	// Ping-pong buffers of the passes, kept to reuse the allocations
+	std::vector<uint32_t> m_Keys;
+	std::vector<uint32_t> m_KeysTmp;
+	std::vector<int> m_OrderTmp;
+};
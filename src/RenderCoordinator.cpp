@@ -0,0 +1,239 @@
+#include "RenderCoordinator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "ImageCompare.h"
+
+// How often the accept loop checks whether the frame is already done
+static const int ACCEPT_POLL_MS = 200;
+
+RenderCoordinator::RenderCoordinator(const Scene& scene, const Camera& cam, unsigned int width, unsigned int height)
+	: m_Scene(scene), m_Camera(cam), m_Width(width), m_Height(height)
+{
+}
+
+bool RenderCoordinator::Render(int worker_count)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Every tile is split into sample ranges, the ranges of a tile are spread over the queue
+	int job_samples = m_SamplesPerJob > 0 ? std::min(m_SamplesPerJob, m_Samples) : m_Samples;
+	m_Pending.clear();
+	for (int first = 0; first < m_Samples; first += job_samples) {
+		for (int y = 0; y < int(m_Height); y += m_TileSize) {
+			for (int x = 0; x < int(m_Width); x += m_TileSize) {
+				RenderJob job;
+				job.m_Id = (int)m_Pending.size();
+				job.m_Min = glm::ivec2(x, y);
+				job.m_Max = glm::min(job.m_Min + m_TileSize, glm::ivec2(m_Width, m_Height));
+				job.m_FirstSample = first;
+				job.m_Samples = std::min(job_samples, m_Samples - first);
+				m_Pending.push_back(job);
+			}
+		}
+	}
+
+	std::vector<RenderJob> jobs(m_Pending.begin(), m_Pending.end());
+	m_Results.assign(jobs.size(), std::vector<glm::vec4>());
+	m_Jobs = (int)m_Pending.size();
+	m_Done = 0;
+	m_Retries = 0;
+	m_WorkersLost = 0;
+	m_Live = 0;
+
+	RenderSettings settings = {};
+	settings.m_LookFrom = m_Camera.m_LookFrom;
+	settings.m_LookAt = m_Camera.m_LookAt;
+	settings.m_Up = m_Camera.m_Up;
+	settings.m_Fov = m_Camera.m_Fov;
+	settings.m_DefocusAngle = m_Camera.m_DefocusAngle;
+	settings.m_FocusDist = m_Camera.m_FocusDist;
+	settings.m_Width = m_Width;
+	settings.m_Height = m_Height;
+	settings.m_MaxDepth = m_MaxDepth;
+	settings.m_RouletteDepth = m_RouletteDepth;
+	settings.m_Deterministic = m_Deterministic;
+	settings.m_Seed = m_Seed;
+
+	// Serialized once, every worker gets the same bytes
+	std::vector<unsigned char> scene;
+	m_Scene.Serialize(scene);
+
+	Socket listener;
+	if (!listener.Listen(m_Address))
+		return false;
+	std::cout << "Coordinator: " << m_Jobs << " jobs, scene " << scene.size() / 1024 << " KiB, waiting for "
+		<< worker_count << " workers on " << m_Address << "\n";
+
+	// Lost workers are replaced by whoever connects next, the frame is given up only when no
+	// worker was connected for m_ConnectSeconds
+	std::vector<std::thread> threads;
+	auto idle_since = std::chrono::steady_clock::now();
+	for (int worker = 0; ; ) {
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			if (m_Done == m_Jobs)
+				break;
+			if (m_Live >= worker_count) {
+				m_Changed.wait_for(lock, std::chrono::milliseconds(ACCEPT_POLL_MS));
+				continue;
+			}
+			auto now = std::chrono::steady_clock::now();
+			if (m_Live > 0)
+				idle_since = now;
+			else if (now - idle_since > std::chrono::seconds(m_ConnectSeconds)) {
+				std::cerr << "Coordinator: no worker for " << m_ConnectSeconds << " s, " << m_Jobs - m_Done << " jobs left\n";
+				break;
+			}
+		}
+		if (!listener.Wait(ACCEPT_POLL_MS))
+			continue;
+
+		Socket socket = listener.Accept();
+		worker++;
+		socket.SetTimeout(m_TimeoutMs);
+
+		uint32_t type = 0;
+		std::vector<unsigned char> payload;
+		RenderHello hello;
+		bool joined = socket.Receive(type, payload) && type == RENDER_HELLO && payload.size() == sizeof(hello);
+		if (joined)
+			memcpy(&hello, payload.data(), sizeof(hello));
+		joined = joined && hello.m_Version == RENDER_PROTOCOL_VERSION
+			&& socket.Send(RENDER_SCENE, &settings, sizeof(settings), scene.data(), scene.size());
+		if (!joined) {
+			std::cerr << "Coordinator: worker " << worker << " failed to join\n";
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_WorkersLost++;
+			continue;
+		}
+
+		std::cout << "Coordinator: worker " << worker << " joined with " << hello.m_Threads << " threads\n";
+		std::shared_ptr<Socket> connection = std::make_shared<Socket>(std::move(socket));
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Live++;
+		}
+		threads.emplace_back([this, connection, worker]() { Serve(*connection, worker); });
+	}
+	listener.Close();
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	// Added in job order, whichever worker finished first
+	m_Sums.assign(size_t(m_Width) * m_Height, glm::vec4(0.f));
+	for (const RenderJob& job : jobs) {
+		const std::vector<glm::vec4>& sums = m_Results[job.m_Id];
+		glm::ivec2 size = job.m_Max - job.m_Min;
+		for (int y = 0; y < size.y && !sums.empty(); y++)
+			for (int x = 0; x < size.x; x++)
+				m_Sums[size_t(job.m_Min.y + y) * m_Width + job.m_Min.x + x] += sums[size_t(y) * size.x + x];
+	}
+	m_Results.clear();
+
+	m_RenderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return m_Done == m_Jobs;
+}
+
+void RenderCoordinator::Serve(Socket& socket, int worker)
+{
+	std::deque<RenderJob> sent;
+	std::vector<unsigned char> payload;
+	bool failed = false;
+
+	while (!failed) {
+		std::vector<RenderJob> batch;
+		{
+			// Idle workers wait here for the jobs of a failed one until the frame is done
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Changed.wait(lock, [&]() { return !sent.empty() || !m_Pending.empty() || m_Done == m_Jobs; });
+			if (sent.empty() && m_Pending.empty())
+				break;
+
+			while (int(sent.size() + batch.size()) < m_JobsInFlight && !m_Pending.empty()) {
+				batch.push_back(m_Pending.front());
+				m_Pending.pop_front();
+			}
+		}
+
+		for (const RenderJob& job : batch) {
+			sent.push_back(job);
+			if (!socket.Send(RENDER_JOB, &job, sizeof(job))) {
+				failed = true;
+				break;
+			}
+		}
+		if (failed)
+			break;
+
+		// Results come back in any order
+		uint32_t type = 0;
+		RenderJob result;
+		if (!socket.Receive(type, payload) || type != RENDER_RESULT || payload.size() < sizeof(result)) {
+			failed = true;
+			break;
+		}
+		memcpy(&result, payload.data(), sizeof(result));
+		auto job = std::find_if(sent.begin(), sent.end(), [&](const RenderJob& j) { return j.m_Id == result.m_Id; });
+		if (job == sent.end() || !Merge(*job, payload)) {
+			failed = true;
+			break;
+		}
+		sent.erase(job);
+		m_Changed.notify_all();
+	}
+
+	if (failed) {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (const RenderJob& job : sent)
+				m_Pending.push_front(job);
+			m_Retries += (int)sent.size();
+			m_WorkersLost++;
+			m_Live--;
+		}
+		m_Changed.notify_all();
+		std::cerr << "Coordinator: lost worker " << worker << ", " << sent.size() << " jobs queued again\n";
+		return;
+	}
+
+	socket.Send(RENDER_DONE, nullptr, 0);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Live--;
+	}
+	m_Changed.notify_all();
+}
+
+bool RenderCoordinator::Merge(const RenderJob& job, const std::vector<unsigned char>& payload)
+{
+	glm::ivec2 size = job.m_Max - job.m_Min;
+	if (payload.size() != sizeof(RenderJob) + size_t(size.x) * size.y * sizeof(glm::vec4))
+		return false;
+
+	std::vector<glm::vec4> sums(size_t(size.x) * size.y);
+	memcpy(sums.data(), payload.data() + sizeof(RenderJob), sums.size() * sizeof(glm::vec4));
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Results[job.m_Id].swap(sums);
+	m_Done++;
+	return true;
+}
+
+std::vector<glm::vec3> RenderCoordinator::Image() const
+{
+	std::vector<glm::vec3> image(m_Sums.size());
+	for (size_t i = 0; i < m_Sums.size(); i++)
+		image[i] = m_Sums[i].w > 0.f ? glm::vec3(m_Sums[i]) / m_Sums[i].w : glm::vec3(0.f);
+	return image;
+}
+
+bool RenderCoordinator::WritePfm(const std::string& path) const
+{
+	return write_pfm(path, m_Width, m_Height, Image());
+}
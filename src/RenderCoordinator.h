@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "camera.h"
+#include "Socket.h"
+#include "RenderProtocol.h"
+
+// Renders a headless frame on worker processes. Workers connect to m_Address and get the scene
+// in the binary scene format once, then trace jobs: a tile of the frame and a number of its
+// samples. Results come back as per pixel sums with their sample count and are added into
+// m_Sums in job order once all are in. Every worker keeps m_JobsInFlight jobs queued so it never waits for the network. The
+// jobs of a worker that disconnects, sends garbage or stays silent for m_TimeoutMs go back to
+// the queue for the others.
+class RenderCoordinator {
+
+public:
+	RenderCoordinator(const Scene& scene, const Camera& cam, unsigned int width, unsigned int height);
+
+	// Serves up to worker_count workers at a time until every job is done, lost workers are
+	// replaced by new connections. False when the listening socket failed or no worker was
+	// connected for m_ConnectSeconds before the end
+	bool Render(int worker_count);
+
+	// Average color of every pixel, row major from the bottom row
+	std::vector<glm::vec3> Image() const;
+
+	// Portable float map, rows from the bottom like the framebuffer
+	bool WritePfm(const std::string& path) const;
+
+	std::string m_Address = ":7878";
+	int m_Samples = 64;
+	int m_MaxDepth = 10;
+	int m_RouletteDepth = 10;
+	int m_TileSize = 64;
+	int m_SamplesPerJob = 16;		// samples of a tile per job, 0 for all of them
+	int m_JobsInFlight = 2;
+	int m_TimeoutMs = 60000;
+	int m_ConnectSeconds = 60;		// without any worker before giving up the frame
+
+	// Deterministic random numbers (CPUTracer::m_Deterministic), the frame is then the same
+	// bits for any number of workers
+	bool m_Deterministic = false;
+	uint32_t m_Seed = 0;
+
+	// Per pixel sum of the samples (rgb) and their count (w)
+	std::vector<glm::vec4> m_Sums;
+
+	// Of the last Render()
+	int m_Jobs = 0;
+	int m_Retries = 0;				// jobs handed out again after their worker failed
+	int m_WorkersLost = 0;
+	double m_RenderMs = 0.0;
+
+private:
+	const Scene& m_Scene;
+	const Camera& m_Camera;
+	unsigned int m_Width;
+	unsigned int m_Height;
+
+	// Shared by the threads serving the workers
+	std::mutex m_Mutex;
+	std::condition_variable m_Changed;
+	std::deque<RenderJob> m_Pending;
+	std::vector<std::vector<glm::vec4>> m_Results;	// sums of every finished job, by id
+	int m_Done = 0;
+	int m_Live = 0;					// workers being served
+
+	// Sends jobs to one worker and merges its results until nothing is left or it fails
+	void Serve(Socket& socket, int worker);
+	bool Merge(const RenderJob& job, const std::vector<unsigned char>& payload);
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Messages between RenderCoordinator and RenderWorker, sent with Socket. Structs travel as raw
+// bytes, coordinator and workers must share the build and the byte order.
+enum Render_Message : uint32_t {
+	RENDER_HELLO = 1,		// worker -> coordinator: RenderHello
+	RENDER_SCENE,			// coordinator -> worker: RenderSettings, then the scene in the binary scene format
+	RENDER_JOB,				// coordinator -> worker: RenderJob
+	RENDER_RESULT,			// worker -> coordinator: RenderJob, then one glm::vec4 per pixel of its tile
+	RENDER_DONE,			// coordinator -> worker: no more jobs, no payload
+};
+
+// Bumped whenever a message layout changes
+static const uint32_t RENDER_PROTOCOL_VERSION = 2;
+
+struct RenderHello {
+	uint32_t m_Version = RENDER_PROTOCOL_VERSION;
+	int32_t m_Threads = 0;			// CPU workers the process will run
+};
+
+// Camera and tracer settings of the frame, the scene follows in the same message
+struct RenderSettings {
+	glm::vec3 m_LookFrom;
+	glm::vec3 m_LookAt;
+	glm::vec3 m_Up;
+	float m_Fov;
+	float m_DefocusAngle;
+	float m_FocusDist;
+	uint32_t m_Width;
+	uint32_t m_Height;
+	int32_t m_MaxDepth;
+	int32_t m_RouletteDepth;
+	int32_t m_Deterministic;		// CPUTracer::m_Deterministic with m_Seed
+	uint32_t m_Seed;
+};
+
+// Samples of the pixels [m_Min, m_Max). Results are sums of the samples (rgb) and their count (w),
+// so jobs sharing a pixel merge by adding.
+struct RenderJob {
+	int32_t m_Id;
+	glm::ivec2 m_Min;
+	glm::ivec2 m_Max;
+	int32_t m_FirstSample;			// index of the first sample, keys the deterministic random numbers
+	int32_t m_Samples;
+};
@@ -0,0 +1,116 @@
+#include "RenderWorker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "CPUTracer.h"
+#include "RenderProtocol.h"
+#include "Scene.h"
+#include "Socket.h"
+#include "camera.h"
+
+// Between connection attempts while the coordinator starts
+static const int CONNECT_RETRY_MS = 100;
+
+// Larger frames are taken for a corrupt stream rather than allocated
+static const uint32_t MAX_FRAME_SIZE = 16384;
+
+bool RenderWorker::Run(const std::string& address)
+{
+	m_Jobs = 0;
+
+	Socket socket;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_ConnectSeconds);
+	while (!socket.Connect(address)) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			std::cerr << "Worker: cannot connect to " << address << "\n";
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(CONNECT_RETRY_MS));
+	}
+	socket.SetTimeout(m_TimeoutMs);
+
+	RenderHello hello;
+	hello.m_Threads = m_ThreadCount > 0 ? m_ThreadCount : (int)std::max(1u, std::thread::hardware_concurrency());
+	if (!socket.Send(RENDER_HELLO, &hello, sizeof(hello)))
+		return false;
+
+	uint32_t type = 0;
+	std::vector<unsigned char> payload;
+	RenderSettings settings;
+	if (!socket.Receive(type, payload) || type != RENDER_SCENE || payload.size() < sizeof(settings)) {
+		std::cerr << "Worker: no scene from the coordinator\n";
+		return false;
+	}
+	memcpy(&settings, payload.data(), sizeof(settings));
+	if (settings.m_Width == 0 || settings.m_Height == 0 || settings.m_Width > MAX_FRAME_SIZE || settings.m_Height > MAX_FRAME_SIZE) {
+		std::cerr << "Worker: bad frame size " << settings.m_Width << "x" << settings.m_Height << "\n";
+		return false;
+	}
+
+	// Traced as shipped, no build step
+	Scene scene;
+	if (!scene.Deserialize(payload.data() + sizeof(settings), payload.size() - sizeof(settings))) {
+		std::cerr << "Worker: the scene does not match this build\n";
+		return false;
+	}
+
+	Camera cam;
+	cam.m_LookFrom = settings.m_LookFrom;
+	cam.m_LookAt = settings.m_LookAt;
+	cam.m_Up = settings.m_Up;
+	cam.m_Fov = settings.m_Fov;
+	cam.m_DefocusAngle = settings.m_DefocusAngle;
+	cam.m_FocusDist = settings.m_FocusDist;
+
+	CPUTracer tracer(scene);
+	tracer.m_RouletteDepth = settings.m_RouletteDepth;
+	tracer.m_Deterministic = settings.m_Deterministic != 0;
+	tracer.m_Seed = settings.m_Seed;
+	tracer.m_ThreadCount = m_ThreadCount;
+	std::cout << "Worker: " << scene.m_Hittables.size() << " primitives, " << settings.m_Width << "x" << settings.m_Height << "\n";
+
+	std::vector<glm::vec4> sums;
+	while (socket.Receive(type, payload)) {
+		if (type == RENDER_DONE)
+			return true;
+
+		RenderJob job;
+		if (type != RENDER_JOB || payload.size() != sizeof(job))
+			return false;
+		memcpy(&job, payload.data(), sizeof(job));
+
+		// RenderRegion() writes the framebuffer at these pixels
+		glm::ivec2 frame_size(settings.m_Width, settings.m_Height);
+		if (glm::any(glm::lessThan(job.m_Min, glm::ivec2(0))) || glm::any(glm::greaterThan(job.m_Max, frame_size))
+			|| glm::any(glm::greaterThanEqual(job.m_Min, job.m_Max)) || job.m_Samples <= 0) {
+			std::cerr << "Worker: job " << job.m_Id << " is outside the frame\n";
+			return false;
+		}
+
+		Tile tile = { job.m_Min, job.m_Max };
+		tracer.m_FirstSample = job.m_FirstSample;
+		tracer.RenderRegion(cam, settings.m_Width, settings.m_Height, tile, job.m_Samples, settings.m_MaxDepth);
+
+		// Averages back to sums, so the coordinator can add the jobs of a pixel
+		glm::ivec2 size = job.m_Max - job.m_Min;
+		sums.resize(size_t(size.x) * size.y);
+		for (int y = 0; y < size.y; y++) {
+			for (int x = 0; x < size.x; x++) {
+				glm::vec4 color = tracer.m_Framebuffer[size_t(job.m_Min.y + y) * settings.m_Width + job.m_Min.x + x];
+				sums[size_t(y) * size.x + x] = glm::vec4(glm::vec3(color) * float(job.m_Samples), float(job.m_Samples));
+			}
+		}
+
+		if (!socket.Send(RENDER_RESULT, &job, sizeof(job), sums.data(), sums.size() * sizeof(glm::vec4)))
+			return false;
+		m_Jobs++;
+	}
+
+	std::cerr << "Worker: lost the coordinator\n";
+	return false;
+}
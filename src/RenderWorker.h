@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+// Worker process of a RenderCoordinator. Receives the scene once, then traces every job it is
+// sent with a CPUTracer and returns the per pixel sums of the samples.
+class RenderWorker {
+
+public:
+	// Connects to the coordinator at address and serves it until it has no more jobs, false when
+	// the connection could not be made, broke on the way or went silent for m_TimeoutMs
+	bool Run(const std::string& address);
+
+	// CPU workers of the tracer, 0 for one per hardware thread
+	int m_ThreadCount = 0;
+
+	// The coordinator may still be starting, connections are tried again for this long
+	int m_ConnectSeconds = 10;
+
+	// A coordinator silent for this long is taken for lost, as RenderCoordinator::m_TimeoutMs
+	// does with its workers
+	int m_TimeoutMs = 60000;
+
+	// Jobs traced by the last Run()
+	int m_Jobs = 0;
+};
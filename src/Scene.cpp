@@ -0,0 +1,515 @@
+#include "Scene.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Buffer bindings, must match buffers.glsl_h
+static const GLuint SPHERES_BINDING   = 0;
+static const GLuint MATERIALS_BINDING = 1;
+static const GLuint CUBES_BINDING     = 2;
+static const GLuint HITTABLES_BINDING = 3;
+static const GLuint CELLS_BINDING     = 4;
+static const GLuint CELL_PRIMS_BINDING = 5;
+static const GLuint PLANES_BINDING    = 6;
+static const GLuint LIGHTS_BINDING    = 8;
+static const GLuint LIGHT_NODES_BINDING = 9;
+
+// Below this many primitives walking the table beats any structure
+static const int GRID_MIN_PRIMITIVES = 32;
+// Grids degrade when primitive sizes vary a lot (ignoring escaped primitives)
+static const float GRID_MAX_SIZE_SPREAD = 16.f;
+// Spheres this many times larger than everything else are converted to planes
+static const float PLANE_RADIUS_FACTOR = 10.f;
+
+// Start of the binary scene format, the version changes with any packed layout
+static const uint32_t SCENE_MAGIC = 0x4E435352;		// "RSCN"
+static const uint32_t SCENE_VERSION = 1;
+
+template <class T>
+static void write_value(std::vector<unsigned char>& out, const T& value) {
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <class T>
+static void write_array(std::vector<unsigned char>& out, const std::vector<T>& values) {
+	write_value(out, uint64_t(values.size()));
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values.data());
+	out.insert(out.end(), bytes, bytes + values.size() * sizeof(T));
+}
+
+// Reads what write_value() and write_array() wrote, every read fails once one ran past the end
+struct SceneReader {
+	const unsigned char* m_Data;
+	size_t m_Size;
+	size_t m_Offset = 0;
+	bool m_Ok = true;
+
+	template <class T>
+	void Value(T& value) {
+		if (!m_Ok || m_Size - m_Offset < sizeof(T)) {
+			m_Ok = false;
+			return;
+		}
+		memcpy(&value, m_Data + m_Offset, sizeof(T));
+		m_Offset += sizeof(T);
+	}
+
+	template <class T>
+	void Array(std::vector<T>& values) {
+		uint64_t count = 0;
+		Value(count);
+		if (!m_Ok || count > (m_Size - m_Offset) / sizeof(T)) {
+			m_Ok = false;
+			return;
+		}
+		values.resize(size_t(count));
+		memcpy(values.data(), m_Data + m_Offset, size_t(count) * sizeof(T));
+		m_Offset += size_t(count) * sizeof(T);
+	}
+};
+
+static void upload_ssbo(GLuint& id, GLuint binding, const void* data, GLsizeiptr bytes) {
+	if (id == 0)
+		glGenBuffers(1, &id);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+	// Empty buffers are still bound so the shader never reads from an unbound binding
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bytes > 0 ? bytes : 16, bytes > 0 ? data : nullptr, GL_STATIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, id);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Indices stored as floats are rounded like the shaders do, NaN fails
+static bool float_index(float value, size_t count) {
+	return value > -0.5f && value + 0.5f < float(count);
+}
+
+// A range of m_CellPrims, spheres first and then cubes like the primitive table
+static bool valid_cell(const glm::ivec4& cell, const Scene& scene) {
+	const std::vector<int>& prims = scene.m_Grid.m_CellPrims;
+	if (cell.x < 0 || cell.y < 0 || cell.z < 0 || int64_t(cell.x) + cell.y + cell.z > int64_t(prims.size()))
+		return false;
+
+	for (int i = 0; i < cell.y + cell.z; i++) {
+		int prim = prims[cell.x + i];
+		if (prim < 0 || prim >= scene.BoundedCount())
+			return false;
+		if (scene.m_Hittables[prim].type != (i < cell.y ? HITTABLE_SPHERE : HITTABLE_CUBE))
+			return false;
+	}
+	return true;
+}
+
+// Every index the tracers follow without checking is in range, so a scene of another build or a
+// corrupt stream is rejected instead of read out of bounds
+static bool valid_scene(const Scene& scene, const std::vector<GPUMaterial>& materials) {
+
+	// Primitive table grouped by type, see BuildPrimitiveTable()
+	if (scene.m_Hittables.size() != scene.m_Spheres.size() + scene.m_Cubes.size() + scene.m_Planes.size())
+		return false;
+	for (int i = 0; i < (int)scene.m_Hittables.size(); i++) {
+		const GPUHittable& h = scene.m_Hittables[i];
+		Hittable_Type type = i < scene.TypeOffset(HITTABLE_CUBE) ? HITTABLE_SPHERE
+			: i < scene.TypeOffset(HITTABLE_PLANE) ? HITTABLE_CUBE : HITTABLE_PLANE;
+		if (h.type != type || h.index < 0 || h.index >= scene.TypeCount(type))
+			return false;
+		if (h.light < -1 || h.light >= (int)scene.m_Lights.size())
+			return false;
+	}
+
+	for (const GPUSphere& sphere : scene.m_Spheres)
+		if (!float_index(sphere.color_matId.w, materials.size()))
+			return false;
+	for (const GPUCube& cube : scene.m_Cubes)
+		if (!float_index(cube.max_matId.w, materials.size()))
+			return false;
+	for (const GPUPlane& plane : scene.m_Planes)
+		if (!float_index(plane.color_matId.w, materials.size()))
+			return false;
+	for (const GPUMaterial& mat : materials)
+		if (!float_index(mat.type_ref_pad.x, EMISSIVE + 1))
+			return false;
+
+	// Lights and the tree over them. Children come after their parent so every descent ends.
+	const std::vector<GPULightNode>& nodes = scene.m_LightTree.m_Nodes;
+	if (scene.m_LightTree.m_Trails.size() != scene.m_Lights.size() || (nodes.empty() && !scene.m_Lights.empty()))
+		return false;
+	for (const GPULight& light : scene.m_Lights)
+		if (!float_index(light.emission_primId.w, scene.BoundedCount()))
+			return false;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		float child = nodes[i].max_child.w;
+		if (child >= 0.f) {
+			if (!float_index(child, nodes.size() - 1) || int(child + 0.5f) <= int(i))
+				return false;
+		}
+		else if (!float_index(-child - 1.f, scene.m_Lights.size()))
+			return false;
+	}
+
+	const UniformGrid& grid = scene.m_Grid;
+	if (!grid.m_Cells.empty()) {
+		glm::ivec3 res = grid.m_Resolution;
+		if (glm::any(glm::lessThan(res, glm::ivec3(1))) || glm::any(glm::greaterThan(res, glm::ivec3(UniformGrid::MAX_RESOLUTION))))
+			return false;
+		if (size_t(res.x) * res.y * res.z != grid.m_Cells.size())
+			return false;
+	}
+	if (!valid_cell(grid.m_Escape, scene))
+		return false;
+	for (const glm::ivec4& cell : grid.m_Cells)
+		if (!valid_cell(cell, scene))
+			return false;
+	return true;
+}
+
+void Scene::AddSphere(Sphere& sphere)
+{
+	m_Spheres.push_back(sphere.GetGPUSphere());
+}
+
+void Scene::AddCube(Cube& cube)
+{
+	m_Cubes.push_back(cube.GetGPUCube());
+}
+
+void Scene::AddPlane(Plane& plane)
+{
+	m_Planes.push_back(plane.GetGPUPlane());
+}
+
+int Scene::ConvertLargeSpheres()
+{
+	int converted = 0;
+
+	// One sphere per pass, the rest of the scene is measured without it
+	while (!m_Spheres.empty()) {
+
+		int largest = 0;
+		for (int i = 1; i < (int)m_Spheres.size(); i++)
+			if (m_Spheres[i].center_radius.w > m_Spheres[largest].center_radius.w)
+				largest = i;
+
+		AABB rest;
+		for (int i = 0; i < (int)m_Spheres.size(); i++) {
+			if (i == largest)
+				continue;
+			const glm::vec4& cr = m_Spheres[i].center_radius;
+			rest.Expand(AABB(glm::vec3(cr) - glm::vec3(cr.w), glm::vec3(cr) + glm::vec3(cr.w)));
+		}
+		for (const GPUCube& cube : m_Cubes)
+			rest.Expand(AABB(glm::vec3(cube.min_pad), glm::vec3(cube.max_matId)));
+
+		if (rest.IsEmpty())
+			break;
+
+		// The scene has to sit outside the sphere, a huge sphere around it is left alone
+		const GPUSphere sphere = m_Spheres[largest];
+		glm::vec3 center = glm::vec3(sphere.center_radius);
+		float radius = sphere.center_radius.w;
+		glm::vec3 to_scene = rest.Center() - center;
+		if (radius < PLANE_RADIUS_FACTOR * rest.MaxExtent() || glm::length(to_scene) <= radius)
+			break;
+
+		// Tangent plane at the point of the sphere closest to the scene
+		glm::vec3 normal = glm::normalize(to_scene);
+		Plane plane(center + normal * radius, normal, glm::vec3(sphere.color_matId));
+		plane.m_MatId = sphere.color_matId.w;
+		AddPlane(plane);
+
+		m_Spheres.erase(m_Spheres.begin() + largest);
+		converted++;
+	}
+
+	return converted;
+}
+
+void Scene::BuildPrimitiveTable()
+{
+	Touch();
+	m_Hittables.clear();
+	m_Hittables.reserve(m_Spheres.size() + m_Cubes.size() + m_Planes.size());
+
+	for (int i = 0; i < (int)m_Spheres.size(); i++)
+		m_Hittables.push_back({ HITTABLE_SPHERE, i, -1, 0 });
+
+	for (int i = 0; i < (int)m_Cubes.size(); i++)
+		m_Hittables.push_back({ HITTABLE_CUBE, i, -1, 0 });
+
+	for (int i = 0; i < (int)m_Planes.size(); i++)
+		m_Hittables.push_back({ HITTABLE_PLANE, i, -1, 0 });
+}
+
+void Scene::Build()
+{
+	ConvertLargeSpheres();
+	BuildPrimitiveTable();
+	BuildLightList();
+	BuildAcceleration(ChooseAcceleration());
+}
+
+void Scene::BuildLightList()
+{
+	Touch();
+	m_Lights.clear();
+	std::vector<LightTree::LightBounds> bounds;
+
+	// Planes are unbounded and cannot be sampled, they stay out of the list
+	for (int i = 0; i < BoundedCount(); i++) {
+		const GPUMaterial& mat = Material::gpuMats[PrimitiveMaterial(i)];
+		m_Hittables[i].light = -1;
+		if (int(mat.type_ref_pad.x + 0.5f) != EMISSIVE)
+			continue;
+
+		glm::vec3 radiance = glm::vec3(mat.albedo_fuzz) * mat.type_ref_pad.z;
+		m_Hittables[i].light = (int)m_Lights.size();
+		m_Lights.push_back({ glm::vec4(radiance, float(i)), glm::uvec4(0) });
+
+		// Power of a diffuse emitter is pi x area x radiance, luminance weighted
+		LightTree::LightBounds light;
+		light.m_Bounds = PrimitiveBounds(i);
+		float area;
+		if (m_Hittables[i].type == HITTABLE_SPHERE) {
+			float radius = m_Spheres[m_Hittables[i].index].center_radius.w;
+			area = 4.f * float(PI) * radius * radius;
+		}
+		else {
+			glm::vec3 e = light.m_Bounds.Extent();
+			area = 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+		}
+		float luminance = glm::dot(radiance, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+		light.m_Power = float(PI) * area * luminance;
+		bounds.push_back(light);
+	}
+
+	m_LightTree.Build(bounds);
+	for (size_t i = 0; i < m_Lights.size(); i++)
+		m_Lights[i].trail_pad.x = m_LightTree.m_Trails[i];
+}
+
+int Scene::PrimitiveMaterial(int prim_id) const
+{
+	const GPUHittable& h = m_Hittables[prim_id];
+	if (h.type == HITTABLE_SPHERE)
+		return int(m_Spheres[h.index].color_matId.w + 0.5f);
+	if (h.type == HITTABLE_CUBE)
+		return int(m_Cubes[h.index].max_matId.w + 0.5f);
+	return int(m_Planes[h.index].color_matId.w + 0.5f);
+}
+
+Accel_Type Scene::ChooseAcceleration() const
+{
+	int count = BoundedCount();
+	if (count < GRID_MIN_PRIMITIVES)
+		return ACCEL_LINEAR;
+
+	std::vector<float> extents(count);
+	for (int i = 0; i < count; i++)
+		extents[i] = PrimitiveBounds(i).MaxExtent();
+	std::sort(extents.begin(), extents.end());
+
+	// Spread of the primitives that would stay in the grid (escaped ones are tested apart)
+	float median = extents[count / 2];
+	float largest = median;
+	for (float e : extents)
+		if (e <= UniformGrid::ESCAPE_FACTOR * median)
+			largest = e;
+
+	// Scenes with widely varying sizes are left to the linear walk, there is no BVH yet
+	if (median <= 0.f || largest / median > GRID_MAX_SIZE_SPREAD)
+		return ACCEL_LINEAR;
+
+	return ACCEL_GRID;
+}
+
+void Scene::BuildAcceleration(Accel_Type type)
+{
+	Touch();
+	m_AccelType = type;
+
+	if (type == ACCEL_GRID) {
+		// Planes are tested on their own, only the bounded prefix is binned
+		std::vector<AABB> bounds(BoundedCount());
+		for (int i = 0; i < (int)bounds.size(); i++)
+			bounds[i] = PrimitiveBounds(i);
+		m_Grid.Build(bounds, m_Hittables);
+	}
+	else {
+		m_Grid = UniformGrid();
+	}
+}
+
+AABB Scene::PrimitiveBounds(int prim_id) const
+{
+	const GPUHittable& h = m_Hittables[prim_id];
+	if (h.type == HITTABLE_SPHERE) {
+		const glm::vec4& cr = m_Spheres[h.index].center_radius;
+		return AABB(glm::vec3(cr) - glm::vec3(cr.w), glm::vec3(cr) + glm::vec3(cr.w));
+	}
+
+	const GPUCube& cube = m_Cubes[h.index];
+	return AABB(glm::vec3(cube.min_pad), glm::vec3(cube.max_matId));
+}
+
+int Scene::TypeOffset(Hittable_Type type) const
+{
+	if (type == HITTABLE_SPHERE)
+		return 0;
+	if (type == HITTABLE_CUBE)
+		return (int)m_Spheres.size();
+	return (int)(m_Spheres.size() + m_Cubes.size());
+}
+
+int Scene::TypeCount(Hittable_Type type) const
+{
+	if (type == HITTABLE_SPHERE)
+		return (int)m_Spheres.size();
+	if (type == HITTABLE_CUBE)
+		return (int)m_Cubes.size();
+	return (int)m_Planes.size();
+}
+
+int Scene::BoundedCount() const
+{
+	return (int)(m_Spheres.size() + m_Cubes.size());
+}
+
+void Scene::Upload(GLuint program_id)
+{
+	glUseProgram(program_id);
+	upload_ssbo(m_SsboSpheres, SPHERES_BINDING, m_Spheres.data(), m_Spheres.size() * sizeof(GPUSphere));
+	upload_ssbo(m_SsboMats, MATERIALS_BINDING, Material::gpuMats.data(), Material::gpuMats.size() * sizeof(GPUMaterial));
+	upload_ssbo(m_SsboCubes, CUBES_BINDING, m_Cubes.data(), m_Cubes.size() * sizeof(GPUCube));
+	upload_ssbo(m_SsboPlanes, PLANES_BINDING, m_Planes.data(), m_Planes.size() * sizeof(GPUPlane));
+	upload_ssbo(m_SsboLights, LIGHTS_BINDING, m_Lights.data(), m_Lights.size() * sizeof(GPULight));
+	upload_ssbo(m_SsboLightNodes, LIGHT_NODES_BINDING, m_LightTree.m_Nodes.data(), m_LightTree.m_Nodes.size() * sizeof(GPULightNode));
+	upload_ssbo(m_SsboHittables, HITTABLES_BINDING, m_Hittables.data(), m_Hittables.size() * sizeof(GPUHittable));
+	upload_ssbo(m_SsboCells, CELLS_BINDING, m_Grid.m_Cells.data(), m_Grid.m_Cells.size() * sizeof(glm::ivec4));
+	upload_ssbo(m_SsboCellPrims, CELL_PRIMS_BINDING, m_Grid.m_CellPrims.data(), m_Grid.m_CellPrims.size() * sizeof(int));
+
+	SetUniforms(program_id);
+}
+
+void Scene::SetUniforms(GLuint program_id) const
+{
+	glUseProgram(program_id);
+	glUniform1i(glGetUniformLocation(program_id, "uSphereCount"), TypeCount(HITTABLE_SPHERE));
+	glUniform1i(glGetUniformLocation(program_id, "uCubeCount"), TypeCount(HITTABLE_CUBE));
+	glUniform1i(glGetUniformLocation(program_id, "uPlaneCount"), TypeCount(HITTABLE_PLANE));
+	glUniform1i(glGetUniformLocation(program_id, "uMaterialsCount"), (int)Material::gpuMats.size());
+	glUniform1i(glGetUniformLocation(program_id, "uLightCount"), (int)m_Lights.size());
+	glUniform1i(glGetUniformLocation(program_id, "uLightSampling"), m_LightSampling);
+	glUniform1f(glGetUniformLocation(program_id, "uSkyIntensity"), m_SkyIntensity);
+	glUniform1i(glGetUniformLocation(program_id, "uUniformSky"), m_UniformSky);
+
+	glUniform1i(glGetUniformLocation(program_id, "uAccel"), m_AccelType);
+	glUniform3fv(glGetUniformLocation(program_id, "uGridMin"), 1, &m_Grid.m_Bounds.m_Min[0]);
+	glUniform3fv(glGetUniformLocation(program_id, "uGridMax"), 1, &m_Grid.m_Bounds.m_Max[0]);
+	glUniform3iv(glGetUniformLocation(program_id, "uGridRes"), 1, &m_Grid.m_Resolution[0]);
+	glUniform4iv(glGetUniformLocation(program_id, "uGridEscape"), 1, &m_Grid.m_Escape[0]);
+}
+
+unsigned int Scene::MaterialMask() const
+{
+	unsigned int mask = 0;
+	for (int i = 0; i < (int)m_Hittables.size(); i++)
+		mask |= 1u << int(Material::gpuMats[PrimitiveMaterial(i)].type_ref_pad.x + 0.5f);
+	return mask;
+}
+
+unsigned int Scene::PrimitiveMask() const
+{
+	unsigned int mask = 0;
+	for (Hittable_Type type : { HITTABLE_SPHERE, HITTABLE_CUBE, HITTABLE_PLANE })
+		if (TypeCount(type) > 0)
+			mask |= 1u << type;
+	return mask;
+}
+
+void Scene::Serialize(std::vector<unsigned char>& out) const
+{
+	out.clear();
+	write_value(out, SCENE_MAGIC);
+	write_value(out, SCENE_VERSION);
+
+	write_array(out, m_Spheres);
+	write_array(out, m_Cubes);
+	write_array(out, m_Planes);
+	write_array(out, m_Hittables);
+	write_array(out, Material::gpuMats);
+
+	write_array(out, m_Lights);
+	write_array(out, m_LightTree.m_Nodes);
+	write_array(out, m_LightTree.m_Trails);
+	write_value(out, int32_t(m_LightSampling));
+	write_value(out, m_SkyIntensity);
+	write_value(out, uint8_t(m_UniformSky));
+
+	write_value(out, int32_t(m_AccelType));
+	write_value(out, m_Grid.m_Bounds);
+	write_value(out, m_Grid.m_Resolution);
+	write_value(out, m_Grid.m_Escape);
+	write_array(out, m_Grid.m_Cells);
+	write_array(out, m_Grid.m_CellPrims);
+}
+
+bool Scene::Deserialize(const unsigned char* data, size_t size)
+{
+	SceneReader reader = { data, size };
+	uint32_t magic = 0, version = 0;
+	reader.Value(magic);
+	reader.Value(version);
+	if (!reader.m_Ok || magic != SCENE_MAGIC || version != SCENE_VERSION)
+		return false;
+
+	// Read into a copy so a truncated scene leaves this one untouched
+	Scene scene;
+	std::vector<GPUMaterial> materials;
+	int32_t light_sampling = 0, accel = 0;
+	uint8_t uniform_sky = 0;
+
+	reader.Array(scene.m_Spheres);
+	reader.Array(scene.m_Cubes);
+	reader.Array(scene.m_Planes);
+	reader.Array(scene.m_Hittables);
+	reader.Array(materials);
+
+	reader.Array(scene.m_Lights);
+	reader.Array(scene.m_LightTree.m_Nodes);
+	reader.Array(scene.m_LightTree.m_Trails);
+	reader.Value(light_sampling);
+	reader.Value(scene.m_SkyIntensity);
+	reader.Value(uniform_sky);
+
+	reader.Value(accel);
+	reader.Value(scene.m_Grid.m_Bounds);
+	reader.Value(scene.m_Grid.m_Resolution);
+	reader.Value(scene.m_Grid.m_Escape);
+	reader.Array(scene.m_Grid.m_Cells);
+	reader.Array(scene.m_Grid.m_CellPrims);
+	if (!reader.m_Ok)
+		return false;
+
+	if (light_sampling != LIGHT_SAMPLING_UNIFORM && light_sampling != LIGHT_SAMPLING_TREE)
+		return false;
+	if (accel != ACCEL_LINEAR && accel != ACCEL_GRID)
+		return false;
+	if (!valid_scene(scene, materials))
+		return false;
+
+	m_Spheres.swap(scene.m_Spheres);
+	m_Cubes.swap(scene.m_Cubes);
+	m_Planes.swap(scene.m_Planes);
+	m_Hittables.swap(scene.m_Hittables);
+	m_Lights.swap(scene.m_Lights);
+	m_LightTree = scene.m_LightTree;
+	m_LightSampling = Light_Sampling(light_sampling);
+	m_SkyIntensity = scene.m_SkyIntensity;
+	m_UniformSky = uniform_sky != 0;
+	m_AccelType = Accel_Type(accel);
+	m_Grid = scene.m_Grid;
+	Material::gpuMats.swap(materials);
+	Touch();
+	return true;
+}
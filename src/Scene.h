@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include <glad/glad.h>
+
+#include "Hittable.h"
+#include "Material.h"
+#include "Sphere.h"
+#include "Cube.h"
+#include "Plane.h"
+#include "AABB.h"
+#include "Grid.h"
+#include "LightTree.h"
+
+// Acceleration structure used by hit_scene(), must match the ACCEL_* constants in scene.glsl_h
+enum Accel_Type {
+	ACCEL_LINEAR,	// 0, test every primitive
+	ACCEL_GRID,		// 1, uniform grid + escape list
+};
+
+struct GPULight {                 // 32 bytes
+	glm::vec4 emission_primId;    // rgb = emitted radiance, w = primitive table index (as float)
+	glm::uvec4 trail_pad;         // x = light tree path from the root, bit i set = right child at depth i
+};
+
+// CPU side copy of everything the compute shader reads. The vectors use the exact
+// std430 layouts of buffers.glsl_h so the GPU and the CPU tracer see the same data.
+class Scene {
+
+public:
+	std::vector<GPUSphere>   m_Spheres;
+	std::vector<GPUCube>     m_Cubes;
+	std::vector<GPUPlane>    m_Planes;
+
+	// Primitive table, grouped by type: all spheres first, then all cubes, then all planes.
+	// Only the bounded prefix (spheres and cubes) goes into the acceleration structure.
+	std::vector<GPUHittable> m_Hittables;
+
+	// Emissive spheres and cubes, the lights sampled by next event estimation
+	std::vector<GPULight>    m_Lights;
+
+	// Hierarchy over m_Lights, used when m_LightSampling is LIGHT_SAMPLING_TREE
+	LightTree      m_LightTree;
+	Light_Sampling m_LightSampling = LIGHT_SAMPLING_TREE;
+
+	// Scale of the sky gradient, lowered for scenes lit by their emitters
+	float m_SkyIntensity = 1.f;
+	// Constant white sky instead of the gradient, used by the furnace tests
+	bool m_UniformSky = false;
+
+	Accel_Type  m_AccelType = ACCEL_LINEAR;
+	UniformGrid m_Grid;
+
+	void AddSphere(Sphere& sphere);
+	void AddCube(Cube& cube);
+	void AddPlane(Plane& plane);
+
+	// Replaces spheres whose radius dwarfs the rest of the scene (ground spheres) with
+	// the plane tangent to them, returns the number of spheres converted
+	int ConvertLargeSpheres();
+
+	// Converts large spheres, then builds the primitive table, the light list and the acceleration structure picked by ChooseAcceleration()
+	void Build();
+
+	// Rebuilds m_Hittables so primitives of the same type are contiguous
+	void BuildPrimitiveTable();
+
+	// Collects the bounded primitives with an emissive material and builds the light tree
+	void BuildLightList();
+
+	// Material index of primitive table entry prim_id
+	int PrimitiveMaterial(int prim_id) const;
+
+	// Picks the structure that suits the scene from primitive count and size spread
+	Accel_Type ChooseAcceleration() const;
+	void BuildAcceleration(Accel_Type type);
+
+	// First entry of each type in the primitive table
+	int TypeOffset(Hittable_Type type) const;
+	int TypeCount(Hittable_Type type) const;
+
+	// Primitives with finite bounds, the first entries of the primitive table
+	int BoundedCount() const;
+
+	// Bounds of primitive table entry prim_id, only valid below BoundedCount()
+	AABB PrimitiveBounds(int prim_id) const;
+
+	// Uploads all SSBOs and sets the count uniforms of the given program
+	void Upload(GLuint program_id);
+
+	// Sets the scene uniforms only, for programs that share the uploaded buffers
+	void SetUniforms(GLuint program_id) const;
+
+	// Binary scene format: the packed buffers, the acceleration structure, the light tree and
+	// Material::gpuMats in native byte order, so a loaded scene is traced without building anything
+	void Serialize(std::vector<unsigned char>& out) const;
+
+	// Replaces the scene and Material::gpuMats, false when data is not a complete scene of this
+	// version or any of its indices is out of range
+	bool Deserialize(const unsigned char* data, size_t size);
+
+	// Bit 1 << Material_Type of every material used by a primitive, VARIANT_MATERIALS
+	unsigned int MaterialMask() const;
+
+	// Bit 1 << Hittable_Type of every primitive type present, VARIANT_PRIMITIVES
+	unsigned int PrimitiveMask() const;
+
+	// Bumped by the Build functions and Deserialize(), copies of the scene (the sphere blocks and
+	// node replicas of CPUTracer) are refreshed when it changes. Call Touch() after editing the
+	// buffers or Material::gpuMats in place.
+	unsigned int Generation() const { return m_Generation; }
+	void Touch() { m_Generation++; }
+
+private:
+	unsigned int m_Generation = 0;
+
+	GLuint m_SsboSpheres = 0;
+	GLuint m_SsboMats = 0;
+	GLuint m_SsboCubes = 0;
+	GLuint m_SsboHittables = 0;
+	GLuint m_SsboCells = 0;
+	GLuint m_SsboCellPrims = 0;
+	GLuint m_SsboPlanes = 0;
+	GLuint m_SsboLights = 0;
+	GLuint m_SsboLightNodes = 0;
+};
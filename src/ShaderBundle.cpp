@@ -0,0 +1,80 @@
+#include "ShaderBundle.h"
+
+#include <cstring>
+#include <iostream>
+
+// Written by the pre-build step, a build without it runs from the shader files on disk
+#if defined(__has_include)
+#if __has_include("ShaderBundle.inl")
+#include "ShaderBundle.inl"
+#define HAS_SHADER_BUNDLE
+#endif
+#endif
+
+// Decoder for compress() in tools/bundle_shaders.py
+static bool decompress(const unsigned char* data, size_t size, std::string& out) {
+    size_t i = 0;
+    while (i < size) {
+        unsigned char tag = data[i++];
+        if (tag < 0x80) {
+            size_t count = size_t(tag) + 1;
+            if (i + count > size)
+                return false;
+            out.append((const char*)data + i, count);
+            i += count;
+        }
+        else {
+            if (i + 2 > size)
+                return false;
+            size_t length = size_t(tag) - 0x80 + 4;
+            size_t distance = data[i] | (size_t(data[i + 1]) << 8);
+            i += 2;
+            if (distance == 0 || distance > out.size())
+                return false;
+
+            // Byte by byte, a match may overlap the bytes it produces
+            size_t from = out.size() - distance;
+            for (size_t k = 0; k < length; k++)
+                out.push_back(out[from + k]);
+        }
+    }
+    return true;
+}
+
+uint64_t shaderHash(const std::string& text)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool loadBundledShader(const char* path, std::string& source)
+{
+#ifdef HAS_SHADER_BUNDLE
+    for (const BundledShader& shader : bundled_shaders) {
+        if (strcmp(shader.path, path) != 0)
+            continue;
+
+        source.clear();
+        source.reserve(shader.size);
+        if (!decompress(shader.data, shader.compressedSize, source) || source.size() != shader.size || shaderHash(source) != shader.hash) {
+            std::cerr << "ERROR: Corrupt bundled shader " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+#endif
+    return false;
+}
+
+int bundledShaderCount()
+{
+#ifdef HAS_SHADER_BUNDLE
+    return int(sizeof(bundled_shaders) / sizeof(bundled_shaders[0]));
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shader programs with their includes resolved at build time by tools/bundle_shaders.py,
+// compressed and compiled into the executable. Loading from the bundle needs no file I/O
+// and no GL_ARB_shading_language_include.
+struct BundledShader {
+    const char* path;           // as passed to Shader, e.g. "shaders/source/comp.glsl"
+    uint64_t hash;              // FNV-1a of the resolved source
+    size_t size;                // resolved source length
+    const unsigned char* data;  // compressed source
+    size_t compressedSize;
+};
+
+// Resolved source of the bundled program at path. False when the executable was built
+// without a bundle, the path is not in it, or the data does not match its hash.
+bool loadBundledShader(const char* path, std::string& source);
+
+// 64 bit FNV-1a, the hash the bundle stores
+uint64_t shaderHash(const std::string& text);
+
+// Number of programs in the bundle, 0 when there is none
+int bundledShaderCount();
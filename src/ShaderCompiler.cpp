@@ -0,0 +1,169 @@
+#include "ShaderCompiler.h"
+
+#include <cstdio>
+
+// glMaxShaderCompilerThreadsKHR, not part of the glad loader
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+static const GLuint ALL_COMPILER_THREADS = 0xFFFFFFFF;
+
+ShaderCompiler::~ShaderCompiler()
+{
+	Shutdown();
+}
+
+void ShaderCompiler::Init(GLFWwindow* window)
+{
+	// Drivers may expose parallel compile and still link on the calling thread, so a
+	// worker context is preferred. Invisible window, only its context is used.
+	if (m_AllowThread) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		m_WorkerWindow = glfwCreateWindow(1, 1, "Shader Compiler", nullptr, window);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+		if (m_WorkerWindow) {
+			m_Mode = COMPILE_THREAD;
+			m_Worker = std::thread(&ShaderCompiler::WorkerLoop, this);
+			return;
+		}
+	}
+
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_threads = nullptr;
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+		max_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+	else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+		max_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+
+	if (max_threads) {
+		max_threads(ALL_COMPILER_THREADS);
+		Shader::parallelCompile = true;
+		m_Mode = COMPILE_PARALLEL;
+	}
+	else
+		m_Mode = COMPILE_BLOCKING;
+}
+
+void ShaderCompiler::Shutdown()
+{
+	if (m_Worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_Wake.notify_one();
+		m_Worker.join();
+	}
+
+	if (m_WorkerWindow) {
+		glfwDestroyWindow(m_WorkerWindow);
+		m_WorkerWindow = nullptr;
+	}
+
+	for (Build& build : m_Done)
+		m_InFlight.push_back(build);
+	m_Done.clear();
+	m_Jobs.clear();
+
+	for (Build& build : m_InFlight) {
+		if (build.m_Fence)
+			glDeleteSync(build.m_Fence);
+		glDeleteProgram(build.m_Shader.m_ProgramId);
+	}
+	m_InFlight.clear();
+}
+
+int ShaderCompiler::Request(const std::string& path, const std::string& defines)
+{
+	Build build;
+	build.m_Ticket = m_NextTicket++;
+	build.m_Path = path;
+	build.m_Defines = defines;
+	build.m_Start = glfwGetTime();
+
+	if (m_Mode == COMPILE_THREAD) {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Jobs.push_back(build);
+		}
+		m_Wake.notify_one();
+	}
+	else {
+		// Compile and link are only issued here, Take() polls for completion
+		build.m_Shader = Shader::beginCompute(build.m_Path.c_str(), build.m_Defines);
+		m_InFlight.push_back(build);
+	}
+	return build.m_Ticket;
+}
+
+bool ShaderCompiler::Take(int ticket, Result& result)
+{
+	if (m_Mode == COMPILE_THREAD) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_InFlight.insert(m_InFlight.end(), m_Done.begin(), m_Done.end());
+		m_Done.clear();
+	}
+
+	for (size_t i = 0; i < m_InFlight.size(); i++) {
+		Build& build = m_InFlight[i];
+		if (build.m_Ticket != ticket)
+			continue;
+
+		// The program is visible here once the commands of the worker context are done
+		if (build.m_Fence) {
+			GLenum status = glClientWaitSync(build.m_Fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				return false;
+			glDeleteSync(build.m_Fence);
+		}
+		else if (!build.m_Shader.isReady())
+			return false;
+
+		result.m_Shader = build.m_Shader;
+		result.m_Linked = build.m_Shader.isLinked();
+		result.m_Ms = (glfwGetTime() - build.m_Start) * 1000.0;
+		m_InFlight.erase(m_InFlight.begin() + i);
+		return true;
+	}
+	return false;
+}
+
+bool ShaderCompiler::IsBusy()
+{
+	if (m_Mode == COMPILE_THREAD) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Compiling || !m_Jobs.empty();
+	}
+
+	// Polling finishes the builds whose compile has completed, like Take()
+	for (Build& build : m_InFlight)
+		if (!build.m_Shader.isReady())
+			return true;
+	return false;
+}
+
+void ShaderCompiler::WorkerLoop()
+{
+	glfwMakeContextCurrent(m_WorkerWindow);
+
+	while (true) {
+		Build build;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Wake.wait(lock, [this] { return m_Quit || !m_Jobs.empty(); });
+			if (m_Quit)
+				break;
+			build = m_Jobs.front();
+			m_Jobs.pop_front();
+			m_Compiling = true;
+		}
+
+		build.m_Shader = Shader(build.m_Path.c_str(), build.m_Defines);
+		build.m_Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Done.push_back(build);
+		m_Compiling = false;
+	}
+
+	glfwMakeContextCurrent(nullptr);
+}
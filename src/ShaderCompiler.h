@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shader.h"
+
+// How ShaderCompiler keeps builds off the render loop
+enum Compile_Mode {
+	COMPILE_THREAD,		// a worker thread with a shared context compiles synchronously
+	COMPILE_PARALLEL,	// no shared context, GL_KHR_parallel_shader_compile polled on the render thread
+	COMPILE_BLOCKING,	// neither is available, builds finish on the render thread
+};
+
+// Builds compute programs while the render loop keeps drawing with the programs it has.
+// A finished build is handed back by Take() on the render thread and the caller swaps it in,
+// so a variant switch or a reload never stalls a frame on the compiler.
+class ShaderCompiler {
+
+public:
+	struct Result {
+		Shader m_Shader;
+		bool m_Linked = false;
+		double m_Ms = 0.0;		// from Request() to completion
+	};
+
+	~ShaderCompiler();
+
+	// Picks the mode. The worker context is created next to window and shares its objects.
+	void Init(GLFWwindow* window);
+
+	// Stops the worker and deletes unclaimed programs, call before the window is destroyed
+	void Shutdown();
+
+	// Queues a build of the compute shader at path, returns the ticket to Take() it with
+	int Request(const std::string& path, const std::string& defines);
+
+	// True and the program when the build of ticket has completed, call on the render thread
+	bool Take(int ticket, Result& result);
+
+	// True while a build is queued or compiling, the include strings must not change then.
+	// Finished builds waiting for Take() do not count.
+	bool IsBusy();
+
+	Compile_Mode m_Mode = COMPILE_BLOCKING;
+	// False skips the worker context and goes straight to parallel compile polling
+	bool m_AllowThread = true;
+
+private:
+	struct Build {
+		int m_Ticket;
+		std::string m_Path;
+		std::string m_Defines;
+		double m_Start;
+		Shader m_Shader;
+		GLsync m_Fence = nullptr;	// COMPILE_THREAD, signaled once the worker's commands are done
+	};
+
+	void WorkerLoop();
+
+	int m_NextTicket = 0;
+
+	// Builds the render thread is waiting on
+	std::vector<Build> m_InFlight;
+
+	// COMPILE_THREAD state, guarded by m_Mutex
+	GLFWwindow* m_WorkerWindow = nullptr;
+	std::thread m_Worker;
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	std::deque<Build> m_Jobs;
+	std::vector<Build> m_Done;
+	bool m_Compiling = false;
+	bool m_Quit = false;
+};
@@ -0,0 +1,109 @@
+#include "ShaderVariants.h"
+
+#include <cstdio>
+
+uint64_t ShaderVariantKey::Pack() const
+{
+	return uint64_t(m_Samples & 0xFFFF) | uint64_t(m_MaxDepth & 0xFFFF) << 16
+		| uint64_t(m_Materials & 0xFF) << 32 | uint64_t(m_Primitives & 0xFF) << 40;
+}
+
+std::string ShaderVariantKey::Defines() const
+{
+	char defines[256];
+	snprintf(defines, sizeof(defines),
+		"#define VARIANT_SAMPLES %d\n#define VARIANT_MAX_DEPTH %d\n#define VARIANT_MATERIALS %u\n#define VARIANT_PRIMITIVES %u\n",
+		m_Samples, m_MaxDepth, m_Materials, m_Primitives);
+	return defines;
+}
+
+ShaderVariants::ShaderVariants(const char* compute_path, Shader& generic, ShaderCompiler& compiler)
+	: m_ComputePath(compute_path), m_Generic(generic), m_Compiler(compiler)
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	Clear();
+}
+
+void ShaderVariants::Clear()
+{
+	for (Entry& entry : m_Entries)
+		glDeleteProgram(entry.m_Shader.m_ProgramId);
+	m_Entries.clear();
+	m_Lookup.clear();
+
+	// Built from sources that have changed since, or may link now
+	m_Discard = m_Ticket >= 0;
+	m_HasFailed = false;
+}
+
+Shader& ShaderVariants::Select(const ShaderVariantKey& key)
+{
+	uint64_t packed = key.Pack();
+	auto found = m_Lookup.find(packed);
+	if (found != m_Lookup.end()) {
+		m_Entries.splice(m_Entries.begin(), m_Entries, found->second);
+		m_HasPending = false;
+		return found->second->m_Shader;
+	}
+
+	// Already on its way, or known not to link
+	if ((m_Ticket >= 0 && m_Building.Pack() == packed) || (m_HasFailed && m_Failed == packed)) {
+		m_HasPending = false;
+		return m_Generic;
+	}
+
+	// Restart the settle count whenever the request changes
+	if (!m_HasPending || m_Pending.Pack() != packed) {
+		m_Pending = key;
+		m_HasPending = true;
+		m_PendingFrames = 0;
+	}
+	return m_Generic;
+}
+
+void ShaderVariants::Update()
+{
+	// One build at a time, the next request waits for it
+	if (m_Ticket >= 0) {
+		ShaderCompiler::Result result;
+		if (!m_Compiler.Take(m_Ticket, result))
+			return;
+		m_Ticket = -1;
+
+		if (m_Discard) {
+			glDeleteProgram(result.m_Shader.m_ProgramId);
+			m_Discard = false;
+			return;
+		}
+
+		printf("Shader variant spp %d depth %d materials 0x%x primitives 0x%x %s in %.1f ms\n",
+			m_Building.m_Samples, m_Building.m_MaxDepth, m_Building.m_Materials, m_Building.m_Primitives,
+			result.m_Linked ? "ready" : "failed", result.m_Ms);
+
+		if (!result.m_Linked) {
+			glDeleteProgram(result.m_Shader.m_ProgramId);
+			m_Failed = m_Building.Pack();
+			m_HasFailed = true;
+			return;
+		}
+
+		m_Entries.push_front({ m_Building.Pack(), result.m_Shader });
+		m_Lookup[m_Building.Pack()] = m_Entries.begin();
+		while ((int)m_Entries.size() > m_Capacity) {
+			glDeleteProgram(m_Entries.back().m_Shader.m_ProgramId);
+			m_Lookup.erase(m_Entries.back().m_Key);
+			m_Entries.pop_back();
+		}
+		return;
+	}
+
+	if (!m_HasPending || ++m_PendingFrames < m_SettleFrames)
+		return;
+
+	m_Building = m_Pending;
+	m_Ticket = m_Compiler.Request(m_ComputePath, m_Building.Defines());
+	m_HasPending = false;
+}
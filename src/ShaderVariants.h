@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "shader.h"
+#include "ShaderCompiler.h"
+
+// What a specialized compute program is compiled for. SAMPLES and MAX_DEPTH become
+// constants so the sample and bounce loops can be unrolled, and the masks strip the
+// scatter branches and intersection loops of types the scene does not use.
+struct ShaderVariantKey {
+	int m_Samples = 0;
+	int m_MaxDepth = 0;
+	unsigned int m_Materials = 0;	// Scene::MaterialMask()
+	unsigned int m_Primitives = 0;	// Scene::PrimitiveMask()
+
+	// Unique for samples and depth below 65536 and 8 bit masks
+	uint64_t Pack() const;
+
+	// #define lines for Shader(compute_path, defines)
+	std::string Defines() const;
+};
+
+// LRU cache of specialized variants of the path tracing compute shader. Select() hands
+// out the generic program until the requested variant exists. Update() requests one
+// variant at a time from the ShaderCompiler, and only once the key has stopped changing
+// for m_SettleFrames frames, so dragging a slider does not compile every value it passes.
+class ShaderVariants {
+
+public:
+	ShaderVariants(const char* compute_path, Shader& generic, ShaderCompiler& compiler);
+	~ShaderVariants();
+
+	// Program to dispatch this frame for key, the generic one while the variant is missing
+	Shader& Select(const ShaderVariantKey& key);
+
+	// Requests the pending variant once it has settled and caches finished ones, call once per frame
+	void Update();
+
+	// Deletes the cached programs and drops the one being built, call after a reload
+	// and while the context is still current
+	void Clear();
+
+	int Size() const { return (int)m_Entries.size(); }
+	bool IsPending() const { return m_HasPending || m_Ticket >= 0; }
+
+	int m_Capacity = 8;
+	int m_SettleFrames = 10;
+
+private:
+	struct Entry {
+		uint64_t m_Key;
+		Shader m_Shader;
+	};
+
+	std::string m_ComputePath;
+	Shader& m_Generic;
+	ShaderCompiler& m_Compiler;
+
+	// Most recently used first
+	std::list<Entry> m_Entries;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> m_Lookup;
+
+	ShaderVariantKey m_Pending;
+	bool m_HasPending = false;
+	int m_PendingFrames = 0;
+
+	// Variant the compiler is working on, m_Ticket is -1 when idle
+	ShaderVariantKey m_Building;
+	int m_Ticket = -1;
+	bool m_Discard = false;		// Clear() came while m_Ticket was building
+	uint64_t m_Failed = 0;		// last key that did not link, not requested again
+	bool m_HasFailed = false;
+};
@@ -0,0 +1,160 @@
+#include "ShaderWatcher.h"
+#include "shader.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Name between the quotes of an #include line, empty for any other line
+static std::string includeName(const std::string& line)
+{
+	size_t start = line.find_first_not_of(" \t");
+	if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+		return "";
+
+	size_t open = line.find('"', start + 8);
+	size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+	if (close == std::string::npos)
+		return "";
+	return line.substr(open + 1, close - open - 1);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+#ifdef __linux__
+	if (m_Fd >= 0)
+		close(m_Fd);
+#endif
+}
+
+bool ShaderWatcher::Init(const std::vector<std::string>& programs, const std::vector<std::string>& directories)
+{
+	m_Programs = programs;
+	for (const std::string& program : m_Programs)
+		Scan(program);
+
+#ifdef __linux__
+	m_Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_Fd < 0) {
+		perror("ShaderWatcher: inotify_init1");
+		return false;
+	}
+
+	// Editors either rewrite the file or replace it by renaming a temporary over it
+	for (const std::string& directory : directories) {
+		int wd = inotify_add_watch(m_Fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd < 0) {
+			fprintf(stderr, "ShaderWatcher: cannot watch %s\n", directory.c_str());
+			return false;
+		}
+		m_Directories[wd] = directory;
+	}
+#else
+	(void)directories;
+	m_LastCheck = std::chrono::steady_clock::now();
+#endif
+	return true;
+}
+
+const std::set<std::string>& ShaderWatcher::Dependencies(const std::string& program) const
+{
+	return m_Dependencies.at(program);
+}
+
+void ShaderWatcher::Scan(const std::string& program)
+{
+	std::set<std::string>& files = m_Dependencies[program];
+	files.clear();
+	AddDependencies(program, files);
+
+#ifndef __linux__
+	for (const std::string& file : files) {
+		struct stat info;
+		if (m_Times.find(file) == m_Times.end() && stat(file.c_str(), &info) == 0)
+			m_Times[file] = (long long)info.st_mtime;
+	}
+#endif
+}
+
+void ShaderWatcher::AddDependencies(const std::string& path, std::set<std::string>& files) const
+{
+	// Visited files are not read again, include guards and cycles end here
+	if (!files.insert(path).second)
+		return;
+
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line)) {
+		std::string name = includeName(line);
+		if (name.empty())
+			continue;
+
+		std::string include = includeFilePath(name);
+		if (include.empty())
+			fprintf(stderr, "ShaderWatcher: %s includes unregistered %s\n", path.c_str(), name.c_str());
+		else
+			AddDependencies(include, files);
+	}
+}
+
+void ShaderWatcher::CollectChanges()
+{
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[4096];
+	while (true) {
+		ssize_t length = read(m_Fd, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+
+		for (ssize_t offset = 0; offset < length;) {
+			const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+			auto directory = m_Directories.find(event->wd);
+			if (event->len > 0 && directory != m_Directories.end())
+				m_Changed.insert(directory->second + "/" + event->name);
+			offset += sizeof(struct inotify_event) + event->len;
+		}
+	}
+#else
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (std::chrono::duration<double>(now - m_LastCheck).count() < m_PollSeconds)
+		return;
+	m_LastCheck = now;
+
+	for (auto& entry : m_Times) {
+		struct stat info;
+		if (stat(entry.first.c_str(), &info) != 0 || (long long)info.st_mtime == entry.second)
+			continue;
+		entry.second = (long long)info.st_mtime;
+		m_Changed.insert(entry.first);
+	}
+#endif
+}
+
+std::vector<std::string> ShaderWatcher::Poll()
+{
+	CollectChanges();
+
+	std::vector<std::string> affected;
+	if (m_Changed.empty())
+		return affected;
+
+	for (const std::string& program : m_Programs) {
+		for (const std::string& file : m_Dependencies[program]) {
+			if (m_Changed.count(file)) {
+				affected.push_back(program);
+				break;
+			}
+		}
+	}
+	m_Changed.clear();
+
+	// An edit can add or remove #include lines
+	for (const std::string& program : affected)
+		Scan(program);
+	return affected;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Watches the shader sources on disk and reports the programs an edit affects. A program
+// depends on its own file and every file its #include lines reach, so editing an include
+// only rebuilds the programs that use it. Uses inotify on Linux and polls modification
+// times elsewhere.
+class ShaderWatcher {
+
+public:
+	~ShaderWatcher();
+
+	// Watches directories and builds the include graph of each program path
+	bool Init(const std::vector<std::string>& programs, const std::vector<std::string>& directories);
+
+	// Programs affected by edits since the last call, each once, call once per frame
+	std::vector<std::string> Poll();
+
+	// Files the program depends on, its own path included
+	const std::set<std::string>& Dependencies(const std::string& program) const;
+
+	// Modification time polling interval when inotify is not available
+	double m_PollSeconds = 0.5;
+
+private:
+	void Scan(const std::string& program);
+	void AddDependencies(const std::string& path, std::set<std::string>& files) const;
+	void CollectChanges();
+
+	std::vector<std::string> m_Programs;
+	std::map<std::string, std::set<std::string>> m_Dependencies;
+
+	// Files written since the last Poll()
+	std::set<std::string> m_Changed;
+
+#ifdef __linux__
+	int m_Fd = -1;
+	std::map<int, std::string> m_Directories;	// watch descriptor -> directory
+#else
+	std::map<std::string, long long> m_Times;	// dependency -> last modification time
+	std::chrono::steady_clock::time_point m_LastCheck;
+#endif
+};
@@ -0,0 +1,271 @@
+#include "Socket.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static void closeHandle(uintptr_t handle) { closesocket(SOCKET(handle)); }
+#else
+static void closeHandle(int handle) { close(handle); }
+#endif
+
+// Winsock needs one call per process before anything else
+static bool startNetwork() {
+#ifdef _WIN32
+	static bool started = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return started;
+#else
+	return true;
+#endif
+}
+
+// "unix:path" fills addr and returns true, anything else is left to TCP
+static bool unixAddress(const std::string& address, sockaddr_un& addr, std::string& path) {
+	if (address.compare(0, 5, "unix:") != 0)
+		return false;
+	path = address.substr(5);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	return true;
+}
+
+// Splits "host:port" at the last colon, nullptr when it does not resolve
+static addrinfo* tcpAddresses(const std::string& address, bool passive) {
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos) {
+		std::cerr << "Socket: address " << address << " has no port\n";
+		return nullptr;
+	}
+	std::string host = address.substr(0, colon);
+	std::string port = address.substr(colon + 1);
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0) {
+		std::cerr << "Socket: cannot resolve " << address << "\n";
+		return nullptr;
+	}
+	return result;
+}
+
+Socket::~Socket()
+{
+	Close();
+}
+
+Socket::Socket(Socket&& other) : m_Handle(other.m_Handle), m_UnixPath(std::move(other.m_UnixPath))
+{
+	other.m_Handle = INVALID_HANDLE;
+	other.m_UnixPath.clear();
+}
+
+Socket& Socket::operator=(Socket&& other)
+{
+	if (this != &other) {
+		Close();
+		m_Handle = other.m_Handle;
+		m_UnixPath = std::move(other.m_UnixPath);
+		other.m_Handle = INVALID_HANDLE;
+		other.m_UnixPath.clear();
+	}
+	return *this;
+}
+
+void Socket::Close()
+{
+	if (m_Handle != INVALID_HANDLE)
+		closeHandle(m_Handle);
+	m_Handle = INVALID_HANDLE;
+
+	if (!m_UnixPath.empty())
+		remove(m_UnixPath.c_str());
+	m_UnixPath.clear();
+}
+
+bool Socket::Listen(const std::string& address)
+{
+	Close();
+	if (!startNetwork())
+		return false;
+
+	sockaddr_un unix_addr;
+	std::string path;
+	if (unixAddress(address, unix_addr, path)) {
+		// A socket file left by a process that did not exit cleanly would block the bind
+		remove(path.c_str());
+		m_Handle = Handle(socket(AF_UNIX, SOCK_STREAM, 0));
+		if (m_Handle != INVALID_HANDLE && bind(m_Handle, (const sockaddr*)&unix_addr, sizeof(unix_addr)) == 0
+			&& listen(m_Handle, SOMAXCONN) == 0) {
+			m_UnixPath = path;
+			return true;
+		}
+	}
+	else if (addrinfo* addresses = tcpAddresses(address, true)) {
+		for (addrinfo* a = addresses; a; a = a->ai_next) {
+			m_Handle = Handle(socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+			if (m_Handle == INVALID_HANDLE)
+				continue;
+
+			// Restarted coordinators bind again while the old connections linger
+			int reuse = 1;
+			setsockopt(m_Handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+			if (bind(m_Handle, a->ai_addr, (int)a->ai_addrlen) == 0 && listen(m_Handle, SOMAXCONN) == 0)
+				break;
+			Close();
+		}
+		freeaddrinfo(addresses);
+		if (IsOpen())
+			return true;
+	}
+
+	std::cerr << "Socket: cannot listen on " << address << "\n";
+	Close();
+	return false;
+}
+
+bool Socket::Connect(const std::string& address)
+{
+	Close();
+	if (!startNetwork())
+		return false;
+
+	sockaddr_un unix_addr;
+	std::string path;
+	if (unixAddress(address, unix_addr, path)) {
+		m_Handle = Handle(socket(AF_UNIX, SOCK_STREAM, 0));
+		if (m_Handle != INVALID_HANDLE && connect(m_Handle, (const sockaddr*)&unix_addr, sizeof(unix_addr)) == 0)
+			return true;
+	}
+	else if (addrinfo* addresses = tcpAddresses(address, false)) {
+		for (addrinfo* a = addresses; a; a = a->ai_next) {
+			m_Handle = Handle(socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+			if (m_Handle != INVALID_HANDLE && connect(m_Handle, a->ai_addr, (int)a->ai_addrlen) == 0)
+				break;
+			Close();
+		}
+		freeaddrinfo(addresses);
+
+		// Jobs and results are single messages, waiting to fill a packet only adds latency
+		if (IsOpen()) {
+			int no_delay = 1;
+			setsockopt(m_Handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+			return true;
+		}
+	}
+
+	Close();
+	return false;
+}
+
+Socket Socket::Accept()
+{
+	Socket client;
+	client.m_Handle = Handle(accept(m_Handle, nullptr, nullptr));
+	if (client.m_Handle != INVALID_HANDLE && m_UnixPath.empty()) {
+		int no_delay = 1;
+		setsockopt(client.m_Handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+	}
+	return client;
+}
+
+void Socket::SetTimeout(int timeout_ms)
+{
+#ifdef _WIN32
+	DWORD timeout = DWORD(timeout_ms);
+#else
+	timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+#endif
+	setsockopt(m_Handle, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+bool Socket::Wait(int timeout_ms)
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(m_Handle, &readable);
+	timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+	return select(int(m_Handle + 1), &readable, nullptr, nullptr, &timeout) > 0;
+}
+
+bool Socket::Send(uint32_t type, const void* head, size_t head_size, const void* body, size_t body_size)
+{
+	if (head_size + body_size > MAX_PAYLOAD)
+		return false;
+
+	uint32_t header[2] = { type, uint32_t(head_size + body_size) };
+	return SendAll(header, sizeof(header)) && SendAll(head, head_size) && SendAll(body, body_size);
+}
+
+bool Socket::Receive(uint32_t& type, std::vector<unsigned char>& payload)
+{
+	uint32_t header[2];
+	if (!ReceiveAll(header, sizeof(header)) || header[1] > MAX_PAYLOAD)
+		return false;
+
+	type = header[0];
+	payload.resize(header[1]);
+	return ReceiveAll(payload.data(), payload.size());
+}
+
+bool Socket::SendAll(const void* data, size_t size)
+{
+	// A peer that went away must fail the send instead of raising SIGPIPE
+#ifdef MSG_NOSIGNAL
+	const int flags = MSG_NOSIGNAL;
+#else
+	const int flags = 0;
+#endif
+	const char* bytes = static_cast<const char*>(data);
+	while (size > 0 && IsOpen()) {
+		int chunk = (int)std::min<size_t>(size, 1 << 20);
+		int sent = (int)send(m_Handle, bytes, chunk, flags);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return size == 0;
+}
+
+bool Socket::ReceiveAll(void* data, size_t size)
+{
+	char* bytes = static_cast<char*>(data);
+	while (size > 0 && IsOpen()) {
+		int chunk = (int)std::min<size_t>(size, 1 << 20);
+		int received = (int)recv(m_Handle, bytes, chunk, 0);
+		if (received <= 0)
+			return false;
+		bytes += received;
+		size -= received;
+	}
+	return size == 0;
+}
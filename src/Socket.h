@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Blocking stream socket carrying typed messages: a 32 bit type and a 32 bit payload size,
+// then the payload. Addresses are "host:port" for TCP (an empty host listens on every
+// interface) or "unix:path" for a Unix domain socket.
+class Socket {
+
+public:
+	Socket() = default;
+	~Socket();
+	Socket(Socket&& other);
+	Socket& operator=(Socket&& other);
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	bool Listen(const std::string& address);
+	bool Connect(const std::string& address);
+
+	// Next connection of a listening socket, closed on failure
+	Socket Accept();
+
+	bool IsOpen() const { return m_Handle != INVALID_HANDLE; }
+	void Close();
+
+	// Receives fail after timeout_ms without data, 0 waits forever
+	void SetTimeout(int timeout_ms);
+
+	// True once data or, on a listening socket, a connection is waiting, at most timeout_ms later
+	bool Wait(int timeout_ms);
+
+	// The payload is head followed by body, sent without joining them first
+	bool Send(uint32_t type, const void* head, size_t head_size, const void* body = nullptr, size_t body_size = 0);
+	bool Receive(uint32_t& type, std::vector<unsigned char>& payload);
+
+	// Larger payloads are taken for a broken stream
+	static const uint32_t MAX_PAYLOAD = 1u << 30;
+
+private:
+#ifdef _WIN32
+	using Handle = uintptr_t;
+#else
+	using Handle = int;
+#endif
+	static const Handle INVALID_HANDLE = Handle(-1);
+
+	Handle m_Handle = INVALID_HANDLE;
+	std::string m_UnixPath;		// socket file of a listening Unix socket, removed by Close()
+
+	bool SendAll(const void* data, size_t size);
+	bool ReceiveAll(void* data, size_t size);
+};
@@ -4,6 +4,7 @@ Sphere::Sphere(glm::vec3 pos, glm::vec3 color, float rad) {
     m_Position = pos;
     m_Radius = rad;
     m_Color = color;
+    m_MatId = 0.f;
 
 	// Compute the vertices and indices for the sphere
 	// Could be optimized to only compute once and share among all spheres
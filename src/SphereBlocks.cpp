@@ -0,0 +1,384 @@
+#include "SphereBlocks.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SPHERE_BLOCKS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC compiles any intrinsic without flags, GCC and Clang need the ISA on the function
+#if defined(SPHERE_BLOCKS_X86) && !defined(_MSC_VER)
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+// The ray broadcast to every lane
+struct RayLanes {
+	float ox, oy, oz;
+	float dx, dy, dz;
+	float a;		// dot(direction, direction)
+};
+
+// Closest or, with any_hit, first hit of ray inside (t_min, t_max). Returns the primitive
+// index or -1 and shrinks t_max to the hit. Each kernel tests lanes against the t_max at the
+// start of the chunk and keeps the lowest lane among equal distances, which gives the same
+// hit as walking the spheres in order and shrinking t_max after each one.
+typedef int (*SphereKernel)(const SphereBlock* blocks, int block_count, const RayLanes& ray, float t_min, float& t_max, bool any_hit);
+
+static int hitScalar(const SphereBlock* blocks, int block_count, const RayLanes& ray, float t_min, float& t_max, bool any_hit)
+{
+	int best = -1;
+	for (int b = 0; b < block_count; b++) {
+		const SphereBlock& block = blocks[b];
+		for (int i = 0; i < SphereBlock::WIDTH; i++) {
+
+			// intersectSphere() in sphere.glsl
+			float ocx = block.m_X[i] - ray.ox;
+			float ocy = block.m_Y[i] - ray.oy;
+			float ocz = block.m_Z[i] - ray.oz;
+			float h = ray.dx * ocx + ray.dy * ocy + ray.dz * ocz;
+			float c = ocx * ocx + ocy * ocy + ocz * ocz - block.m_R2[i];
+
+			float discriminant = h * h - ray.a * c;
+			if (discriminant < 0)
+				continue;
+
+			float sqrtd = sqrtf(discriminant);
+			float root = (h - sqrtd) / ray.a;
+			if (!(t_min < root && root < t_max)) {
+				root = (h + sqrtd) / ray.a;
+				if (!(t_min < root && root < t_max))
+					continue;
+			}
+
+			t_max = root;
+			best = block.m_Prim[i];
+			if (any_hit)
+				return best;
+		}
+	}
+	return best;
+}
+
+#ifdef SPHERE_BLOCKS_X86
+
+static int lowestBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+SIMD_TARGET("sse4.1")
+static int hitSSE4(const SphereBlock* blocks, int block_count, const RayLanes& ray, float t_min, float& t_max, bool any_hit)
+{
+	const __m128 ox = _mm_set1_ps(ray.ox), oy = _mm_set1_ps(ray.oy), oz = _mm_set1_ps(ray.oz);
+	const __m128 dx = _mm_set1_ps(ray.dx), dy = _mm_set1_ps(ray.dy), dz = _mm_set1_ps(ray.dz);
+	const __m128 a = _mm_set1_ps(ray.a);
+	const __m128 lo = _mm_set1_ps(t_min);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+	__m128 hi = _mm_set1_ps(t_max);
+	int best = -1;
+
+	for (int b = 0; b < block_count; b++) {
+		const SphereBlock& block = blocks[b];
+		for (int k = 0; k < SphereBlock::WIDTH; k += 4) {
+			__m128 ocx = _mm_sub_ps(_mm_load_ps(block.m_X + k), ox);
+			__m128 ocy = _mm_sub_ps(_mm_load_ps(block.m_Y + k), oy);
+			__m128 ocz = _mm_sub_ps(_mm_load_ps(block.m_Z + k), oz);
+			__m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ocx), _mm_mul_ps(dy, ocy)), _mm_mul_ps(dz, ocz));
+			__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+				_mm_load_ps(block.m_R2 + k));
+			__m128 discriminant = _mm_sub_ps(_mm_mul_ps(h, h), _mm_mul_ps(a, c));
+			__m128 real = _mm_cmpge_ps(discriminant, zero);
+			if (!_mm_movemask_ps(real))
+				continue;
+
+			__m128 sqrtd = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+			__m128 t_near = _mm_div_ps(_mm_sub_ps(h, sqrtd), a);
+			__m128 t_far = _mm_div_ps(_mm_add_ps(h, sqrtd), a);
+			__m128 near_in = _mm_and_ps(_mm_cmpgt_ps(t_near, lo), _mm_cmplt_ps(t_near, hi));
+			__m128 far_in = _mm_and_ps(_mm_cmpgt_ps(t_far, lo), _mm_cmplt_ps(t_far, hi));
+			__m128 hit = _mm_and_ps(real, _mm_or_ps(near_in, far_in));
+			int hit_mask = _mm_movemask_ps(hit);
+			if (!hit_mask)
+				continue;
+			if (any_hit)
+				return block.m_Prim[k + lowestBit(hit_mask)];
+
+			__m128 t = _mm_blendv_ps(inf, _mm_blendv_ps(t_far, t_near, near_in), hit);
+			__m128 m = _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 3, 0, 1)));
+			m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+			int lane = lowestBit(_mm_movemask_ps(_mm_cmpeq_ps(t, m)));
+			t_max = _mm_cvtss_f32(m);
+			hi = _mm_set1_ps(t_max);
+			best = block.m_Prim[k + lane];
+		}
+	}
+	return best;
+}
+
+SIMD_TARGET("avx2")
+static int hitAVX2(const SphereBlock* blocks, int block_count, const RayLanes& ray, float t_min, float& t_max, bool any_hit)
+{
+	const __m256 ox = _mm256_set1_ps(ray.ox), oy = _mm256_set1_ps(ray.oy), oz = _mm256_set1_ps(ray.oz);
+	const __m256 dx = _mm256_set1_ps(ray.dx), dy = _mm256_set1_ps(ray.dy), dz = _mm256_set1_ps(ray.dz);
+	const __m256 a = _mm256_set1_ps(ray.a);
+	const __m256 lo = _mm256_set1_ps(t_min);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+	__m256 hi = _mm256_set1_ps(t_max);
+	int best = -1;
+
+	for (int b = 0; b < block_count; b++) {
+		const SphereBlock& block = blocks[b];
+		for (int k = 0; k < SphereBlock::WIDTH; k += 8) {
+			__m256 ocx = _mm256_sub_ps(_mm256_load_ps(block.m_X + k), ox);
+			__m256 ocy = _mm256_sub_ps(_mm256_load_ps(block.m_Y + k), oy);
+			__m256 ocz = _mm256_sub_ps(_mm256_load_ps(block.m_Z + k), oz);
+			__m256 h = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, ocx), _mm256_mul_ps(dy, ocy)), _mm256_mul_ps(dz, ocz));
+			__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)),
+				_mm256_load_ps(block.m_R2 + k));
+			__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(h, h), _mm256_mul_ps(a, c));
+			__m256 real = _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ);
+			if (!_mm256_movemask_ps(real))
+				continue;
+
+			__m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+			__m256 t_near = _mm256_div_ps(_mm256_sub_ps(h, sqrtd), a);
+			__m256 t_far = _mm256_div_ps(_mm256_add_ps(h, sqrtd), a);
+			__m256 near_in = _mm256_and_ps(_mm256_cmp_ps(t_near, lo, _CMP_GT_OQ), _mm256_cmp_ps(t_near, hi, _CMP_LT_OQ));
+			__m256 far_in = _mm256_and_ps(_mm256_cmp_ps(t_far, lo, _CMP_GT_OQ), _mm256_cmp_ps(t_far, hi, _CMP_LT_OQ));
+			__m256 hit = _mm256_and_ps(real, _mm256_or_ps(near_in, far_in));
+			int hit_mask = _mm256_movemask_ps(hit);
+			if (!hit_mask)
+				continue;
+			if (any_hit)
+				return block.m_Prim[k + lowestBit(hit_mask)];
+
+			__m256 t = _mm256_blendv_ps(inf, _mm256_blendv_ps(t_far, t_near, near_in), hit);
+			__m128 m = _mm_min_ps(_mm256_castps256_ps128(t), _mm256_extractf128_ps(t, 1));
+			m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+			m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+			t_max = _mm_cvtss_f32(m);
+			hi = _mm256_set1_ps(t_max);
+			int lane = lowestBit(_mm256_movemask_ps(_mm256_cmp_ps(t, hi, _CMP_EQ_OQ)));
+			best = block.m_Prim[k + lane];
+		}
+	}
+	return best;
+}
+
+SIMD_TARGET("avx512f")
+static int hitAVX512(const SphereBlock* blocks, int block_count, const RayLanes& ray, float t_min, float& t_max, bool any_hit)
+{
+	const __m512 ox = _mm512_set1_ps(ray.ox), oy = _mm512_set1_ps(ray.oy), oz = _mm512_set1_ps(ray.oz);
+	const __m512 dx = _mm512_set1_ps(ray.dx), dy = _mm512_set1_ps(ray.dy), dz = _mm512_set1_ps(ray.dz);
+	const __m512 a = _mm512_set1_ps(ray.a);
+	const __m512 lo = _mm512_set1_ps(t_min);
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 inf = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+	__m512 hi = _mm512_set1_ps(t_max);
+	int best = -1;
+
+	for (int b = 0; b < block_count; b++) {
+		const SphereBlock& block = blocks[b];
+		__m512 ocx = _mm512_sub_ps(_mm512_load_ps(block.m_X), ox);
+		__m512 ocy = _mm512_sub_ps(_mm512_load_ps(block.m_Y), oy);
+		__m512 ocz = _mm512_sub_ps(_mm512_load_ps(block.m_Z), oz);
+		__m512 h = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, ocx), _mm512_mul_ps(dy, ocy)), _mm512_mul_ps(dz, ocz));
+		__m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, ocx), _mm512_mul_ps(ocy, ocy)), _mm512_mul_ps(ocz, ocz)),
+			_mm512_load_ps(block.m_R2));
+		__m512 discriminant = _mm512_sub_ps(_mm512_mul_ps(h, h), _mm512_mul_ps(a, c));
+		__mmask16 real = _mm512_cmp_ps_mask(discriminant, zero, _CMP_GE_OQ);
+		if (!real)
+			continue;
+
+		__m512 sqrtd = _mm512_sqrt_ps(_mm512_max_ps(discriminant, zero));
+		__m512 t_near = _mm512_div_ps(_mm512_sub_ps(h, sqrtd), a);
+		__m512 t_far = _mm512_div_ps(_mm512_add_ps(h, sqrtd), a);
+		__mmask16 near_in = _mm512_cmp_ps_mask(t_near, lo, _CMP_GT_OQ) & _mm512_cmp_ps_mask(t_near, hi, _CMP_LT_OQ);
+		__mmask16 far_in = _mm512_cmp_ps_mask(t_far, lo, _CMP_GT_OQ) & _mm512_cmp_ps_mask(t_far, hi, _CMP_LT_OQ);
+		__mmask16 hit = real & (near_in | far_in);
+		if (!hit)
+			continue;
+		if (any_hit)
+			return block.m_Prim[lowestBit(hit)];
+
+		__m512 t = _mm512_mask_blend_ps(hit, inf, _mm512_mask_blend_ps(near_in, t_far, t_near));
+		t_max = _mm512_reduce_min_ps(t);
+		hi = _mm512_set1_ps(t_max);
+		best = block.m_Prim[lowestBit(_mm512_cmp_ps_mask(t, hi, _CMP_EQ_OQ))];
+	}
+	return best;
+}
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	int out[4];
+	__cpuidex(out, leaf, subleaf);
+	for (int i = 0; i < 4; i++)
+		regs[i] = (unsigned int)out[i];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switches (XCR0)
+static unsigned long long osSavedState()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+#endif
+
+static Simd_Isa detectIsa()
+{
+#ifdef SPHERE_BLOCKS_X86
+	unsigned int regs[4];
+	cpuid(0, 0, regs);
+	unsigned int max_leaf = regs[0];
+
+	cpuid(1, 0, regs);
+	bool sse41 = (regs[2] >> 19) & 1;
+	bool osxsave = (regs[2] >> 27) & 1;
+	bool avx = (regs[2] >> 28) & 1;
+	if (!sse41)
+		return SIMD_SCALAR;
+	if (!osxsave || !avx || max_leaf < 7)
+		return SIMD_SSE4;
+
+	// The CPU supporting the wide registers is not enough, the OS has to save them
+	unsigned long long xcr0 = osSavedState();
+	cpuid(7, 0, regs);
+	bool avx2 = (regs[1] >> 5) & 1;
+	bool avx512f = (regs[1] >> 16) & 1;
+	if (avx512f && (xcr0 & 0xE6) == 0xE6)
+		return SIMD_AVX512;
+	if (avx2 && (xcr0 & 0x6) == 0x6)
+		return SIMD_AVX2;
+	return SIMD_SSE4;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+Simd_Isa SphereBlocks::DetectIsa()
+{
+	// CPUID is slow under a hypervisor, and Build() asks for every packet
+	static const Simd_Isa isa = detectIsa();
+	return isa;
+}
+
+const char* SphereBlocks::IsaName(Simd_Isa isa)
+{
+	const char* names[] = { "scalar", "SSE4", "AVX2", "AVX-512" };
+	return names[isa];
+}
+
+void SphereBlocks::Build(const Scene& scene)
+{
+	int begin = scene.TypeOffset(HITTABLE_SPHERE);
+	std::vector<int> prims(scene.TypeCount(HITTABLE_SPHERE));
+	for (int i = 0; i < (int)prims.size(); i++)
+		prims[i] = begin + i;
+	Build(scene, prims);
+}
+
+void SphereBlocks::Build(const Scene& scene, const std::vector<int>& prims)
+{
+	m_Isa = std::min(m_Isa, DetectIsa());
+
+	m_Count = 0;
+	for (int prim : prims)
+		if (scene.m_Hittables[prim].type == HITTABLE_SPHERE)
+			m_Count++;
+	m_Blocks.assign((m_Count + SphereBlock::WIDTH - 1) / SphereBlock::WIDTH, SphereBlock());
+
+	for (SphereBlock& block : m_Blocks) {
+		for (int i = 0; i < SphereBlock::WIDTH; i++) {
+			block.m_X[i] = block.m_Y[i] = block.m_Z[i] = 0.f;
+			block.m_R2[i] = -1.f;
+			block.m_Prim[i] = -1;
+		}
+	}
+
+	int i = 0;
+	for (int prim : prims) {
+		const GPUHittable& h = scene.m_Hittables[prim];
+		if (h.type != HITTABLE_SPHERE)
+			continue;
+
+		SphereBlock& block = m_Blocks[i / SphereBlock::WIDTH];
+		int lane = i % SphereBlock::WIDTH;
+		const glm::vec4& cr = scene.m_Spheres[h.index].center_radius;
+		block.m_X[lane] = cr.x;
+		block.m_Y[lane] = cr.y;
+		block.m_Z[lane] = cr.z;
+		block.m_R2[lane] = cr.w * cr.w;
+		block.m_Prim[lane] = prim;
+		i++;
+	}
+}
+
+static SphereKernel kernel(Simd_Isa isa)
+{
+#ifdef SPHERE_BLOCKS_X86
+	if (isa == SIMD_AVX512)
+		return hitAVX512;
+	if (isa == SIMD_AVX2)
+		return hitAVX2;
+	if (isa == SIMD_SSE4)
+		return hitSSE4;
+#endif
+	return hitScalar;
+}
+
+static RayLanes rayLanes(const Ray& r)
+{
+	return { r.origin.x, r.origin.y, r.origin.z, r.direction.x, r.direction.y, r.direction.z,
+		glm::dot(r.direction, r.direction) };
+}
+
+bool SphereBlocks::Closest(const Ray& r, Interval& ray_t, int& prim_id) const
+{
+	if (m_Blocks.empty())
+		return false;
+
+	int hit = kernel(m_Isa)(m_Blocks.data(), (int)m_Blocks.size(), rayLanes(r), ray_t.min, ray_t.max, false);
+	if (hit < 0)
+		return false;
+	prim_id = hit;
+	return true;
+}
+
+bool SphereBlocks::Occluded(const Ray& r, const Interval& ray_t) const
+{
+	if (m_Blocks.empty())
+		return false;
+
+	float t_max = ray_t.max;
+	return kernel(m_Isa)(m_Blocks.data(), (int)m_Blocks.size(), rayLanes(r), ray_t.min, t_max, true) >= 0;
+}
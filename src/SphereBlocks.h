@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include "Ray.h"
+
+class Scene;
+
+// Instruction sets the sphere kernels are compiled for, picked at runtime
+enum Simd_Isa {
+	SIMD_SCALAR,
+	SIMD_SSE4,		// 4 spheres per instruction
+	SIMD_AVX2,		// 8
+	SIMD_AVX512,	// 16
+};
+
+// 16 spheres in SoA layout. Lanes past the last sphere have a negative squared radius
+// and can never be hit.
+struct alignas(64) SphereBlock {
+	static const int WIDTH = 16;
+
+	float m_X[WIDTH];
+	float m_Y[WIDTH];
+	float m_Z[WIDTH];
+	float m_R2[WIDTH];		// radius squared
+	int m_Prim[WIDTH];		// index into Scene::m_Hittables
+};
+
+// CPU copy of the scene's spheres repacked from GPUSphere (AoS, laid out for std430) into
+// SoA blocks, so one ray is tested against a whole block per instruction. The math is
+// intersectSphere() in sphere.glsl lane for lane, hits match the scalar walk.
+class SphereBlocks {
+
+public:
+	// Repacks the spheres of the primitive table in table order
+	void Build(const Scene& scene);
+
+	// Repacks the spheres among prims (primitive table indices, ascending), other types are skipped
+	void Build(const Scene& scene, const std::vector<int>& prims);
+
+	// Closest sphere hit inside ray_t, shrinks ray_t.max and sets prim_id when one is found
+	bool Closest(const Ray& r, Interval& ray_t, int& prim_id) const;
+
+	// Any sphere hit inside ray_t, for shadow rays
+	bool Occluded(const Ray& r, const Interval& ray_t) const;
+
+	int Count() const { return m_Count; }
+
+	// Best instruction set of this CPU and its name
+	static Simd_Isa DetectIsa();
+	static const char* IsaName(Simd_Isa isa);
+
+	// Lowered to DetectIsa() by Build() when the CPU lacks it
+	Simd_Isa m_Isa = DetectIsa();
+
+private:
+	std::vector<SphereBlock> m_Blocks;
+	int m_Count = 0;
+};
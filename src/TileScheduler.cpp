@@ -0,0 +1,157 @@
+#include "TileScheduler.h"
+#include "Topology.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Cell d of the Hilbert curve filling an n x n square, n a power of two
+static glm::ivec2 hilbertCell(int n, int d) {
+	glm::ivec2 p(0);
+	for (int s = 1; s < n; s *= 2) {
+		int rx = 1 & (d / 2);
+		int ry = 1 & (d ^ rx);
+
+		// Rotate the quadrant so the sub-curves join end to end
+		if (ry == 0) {
+			if (rx == 1)
+				p = glm::ivec2(s - 1) - p;
+			std::swap(p.x, p.y);
+		}
+
+		p += s * glm::ivec2(rx, ry);
+		d /= 4;
+	}
+	return p;
+}
+
+void TileScheduler::HilbertOrder(int tiles_x, int tiles_y, std::vector<glm::ivec2>& order)
+{
+	int n = 1;
+	while (n < tiles_x || n < tiles_y)
+		n *= 2;
+
+	order.clear();
+	for (int d = 0; d < n * n; d++) {
+		glm::ivec2 cell = hilbertCell(n, d);
+		if (cell.x < tiles_x && cell.y < tiles_y)
+			order.push_back(cell);
+	}
+}
+
+void TileScheduler::Run(const Tile& region, int tile_size, int thread_count, const std::function<void(int, const Tile&)>& work)
+{
+	glm::ivec2 size = region.m_Max - region.m_Min;
+	int tiles_x = (size.x + tile_size - 1) / tile_size;
+	int tiles_y = (size.y + tile_size - 1) / tile_size;
+
+	std::vector<glm::ivec2> cells;
+	if (m_Order == TILE_ORDER_HILBERT)
+		HilbertOrder(tiles_x, tiles_y, cells);
+	else
+		for (int y = 0; y < tiles_y; y++)
+			for (int x = 0; x < tiles_x; x++)
+				cells.push_back(glm::ivec2(x, y));
+
+	int tile_count = (int)cells.size();
+
+	m_Queues.clear();
+	m_Queues.resize(thread_count);
+	m_Stats.assign(thread_count, WorkerStats());
+
+	std::atomic<int> ready(0);
+	std::vector<std::thread> workers;
+	auto start = std::chrono::steady_clock::now();
+
+	for (int w = 0; w < thread_count; w++) {
+		workers.emplace_back([&, w]() {
+
+			if (w < (int)m_Cpus.size())
+				Topology::PinThread(m_Cpus[w]);
+
+			// Allocated and filled by the worker, first touch keeps the pages on its node
+			std::unique_ptr<Queue> queue(new Queue());
+			auto push = [&](const glm::ivec2& cell) {
+				Tile tile;
+				tile.m_Min = region.m_Min + cell * tile_size;
+				tile.m_Max = glm::min(tile.m_Min + tile_size, region.m_Max);
+				queue->m_Tiles.push_back(tile);
+			};
+
+			if (m_Order == TILE_ORDER_HILBERT) {
+				for (int i = tile_count * w / thread_count; i < tile_count * (w + 1) / thread_count; i++)
+					push(cells[i]);
+			}
+			else {
+				for (int i = w; i < tile_count; i += thread_count)
+					push(cells[i]);
+			}
+
+			m_Queues[w] = std::move(queue);
+			ready++;
+			while (ready.load() < thread_count)
+				std::this_thread::yield();
+
+			WorkerStats stats;
+			Tile tile;
+			while (true) {
+				bool stolen = false;
+				if (!Pop(w, tile)) {
+					if (!m_Steal || !Steal(w, tile))
+						break;
+					stolen = true;
+				}
+
+				auto tile_start = std::chrono::steady_clock::now();
+				work(w, tile);
+				stats.m_BusyMs += elapsed_ms(tile_start);
+				stats.m_Tiles++;
+				if (stolen)
+					stats.m_Stolen++;
+			}
+
+			m_Stats[w] = stats;
+		});
+	}
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	double frame_ms = elapsed_ms(start);
+	for (WorkerStats& stats : m_Stats)
+		stats.m_IdleMs = std::max(0.0, frame_ms - stats.m_BusyMs);
+}
+
+bool TileScheduler::Pop(int worker, Tile& tile)
+{
+	Queue& queue = *m_Queues[worker];
+	std::lock_guard<std::mutex> lock(queue.m_Mutex);
+	if (queue.m_Tiles.empty())
+		return false;
+
+	tile = queue.m_Tiles.front();
+	queue.m_Tiles.pop_front();
+	return true;
+}
+
+bool TileScheduler::Steal(int worker, Tile& tile)
+{
+	// Victims in turn from the next worker, tiles are never added so a full sweep of empty queues ends the frame
+	int count = (int)m_Queues.size();
+	for (int i = 1; i < count; i++) {
+		Queue& victim = *m_Queues[(worker + i) % count];
+		std::lock_guard<std::mutex> lock(victim.m_Mutex);
+		if (victim.m_Tiles.empty())
+			continue;
+
+		tile = victim.m_Tiles.back();
+		victim.m_Tiles.pop_back();
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Order the tiles of a frame are handed out in
+enum Tile_Order {
+	TILE_ORDER_ROWS,		// row major, tiles dealt round robin like striped rows
+	TILE_ORDER_HILBERT,		// along a Hilbert curve, each worker starts with one run of it
+};
+
+// Pixels [m_Min, m_Max) of the frame
+struct Tile {
+	glm::ivec2 m_Min;
+	glm::ivec2 m_Max;
+};
+
+// Hands out the tiles of a frame to the CPU workers. Consecutive tiles of a Hilbert curve are
+// neighbours on screen, so the rays of one worker keep hitting the same cells and primitives.
+// Every worker owns a deque, filled by the worker itself so the memory is local to it. Workers
+// take tiles from the front of their own deque and, once it is empty, steal from the back of
+// another's: the end of that worker's run, furthest from the tiles it is tracing.
+class TileScheduler {
+
+public:
+	// Busy is the time spent in work, idle the rest of the frame (stealing and waiting for the others)
+	struct WorkerStats {
+		double m_BusyMs = 0.0;
+		double m_IdleMs = 0.0;
+		int m_Tiles = 0;
+		int m_Stolen = 0;
+	};
+
+	// Runs work(worker, tile) over the tile_size tiles of the pixels in region on thread_count
+	// threads, returns once every tile is done
+	void Run(const Tile& region, int tile_size, int thread_count, const std::function<void(int, const Tile&)>& work);
+
+	// Cell coordinates of a tiles_x x tiles_y grid along a Hilbert curve, cells outside the
+	// grid skipped when it is not a power of two square
+	static void HilbertOrder(int tiles_x, int tiles_y, std::vector<glm::ivec2>& order);
+
+	Tile_Order m_Order = TILE_ORDER_HILBERT;
+	bool m_Steal = true;
+
+	// CPU every worker is pinned to before it fills its deque, -1 or missing entries are not pinned
+	std::vector<int> m_Cpus;
+
+	// One entry per worker of the last Run()
+	std::vector<WorkerStats> m_Stats;
+
+private:
+	// Own cache line per worker, the lock is only contended by thieves
+	struct alignas(64) Queue {
+		std::mutex m_Mutex;
+		std::deque<Tile> m_Tiles;
+	};
+	std::vector<std::unique_ptr<Queue>> m_Queues;
+
+	bool Pop(int worker, Tile& tile);
+	bool Steal(int worker, Tile& tile);
+};
@@ -0,0 +1,155 @@
+#include "Topology.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef __linux__
+// "0-3,8-11" as in the sysfs cpulist files
+static std::vector<int> parseCpuList(const std::string& list)
+{
+	std::vector<int> cpus;
+	size_t start = 0;
+	while (start < list.size()) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.size();
+
+		std::string range = list.substr(start, end - start);
+		size_t dash = range.find('-');
+		if (!range.empty() && isdigit((unsigned char)range[0])) {
+			int first = std::stoi(range);
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+		start = end + 1;
+	}
+	return cpus;
+}
+#endif
+
+void Topology::Detect()
+{
+	m_Nodes.clear();
+
+#ifdef _WIN32
+	ULONG highest = 0;
+	if (GetNumaHighestNodeNumber(&highest)) {
+		for (USHORT id = 0; id <= highest; id++) {
+			GROUP_AFFINITY affinity = {};
+			if (!GetNumaNodeProcessorMaskEx(id, &affinity))
+				continue;
+
+			Node node;
+			node.m_Id = id;
+			for (int bit = 0; bit < 64; bit++)
+				if (affinity.Mask & (KAFFINITY(1) << bit))
+					node.m_Cpus.push_back(affinity.Group * 64 + bit);
+			if (!node.m_Cpus.empty())
+				m_Nodes.push_back(node);
+		}
+	}
+#elif defined(__linux__)
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+	// Node ids can have holes, stop after a run of missing ones
+	for (int id = 0, missing = 0; missing < 64; id++) {
+		std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+		std::string list;
+		if (!file || !std::getline(file, list)) {
+			missing++;
+			continue;
+		}
+		missing = 0;
+
+		Node node;
+		node.m_Id = id;
+		for (int cpu : parseCpuList(list))
+			if (!have_mask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+				node.m_Cpus.push_back(cpu);
+		if (!node.m_Cpus.empty())
+			m_Nodes.push_back(node);
+	}
+#endif
+
+	if (m_Nodes.empty()) {
+		Node node;
+#ifdef __linux__
+		for (int cpu = 0; have_mask && cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &allowed))
+				node.m_Cpus.push_back(cpu);
+#endif
+		if (node.m_Cpus.empty())
+			for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+				node.m_Cpus.push_back(int(cpu));
+		m_Nodes.push_back(node);
+	}
+}
+
+std::vector<Topology::Place> Topology::Assign(int worker_count, int node_count) const
+{
+	int nodes = node_count > 0 ? std::min(node_count, (int)m_Nodes.size()) : (int)m_Nodes.size();
+	std::vector<Place> places(worker_count);
+
+	// Workers split over the nodes in proportion to their CPUs
+	int cpus = CpuCount(nodes);
+	int first_cpu = 0;
+	for (int n = 0; n < nodes; n++) {
+		const std::vector<int>& node_cpus = m_Nodes[n].m_Cpus;
+		int begin = int((long long)worker_count * first_cpu / cpus);
+		first_cpu += (int)node_cpus.size();
+		int end = int((long long)worker_count * first_cpu / cpus);
+
+		for (int w = begin; w < end; w++) {
+			places[w].m_Node = n;
+			places[w].m_Cpu = node_cpus[(w - begin) % node_cpus.size()];
+		}
+	}
+	return places;
+}
+
+int Topology::CpuCount(int node_count) const
+{
+	int nodes = node_count > 0 ? std::min(node_count, (int)m_Nodes.size()) : (int)m_Nodes.size();
+	int cpus = 0;
+	for (int n = 0; n < nodes; n++)
+		cpus += (int)m_Nodes[n].m_Cpus.size();
+	return cpus;
+}
+
+bool Topology::PinThread(int cpu)
+{
+	if (cpu < 0)
+		return false;
+
+#ifdef _WIN32
+	GROUP_AFFINITY affinity = {};
+	affinity.Group = WORD(cpu / 64);
+	affinity.Mask = KAFFINITY(1) << (cpu % 64);
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+	if (cpu >= CPU_SETSIZE)
+		return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
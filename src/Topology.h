@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// NUMA nodes of the machine and the CPUs of each, read from sysfs on Linux and from the
+// processor groups on Windows. Machines without that information are one node holding
+// every hardware thread. On Linux only the CPUs the process may run on are listed.
+class Topology {
+
+public:
+	struct Node {
+		int m_Id = 0;
+		std::vector<int> m_Cpus;
+	};
+
+	// Where a worker runs
+	struct Place {
+		int m_Node = 0;		// index into m_Nodes
+		int m_Cpu = -1;
+	};
+
+	void Detect();
+
+	// Spreads worker_count workers over the first node_count nodes (0 for all), node by node so
+	// workers next to each other in the tile order share a node
+	std::vector<Place> Assign(int worker_count, int node_count) const;
+
+	// CPUs of the first node_count nodes (0 for all)
+	int CpuCount(int node_count) const;
+
+	// Restricts the calling thread to cpu, false when the OS refused
+	static bool PinThread(int cpu);
+
+	std::vector<Node> m_Nodes;
+};
+
+// Leaves new elements uninitialized, so the pages of a buffer are placed on the node of the
+// thread writing them first instead of the one that allocated it
+template <class T>
+struct FirstTouchAllocator {
+	using value_type = T;
+
+	FirstTouchAllocator() = default;
+	template <class U> FirstTouchAllocator(const FirstTouchAllocator<U>&) {}
+
+	T* allocate(size_t count) { return static_cast<T*>(::operator new(count * sizeof(T))); }
+	void deallocate(T* p, size_t) { ::operator delete(p); }
+
+	// Default initialization instead of value initialization, no write for trivial types
+	template <class U> void construct(U* p) { ::new (static_cast<void*>(p)) U; }
+	template <class U, class... Args> void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+	template <class U> bool operator==(const FirstTouchAllocator<U>&) const { return true; }
+	template <class U> bool operator!=(const FirstTouchAllocator<U>&) const { return false; }
+};
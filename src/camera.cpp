@@ -19,7 +19,7 @@ Camera::Camera() {
     m_FocusDist = 10.;
 }
 
-void Camera::setUniforms(GLuint program_id)
+void Camera::setUniforms(GLuint program_id) const
 {
     glUseProgram(program_id);
     std::string base = "cam.";
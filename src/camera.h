@@ -10,7 +10,7 @@
 class Camera {
 public:
     Camera();
-    void setUniforms(GLuint program_id);
+    void setUniforms(GLuint program_id) const;
     void processMouse(double xoffset, double yoffset);
     void processKeyboard(double delta, unsigned int key);
     glm::vec3 m_LookFrom; // Cam location
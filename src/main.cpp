@@ -9,6 +9,9 @@
 #include <GLFW/glfw3.h>
 #include <gl/GL.h>
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
 
 
 #include "shader.h"
@@ -17,6 +20,21 @@
 
 #include "Sphere.h"
 #include "Cube.h"
+#include "Plane.h"
+#include "Scene.h"
+#include "CPUTracer.h"
+#include "Profiler.h"
+#include "Dispatcher.h"
+#include "HybridRenderer.h"
+#include "RenderCoordinator.h"
+#include "RenderWorker.h"
+#include "Benchmark.h"
+#include "Furnace.h"
+#include "Golden.h"
+#include "ShaderVariants.h"
+#include "ShaderCompiler.h"
+#include "ShaderBundle.h"
+#include "ShaderWatcher.h"
 
 #include "GUI.h"
 
@@ -31,8 +49,7 @@ double lastX;
 double lastY;
 
 //Scene Setup
-std::vector<GPUSphere>    gpuSpheres;
-GLuint ssboSpheres = 0, ssboMats = 0;
+Scene scene;
 
 void mouse_callback(GLFWwindow* window, double mouse_x, double mouse_y)
 {
@@ -92,7 +109,9 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
-void setup_scene() {
+// Small objects are scattered over [-half_extent, half_extent) on both ground axes,
+// emissive_fraction of the small diffuse spheres glow instead
+void setup_scene(int half_extent, float emissive_fraction) {
 
     // Ground
     Material ground_material = Material::MakeLambertian(glm::vec3(0.5, 0.5, 0.5));
@@ -100,13 +119,13 @@ void setup_scene() {
     // albedo, fuzz, type, refraction, padding
     Material::gpuMats.push_back({ { ground_material.m_Albedo, ground_material.m_Fuzz }, {float(ground_material.m_Type), 0.f, 0.f, 0.f} });
     
-    // position, radius, color, mat index
-    Sphere GroundSphere(glm::vec3(0, -1000.f, 0.f), glm::vec3(0.f), 1000.f);
-    gpuSpheres.push_back(GroundSphere.GetGPUSphere());
+    // point, normal, color (material index 0)
+    Plane GroundPlane(glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f));
+    scene.AddPlane(GroundPlane);
    
     // Generate objects with random materials
-    for (int a = -4; a < 4; a++) {
-        for (int b = -4; b < 4; b++) {
+    for (int a = -half_extent; a < half_extent; a++) {
+        for (int b = -half_extent; b < half_extent; b++) {
 
 
             float choose_mat = random_float();
@@ -114,13 +133,25 @@ void setup_scene() {
 
             if ((center - glm::vec3(4, 0.2, 0)).length() > 0.9) {
 
-                if (choose_mat < 0.8) {
+                if (choose_mat < 0.15) {
+
+                    // diffuse box
+                    glm::vec3 albedo = random_vec() * random_vec();
+                    Cube TempCube(center - glm::vec3(.18f, .2f, .18f), center + glm::vec3(.18f, .16f, .18f), albedo);
+                    TempCube.SetMaterial(Material::MakeLambertian(albedo));
+                    scene.AddCube(TempCube);
+
+                }
+                else if (choose_mat < 0.8) {
 
                     // diffuse
                     glm::vec3 albedo = random_vec() * random_vec();
                     Sphere TempSphere(center, albedo, .2f);
-                    TempSphere.SetMaterial(Material::MakeLambertian(albedo));
-                    gpuSpheres.push_back(TempSphere.GetGPUSphere());
+                    if (emissive_fraction > 0.f && random_float() < emissive_fraction)
+                        TempSphere.SetMaterial(Material::MakeEmissive(random_vec(0.5, 1), 4.f));
+                    else
+                        TempSphere.SetMaterial(Material::MakeLambertian(albedo));
+                    scene.AddSphere(TempSphere);
 
                 }
                 else if (choose_mat < 0.95) {
@@ -130,7 +161,7 @@ void setup_scene() {
                     float fuzz = random_float(0, 0.5);
                     Sphere TempSphere(center, albedo, .2f);
                     TempSphere.SetMaterial(Material::MakeMetal(albedo, fuzz));
-                    gpuSpheres.push_back(TempSphere.GetGPUSphere());
+                    scene.AddSphere(TempSphere);
 
                 }
                 else {
@@ -138,7 +169,7 @@ void setup_scene() {
                     // glass
                     Sphere TempSphere(center, glm::vec3(0.f), .2f);
                     TempSphere.SetMaterial(Material::MakeDielectric(0.f));
-                    gpuSpheres.push_back(TempSphere.GetGPUSphere());
+                    scene.AddSphere(TempSphere);
                 }
             }
         }
@@ -148,28 +179,77 @@ void setup_scene() {
     // Large Glass Sphere
     Sphere GlassSphere(glm::vec3(0, 1.f, 0.f), glm::vec3(0.f), 1.f);
     GlassSphere.SetMaterial(Material::MakeDielectric(0.f));
-    gpuSpheres.push_back(GlassSphere.GetGPUSphere());
+    scene.AddSphere(GlassSphere);
 
     // Large Matte Sphere
     Sphere MatteSphere(glm::vec3(-4.f, 1.f, 0.f), glm::vec3(0.f), 1.f);
     MatteSphere.m_Material = Material::MakeLambertian(glm::vec3(0.4, 0.2, 0.1));
-    gpuSpheres.push_back(MatteSphere.GetGPUSphere());
+    scene.AddSphere(MatteSphere);
 
     // Large Metal Sphere
     Sphere MetalSphere(glm::vec3(4.f, 1.f, 0.f), glm::vec3(1.f), 1.f);
     MetalSphere.SetMaterial(Material::MakeMetal(glm::vec3(0.7f, 0.6f, 0.5f), 0.0));
-    gpuSpheres.push_back(MetalSphere.GetGPUSphere());
+    scene.AddSphere(MetalSphere);
 
 
 }
 
-void upload_ssbo(GLuint& id, GLuint binding, const void* data, GLsizeiptr bytes) {
-    glGenBuffers(1, &id);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, data, GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, id);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-};
+// Closed box lit only by a small emissive sphere, the camera sits inside it
+void setup_cornell_scene() {
+
+    const float wall = 0.05f;
+    auto add_wall = [](glm::vec3 min, glm::vec3 max, glm::vec3 albedo) {
+        Cube Wall(min, max, albedo);
+        Wall.SetMaterial(Material::MakeLambertian(albedo));
+        scene.AddCube(Wall);
+    };
+
+    glm::vec3 white(0.73f), red(0.65f, 0.05f, 0.05f), green(0.12f, 0.45f, 0.15f);
+    add_wall(glm::vec3(-1.f - wall, 0.f, -1.f), glm::vec3(-1.f, 2.f, 1.f), red);
+    add_wall(glm::vec3(1.f, 0.f, -1.f), glm::vec3(1.f + wall, 2.f, 1.f), green);
+    add_wall(glm::vec3(-1.f, -wall, -1.f), glm::vec3(1.f, 0.f, 1.f), white);
+    add_wall(glm::vec3(-1.f, 2.f, -1.f), glm::vec3(1.f, 2.f + wall, 1.f), white);
+    add_wall(glm::vec3(-1.f, 0.f, -1.f - wall), glm::vec3(1.f, 2.f, -1.f), white);
+    add_wall(glm::vec3(-1.f, 0.f, 1.f), glm::vec3(1.f, 2.f, 1.f + wall), white);
+
+    // Contents
+    Cube Block(glm::vec3(-0.6f, 0.f, -0.6f), glm::vec3(-0.1f, 1.1f, -0.1f), white);
+    Block.SetMaterial(Material::MakeLambertian(white));
+    scene.AddCube(Block);
+
+    Sphere Ball(glm::vec3(0.45f, 0.35f, 0.2f), glm::vec3(1.f), 0.35f);
+    Ball.SetMaterial(Material::MakeMetal(glm::vec3(0.8f), 0.1f));
+    scene.AddSphere(Ball);
+
+    // Light
+    Sphere Light(glm::vec3(0.f, 1.8f, 0.f), glm::vec3(1.f), 0.12f);
+    Light.SetMaterial(Material::MakeEmissive(glm::vec3(1.f, 0.9f, 0.75f), 40.f));
+    scene.AddSphere(Light);
+
+    // Camera just inside the front wall
+    cam.m_LookFrom = glm::vec3(0.f, 1.f, 0.95f);
+    cam.m_LookAt = glm::vec3(0.f, 1.f, -1.f);
+    cam.m_Fov = 70.f;
+    cam.m_DefocusAngle = 0.f;
+
+    glm::vec3 dir = glm::normalize(cam.m_LookAt - cam.m_LookFrom);
+    cam.m_Pitch = glm::degrees(asin(dir.y));
+    cam.m_Yaw = glm::degrees(atan2(dir.z, dir.x));
+}
+
+// Fills the global scene by name ("cornell", "lights" or the default spheres) and builds it
+void create_scene(const std::string& name, int size) {
+
+    if (name == "cornell")
+        setup_cornell_scene();
+    else if (name == "lights") {
+        setup_scene(size, 0.35f);
+        scene.m_SkyIntensity = 0.02f;
+    }
+    else
+        setup_scene(size, 0.f);
+    scene.Build();
+}
 
 int glfw_Setup(GLFWwindow*& window)
 {
@@ -234,7 +314,115 @@ int glfw_Setup(GLFWwindow*& window)
     return 0;
 }
 
-int main() {
+int main(int argc, char** argv) {
+
+    // Command line: --bench runs the benchmark suite and exits, --furnace the white furnace tests,
+    // --scene-size N scatters small objects over a 2N x 2N area (default 4),
+    // --scene cornell renders the closed box lit by an emissive sphere,
+    // --scene lights turns about a quarter of the small spheres into lights under a night sky,
+    // --no-shader-cache always compiles from source instead of loading cached program binaries,
+    // --shaders-from-disk reads shaders/ instead of the sources bundled at build time,
+    // --watch-shaders reads them from disk too and rebuilds the programs an edit affects,
+    // --coordinator ADDRESS renders one frame headless on --workers N processes started with
+    // --worker ADDRESS ("host:port" or "unix:path"), --samples N per pixel, written to --out PATH,
+    // --deterministic hashes every random number from --seed N and the sample instead,
+    // --golden compares renders of both tracers with the images in golden/ (--golden-cpu the CPU
+    // tracer alone, without a window), --update-golden replaces them with CPU renders
+    bool runBenchmark = false;
+    bool watchShaders = false;
+    bool runFurnace = false;
+    bool runGolden = false;
+    bool goldenCpuOnly = false;
+    bool updateGolden = false;
+    std::string sceneName = "default";
+    int sceneSize = 4;
+    std::string coordinatorAddress;
+    std::string workerAddress;
+    int workerCount = 1;
+    int renderSamples = 64;
+    std::string outputPath = "frame.pfm";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench")
+            runBenchmark = true;
+        else if (arg == "--furnace")
+            runFurnace = true;
+        else if (arg == "--golden")
+            runGolden = true;
+        else if (arg == "--golden-cpu")
+            goldenCpuOnly = true;
+        else if (arg == "--update-golden")
+            updateGolden = true;
+        else if (arg == "--scene-size" && i + 1 < argc)
+            sceneSize = std::max(1, atoi(argv[++i]));
+        else if (arg == "--scene" && i + 1 < argc)
+            sceneName = argv[++i];
+        else if (arg == "--no-shader-cache")
+            Shader::cacheDirectory.clear();
+        else if (arg == "--shaders-from-disk")
+            Shader::useBundle = false;
+        else if (arg == "--watch-shaders") {
+            watchShaders = true;
+            Shader::useBundle = false;
+        }
+        else if (arg == "--coordinator" && i + 1 < argc)
+            coordinatorAddress = argv[++i];
+        else if (arg == "--worker" && i + 1 < argc)
+            workerAddress = argv[++i];
+        else if (arg == "--workers" && i + 1 < argc)
+            workerCount = std::max(1, atoi(argv[++i]));
+        else if (arg == "--samples" && i + 1 < argc)
+            renderSamples = std::max(1, atoi(argv[++i]));
+        else if (arg == "--out" && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (arg == "--deterministic")
+            use_deterministic = true;
+        else if (arg == "--seed" && i + 1 < argc)
+            render_seed = atoi(argv[++i]);
+    }
+
+    // Golden images are written by the CPU tracer, which needs no window or GL context
+    if (goldenCpuOnly || updateGolden) {
+        Golden golden(nullptr);
+        golden.m_Update = updateGolden;
+        int failed = golden.Run();
+        std::cout << (updateGolden ? "Golden images written" : "Golden image tests") << ", " << failed << " failed\n";
+        return failed > 0 ? 1 : 0;
+    }
+
+    // Distributed rendering runs headless on the CPU tracer, without a window or GL context
+    if (!workerAddress.empty()) {
+        RenderWorker worker;
+        bool served = worker.Run(workerAddress);
+        std::cout << "Worker: " << worker.m_Jobs << " jobs traced\n";
+        return served ? 0 : 1;
+    }
+
+    if (!coordinatorAddress.empty()) {
+        create_scene(sceneName, sceneSize);
+
+        RenderCoordinator coordinator(scene, cam, Camera::SCR_WIDTH, Camera::SCR_HEIGHT);
+        coordinator.m_Address = coordinatorAddress;
+        coordinator.m_Samples = renderSamples;
+        coordinator.m_MaxDepth = ray_depth;
+        coordinator.m_RouletteDepth = use_russian_roulette ? roulette_depth : ray_depth;
+        coordinator.m_Deterministic = use_deterministic;
+        coordinator.m_Seed = uint32_t(render_seed);
+        bool rendered = coordinator.Render(workerCount);
+
+        std::cout << "Coordinator: " << coordinator.m_Jobs << " jobs in " << coordinator.m_RenderMs << " ms, "
+            << coordinator.m_Retries << " retried, " << coordinator.m_WorkersLost << " workers lost\n";
+        if (!rendered) {
+            std::cout << "Coordinator: every worker was lost before the frame was done\n";
+            return 1;
+        }
+        if (!coordinator.WritePfm(outputPath)) {
+            std::cout << "Coordinator: cannot write " << outputPath << "\n";
+            return 1;
+        }
+        std::cout << "Coordinator: wrote " << outputPath << "\n";
+        return 0;
+    }
 
     GLFWwindow* window = nullptr;
     if (glfw_Setup(window) != 0) {
@@ -257,24 +445,54 @@ int main() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, Camera::SCR_WIDTH, Camera::SCR_HEIGHT);
 
+    // The image keeps its initial size, used by the CPU tracer uploads
+    const unsigned int imageWidth = Camera::SCR_WIDTH;
+    const unsigned int imageHeight = Camera::SCR_HEIGHT;
+
     // Create Shader program
+    bool bundled = Shader::useBundle && bundledShaderCount() > 0;
+    std::cout << "Shader sources: " << (bundled ? "embedded bundle" : "shaders/ on disk") << "\n";
+    double shaderStart = glfwGetTime();
     Shader graphicsProgram("shaders/source/vert.glsl", "shaders/source/frag.glsl");
     Shader computeProgram("shaders/source/comp.glsl");
+    std::cout << "Shaders ready in " << (glfwGetTime() - shaderStart) * 1000.0 << " ms, program cache "
+        << Shader::cacheHits << "/" << Shader::cacheHits + Shader::cacheMisses << " hits\n";
 
     // Quad rendered in vertex shader but some vao must be bound to render anything
     GLuint vao;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
-    // Create the scene
-    setup_scene();
+    // The furnace tests build their own scenes
+    if (runFurnace || runGolden) {
+        int failed = 0;
+        if (runFurnace) {
+            Furnace furnace(computeProgram, imageWidth, imageHeight);
+            furnace.Run();
+        }
+        if (runGolden) {
+            Golden golden(&computeProgram);
+            failed = golden.Run();
+            std::cout << "Golden image tests, " << failed << " failed\n";
+        }
+
+        glDeleteProgram(graphicsProgram.m_ProgramId);
+        glDeleteProgram(computeProgram.m_ProgramId);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return failed > 0 ? 1 : 0;
+    }
+
+    // Create the scene and its acceleration structure
+    double buildStart = glfwGetTime();
+    create_scene(sceneName, sceneSize);
+    std::cout << "Scene: " << scene.m_Hittables.size() << " primitives, "
+        << (scene.m_AccelType == ACCEL_GRID ? "grid" : "linear") << " acceleration, built in "
+        << (glfwGetTime() - buildStart) * 1000.0 << " ms\n";
 
     // Send scene to computer shader (upload ssbo and  init key values
     computeProgram.use();
-    upload_ssbo(ssboSpheres, /*binding=*/0, gpuSpheres.data(), gpuSpheres.size() * sizeof(GPUSphere));
-    upload_ssbo(ssboMats, /*binding=*/1, Material::gpuMats.data(), Material::gpuMats.size() * sizeof(GPUMaterial));
-    glUniform1i(glGetUniformLocation(computeProgram.m_ProgramId, "uSphereCount"), (int)gpuSpheres.size());
-    glUniform1i(glGetUniformLocation(computeProgram.m_ProgramId, "uMaterialsCount"), (int)Material::gpuMats.size());
+    scene.Upload(computeProgram.m_ProgramId);
     computeProgram.setInt("SCR_HEIGHT", Camera::SCR_HEIGHT);
     computeProgram.setInt("SCR_WIDTH", Camera::SCR_WIDTH);
 
@@ -288,9 +506,64 @@ int main() {
     std::cout << "Vendor:         " << glGetString(GL_VENDOR) << std::endl;
     std::cout << "Renderer:       " << glGetString(GL_RENDERER) << std::endl;
      
+    if (runBenchmark) {
+        Benchmark benchmark(scene, computeProgram, cam, imageWidth, imageHeight, number_of_samples, ray_depth);
+        benchmark.Run();
+
+        glDeleteProgram(graphicsProgram.m_ProgramId);
+        glDeleteProgram(computeProgram.m_ProgramId);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return 0;
+    }
+
+    // CPU mirror of the compute shader, reads the same buffers as the GPU
+    CPUTracer cpuTracer(scene);
+
+    // Time spent tracing, measured on whichever side renders the frame
+    GPUTimer traceTimer;
+    traceTimer.Init();
+    double trace_ms = 0.0;
+
+    // Tiles or persistent threads, with optional per workgroup utilization
+    Dispatcher dispatcher;
+    dispatcher.Init();
+    GroupUtilization groupUtilization;
+    std::cout << "Persistent threads: " << dispatcher.m_PersistentGroups << " groups\n";
+
+    // Frames split between the compute shader and the CPU tracer
+    HybridRenderer hybrid;
+    hybrid.Init();
+
+    // Variants are built off the render loop, the frame keeps its current program meanwhile
+    ShaderCompiler shaderCompiler;
+    shaderCompiler.Init(window);
+    const char* compileModes[] = { "worker thread", "driver parallel compile", "blocking" };
+    std::cout << "Shader compiles: " << compileModes[shaderCompiler.m_Mode] << "\n";
+
+    // Specialized kernels for the current samples, depth and scene contents
+    ShaderVariants shaderVariants("shaders/source/comp.glsl", computeProgram, shaderCompiler);
+    GLuint tracerProgram = computeProgram.m_ProgramId;
+    const unsigned int materialMask = scene.MaterialMask();
+    const unsigned int primitiveMask = scene.PrimitiveMask();
+
+    // Hot reload, the scene buffers stay as they are and only the programs are replaced
+    const char* computePath = "shaders/source/comp.glsl";
+    const char* vertexPath = "shaders/source/vert.glsl";
+    const char* fragmentPath = "shaders/source/frag.glsl";
+    ShaderWatcher shaderWatcher;
+    if (watchShaders && !shaderWatcher.Init({ computePath, vertexPath, fragmentPath },
+        { "shaders/source", "shaders/source/implementations", "shaders/include" }))
+        watchShaders = false;
+    int reloadTicket = -1;
+    std::vector<std::string> editedShaders;
+
     // Initialize ImGui
     init_gui(window);
 
+    // GLFW's timer starts at glfwInit()
+    std::cout << "Startup: " << glfwGetTime() * 1000.0 << " ms\n";
+
     double delay_fps_display = 0.0f;
     float display_fps = 1.f;
 
@@ -300,20 +573,81 @@ int main() {
         // Frame rate
         double frameStart = glfwGetTime();
 
-        // Update Compute Shader
-        computeProgram.use();
-        computeProgram.setFloat("uSeed", random_float());
-        computeProgram.setInt("SAMPLES", number_of_samples);
-        computeProgram.setInt("MAX_DEPTH", ray_depth);
-        cam.setUniforms(computeProgram.m_ProgramId);
-
-        // Dispatch the compute workgroups (this groups sizing performs better)
-        glDispatchCompute(
-            (GLuint)ceil(Camera::SCR_WIDTH / 16.0),
-            (GLuint)ceil(Camera::SCR_HEIGHT / 16.0),
-            1
-        );
-        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        // Russian roulette starts after roulette_depth bounces, ray_depth disables it
+        int rouletteDepth = use_russian_roulette ? roulette_depth : ray_depth;
+        scene.m_LightSampling = use_light_tree ? LIGHT_SAMPLING_TREE : LIGHT_SAMPLING_UNIFORM;
+
+        if (use_cpu_tracer) {
+
+            // Render on the CPU and copy the result into the output texture
+            double traceStart = glfwGetTime();
+            cpuTracer.m_RouletteDepth = rouletteDepth;
+            cpuTracer.m_UseStreams = use_ray_streams;
+            cpuTracer.m_SortStreams = sort_ray_streams;
+            cpuTracer.m_Deterministic = use_deterministic;
+            cpuTracer.m_Seed = uint32_t(render_seed);
+            cpuTracer.m_Specialize = use_shader_variants;
+            cpuTracer.RenderFrame(cam, imageWidth, imageHeight, number_of_samples, ray_depth);
+            trace_ms = (glfwGetTime() - traceStart) * 1000.0;
+            glBindTexture(GL_TEXTURE_2D, imageTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imageWidth, imageHeight, GL_RGBA, GL_FLOAT, cpuTracer.m_Framebuffer.data());
+        }
+        else {
+
+            // The generic kernel runs until the variant for these settings is compiled
+            ShaderVariantKey variantKey = { number_of_samples, ray_depth, materialMask, primitiveMask };
+            Shader& tracer = use_shader_variants ? shaderVariants.Select(variantKey) : computeProgram;
+
+            // Programs share the scene buffers but not their uniforms
+            if (tracer.m_ProgramId != tracerProgram) {
+                scene.SetUniforms(tracer.m_ProgramId);
+                tracer.setInt("SCR_HEIGHT", Camera::SCR_HEIGHT);
+                tracer.setInt("SCR_WIDTH", Camera::SCR_WIDTH);
+                tracerProgram = tracer.m_ProgramId;
+            }
+
+            // Update Compute Shader
+            tracer.use();
+            // A deterministic frame is keyed by the seed, the same every frame and for the CPU tracer
+            tracer.setFloat("uSeed", use_deterministic ? float(render_seed) : random_float());
+            tracer.setUInt("uSeedBits", uint32_t(render_seed));
+            tracer.setBool("uDeterministic", use_deterministic);
+            tracer.setInt("SAMPLES", number_of_samples);
+            tracer.setInt("MAX_DEPTH", ray_depth);
+            tracer.setInt("uRouletteDepth", rouletteDepth);
+            tracer.setInt("uLightSampling", scene.m_LightSampling);
+            cam.setUniforms(tracer.m_ProgramId);
+
+            dispatcher.m_Mode = use_persistent_threads ? DISPATCH_PERSISTENT : DISPATCH_TILES;
+            dispatcher.m_BatchSize = persistent_batch_size;
+            dispatcher.m_CollectStats = collect_group_stats;
+
+            if (use_hybrid) {
+
+                // The GPU traces the bottom rows, the CPU tracer the rest
+                cpuTracer.m_RouletteDepth = rouletteDepth;
+                cpuTracer.m_UseStreams = use_ray_streams;
+                cpuTracer.m_SortStreams = sort_ray_streams;
+                cpuTracer.m_Deterministic = use_deterministic;
+                cpuTracer.m_Seed = uint32_t(render_seed);
+                cpuTracer.m_Specialize = use_shader_variants;
+                hybrid.RenderFrame(tracer.m_ProgramId, dispatcher, cpuTracer, cam, imageTexture,
+                    imageWidth, imageHeight, number_of_samples, ray_depth);
+                trace_ms = std::max(hybrid.m_GpuMs, hybrid.m_CpuMs + hybrid.m_UploadMs);
+            }
+            else {
+
+                // Dispatch the compute workgroups (16x16 groups perform better)
+                traceTimer.Begin();
+                dispatcher.Dispatch(tracer.m_ProgramId, Camera::SCR_WIDTH, Camera::SCR_HEIGHT);
+                traceTimer.End();
+                trace_ms = traceTimer.m_LastMs;
+            }
+            glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+            if (collect_group_stats)
+                groupUtilization = dispatcher.ReadUtilization();
+        }
 
         // Clear the background
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -327,7 +661,67 @@ int main() {
         glBindVertexArray(0);
 
         // Display DearImGui
-        display_gui(display_fps);
+        display_gui(display_fps, trace_ms, groupUtilization, hybrid, shaderVariants, tracerProgram != computeProgram.m_ProgramId);
+
+        // Starts settled variant builds and swaps in finished ones
+        if (use_shader_variants && !use_cpu_tracer)
+            shaderVariants.Update();
+
+        if (watchShaders) {
+            for (const std::string& path : shaderWatcher.Poll()) {
+                std::cout << "Shader edited: " << path << "\n";
+                if (std::find(editedShaders.begin(), editedShaders.end(), path) == editedShaders.end())
+                    editedShaders.push_back(path);
+            }
+
+            ShaderCompiler::Result reloaded;
+            if (reloadTicket >= 0 && shaderCompiler.Take(reloadTicket, reloaded)) {
+                reloadTicket = -1;
+                if (reloaded.m_Linked) {
+                    std::cout << "Shader reloaded in " << reloaded.m_Ms << " ms\n";
+                    glDeleteProgram(computeProgram.m_ProgramId);
+                    computeProgram = reloaded.m_Shader;
+
+                    // Variants were built from the old sources, uniforms are set again next frame
+                    shaderVariants.Clear();
+                    tracerProgram = 0;
+                }
+                else {
+                    std::cout << "Shader reload failed, keeping the previous compute program\n";
+                    glDeleteProgram(reloaded.m_Shader.m_ProgramId);
+                }
+            }
+
+            // The include strings are only replaced while no build compiles against them, edits
+            // made during a reload or a variant build are picked up once it is done
+            if (!editedShaders.empty() && !shaderCompiler.IsBusy()) {
+                reloadIncludes();
+
+                bool graphicsEdited = false;
+                for (const std::string& path : editedShaders) {
+                    if (path == computePath)
+                        reloadTicket = shaderCompiler.Request(computePath, "");
+                    else
+                        graphicsEdited = true;
+                }
+                editedShaders.clear();
+
+                // Small enough to rebuild in the frame, once for edits of both stages
+                if (graphicsEdited) {
+                    Shader graphics(vertexPath, fragmentPath);
+                    if (graphics.isLinked()) {
+                        glDeleteProgram(graphicsProgram.m_ProgramId);
+                        graphicsProgram = graphics;
+                        graphicsProgram.use();
+                        graphicsProgram.setInt("uOutputTexture", 0);
+                    }
+                    else {
+                        std::cout << "Shader reload failed, keeping the previous graphics program\n";
+                        glDeleteProgram(graphics.m_ProgramId);
+                    }
+                }
+            }
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -350,6 +744,8 @@ int main() {
     }
 
     // Cleanup
+    shaderVariants.Clear();
+    shaderCompiler.Shutdown();
     glDeleteProgram(graphicsProgram.m_ProgramId);
     glDeleteProgram(computeProgram.m_ProgramId);
     glBindVertexArray(0);
@@ -1,4 +1,36 @@
 #include "Shader.h"
+#include "ShaderBundle.h"
+
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <map>
+#include <mutex>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+std::string Shader::cacheDirectory = "shader_cache";
+bool Shader::useBundle = true;
+std::atomic<int> Shader::cacheHits(0);
+std::atomic<int> Shader::cacheMisses(0);
+bool Shader::parallelCompile = false;
+
+// GL_KHR_parallel_shader_compile query, not part of the glad loader
+static const GLenum COMPLETION_STATUS_KHR = 0x91B1;
+
+// Header of a cached program binary file, the driver blob follows
+struct ProgramBinaryHeader {
+    uint32_t magic;
+    GLenum format;
+};
+static const uint32_t PROGRAM_BINARY_MAGIC = 0x42505452;   // "RTPB"
+
+// Virtual include name -> source, filled by loadIncludes()
+static std::map<std::string, std::string> includeSources;
+static std::mutex includeMutex;
 
 // Load a file into a std::string
 std::string LoadFile(const char* path) {
@@ -11,33 +43,44 @@ std::string LoadFile(const char* path) {
     return ss.str();
 }
 
-void loadIncludes() {
-
-    // List of virtual names opengfl will use for includes
-    std::vector<std::pair<const char*, const char*>> includes = {
-        { "/material.glsl", "shaders/source/implementations/material.glsl"    },
-        { "/sphere.glsl", "shaders/source/implementations/sphere.glsl"    },
-        { "/ray.glsl", "shaders/source/implementations/ray.glsl"    },
-        { "/utilities.glsl", "shaders/source/implementations/utilities.glsl"    },
-        { "/interval.glsl", "shaders/source/implementations/interval.glsl"    },
-        { "/camera.glsl", "shaders/source/implementations/camera.glsl"    },
-        { "/aabb.glsl", "shaders/source/implementations/aabb.glsl"    },
-            
-        { "/types.glsl_h", "shaders/include/types.glsl_h"    },
-        { "/ray.glsl_h", "shaders/include/ray.glsl_h"    },
-        { "/utilities.glsl_h", "shaders/include/utilities.glsl_h"    },
-        { "/interval.glsl_h", "shaders/include/interval.glsl_h"    },
-        { "/camera.glsl_h", "shaders/include/camera.glsl_h"    },
-        { "/aabb.glsl_h", "shaders/include/aabb.glsl_h"    },
-		{ "/sphere.glsl_h", "shaders/include/sphere.glsl_h"    },
-        { "/material.glsl_h", "shaders/include/material.glsl_h"    },
-        { "/buffers.glsl_h", "shaders/include/buffers.glsl_h"    },
-
-    };
-
-    for (std::pair<const char*, const char*>& inc : includes) {
+// List of virtual names opengfl will use for includes
+static const std::vector<std::pair<const char*, const char*>> includeFiles = {
+    { "/material.glsl", "shaders/source/implementations/material.glsl"    },
+    { "/sphere.glsl", "shaders/source/implementations/sphere.glsl"    },
+    { "/ray.glsl", "shaders/source/implementations/ray.glsl"    },
+    { "/utilities.glsl", "shaders/source/implementations/utilities.glsl"    },
+    { "/interval.glsl", "shaders/source/implementations/interval.glsl"    },
+    { "/camera.glsl", "shaders/source/implementations/camera.glsl"    },
+    { "/aabb.glsl", "shaders/source/implementations/aabb.glsl"    },
+    { "/scene.glsl", "shaders/source/implementations/scene.glsl"    },
+    { "/grid.glsl", "shaders/source/implementations/grid.glsl"    },
+    { "/plane.glsl", "shaders/source/implementations/plane.glsl"    },
+    { "/light.glsl", "shaders/source/implementations/light.glsl"    },
+    { "/bsdf.glsl", "shaders/source/implementations/bsdf.glsl"    },
+        
+    { "/types.glsl_h", "shaders/include/types.glsl_h"    },
+    { "/ray.glsl_h", "shaders/include/ray.glsl_h"    },
+    { "/utilities.glsl_h", "shaders/include/utilities.glsl_h"    },
+    { "/interval.glsl_h", "shaders/include/interval.glsl_h"    },
+    { "/camera.glsl_h", "shaders/include/camera.glsl_h"    },
+    { "/aabb.glsl_h", "shaders/include/aabb.glsl_h"    },
+	{ "/sphere.glsl_h", "shaders/include/sphere.glsl_h"    },
+    { "/material.glsl_h", "shaders/include/material.glsl_h"    },
+    { "/buffers.glsl_h", "shaders/include/buffers.glsl_h"    },
+    { "/scene.glsl_h", "shaders/include/scene.glsl_h"    },
+    { "/grid.glsl_h", "shaders/include/grid.glsl_h"    },
+    { "/plane.glsl_h", "shaders/include/plane.glsl_h"    },
+    { "/light.glsl_h", "shaders/include/light.glsl_h"    },
+    { "/bsdf.glsl_h", "shaders/include/bsdf.glsl_h"    },
+
+};
+
+// Reads every include file and registers it, includeMutex must be held
+static void registerIncludes() {
+    for (const std::pair<const char*, const char*>& inc : includeFiles) {
         const char* name = inc.first;
         std::string src = LoadFile(inc.second);
+        includeSources[name] = src;
         glNamedStringARB(
             GL_SHADER_INCLUDE_ARB,
             strlen(name),
@@ -48,51 +91,251 @@ void loadIncludes() {
     }
 }
 
+void loadIncludes() {
+
+    // Registered once per process, every program shares them. Programs can be built
+    // on the ShaderCompiler thread too.
+    std::lock_guard<std::mutex> lock(includeMutex);
+    if (includeSources.empty())
+        registerIncludes();
+}
+
+void reloadIncludes() {
+    std::lock_guard<std::mutex> lock(includeMutex);
+    registerIncludes();
+}
+
+std::string includeFilePath(const std::string& name) {
+    for (const std::pair<const char*, const char*>& inc : includeFiles)
+        if (name == inc.first)
+            return inc.second;
+    return "";
+}
+
+// Read a shader, from the bundle when it has one, and insert the defines after its #version line
+static std::string readSource(const char* path, const std::string& defines) {
+    std::string source;
+    if (!Shader::useBundle || !loadBundledShader(path, source)) {
+
+        // Sources on disk still carry their #include lines
+        loadIncludes();
+
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "ERROR: Shader file not found: " << path << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+        source.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    // #version must stay the first line
+    if (!defines.empty()) {
+        size_t line_end = source.find('\n', source.find("#version"));
+        source.insert(line_end == std::string::npos ? source.size() : line_end + 1, defines);
+    }
+    return source;
+}
+
+// Append the source of every include reached from source to resolved, each file once
+static void resolveIncludes(const std::string& source, std::set<std::string>& seen, std::string& resolved) {
+    size_t pos = 0;
+    while ((pos = source.find("#include", pos)) != std::string::npos) {
+        size_t open = source.find('"', pos);
+        size_t close = open == std::string::npos ? open : source.find('"', open + 1);
+        if (close == std::string::npos)
+            return;
+        pos = close + 1;
+
+        std::string name = source.substr(open + 1, close - open - 1);
+        auto found = includeSources.find(name);
+        if (found == includeSources.end() || !seen.insert(name).second)
+            continue;
+        resolved += found->second;
+        resolveIncludes(found->second, seen, resolved);
+    }
+}
+
+static void makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
 Shader::Shader(const char* vertPath, const char* fragPath)
 {
+    buildProgram({ { readSource(vertPath, ""), vertPath, "VERTEX" },
+                   { readSource(fragPath, ""), fragPath, "FRAGMENT" } }, true);
+}
 
-    // Load shader includes
-    loadIncludes();
 
-    m_ProgramId = glCreateProgram();
-    compileShader(vertPath, "VERTEX", m_ProgramId);
-    compileShader(fragPath, "FRAGMENT", m_ProgramId);
+Shader::Shader(const char* compPath)
+    : Shader(compPath, std::string())
+{
+}
 
-    // Now that all shaders are attached, link the program:
-    glLinkProgram(m_ProgramId);
-    checkCompileErrors(m_ProgramId, "PROGRAM", "PROGRAM");
+
+Shader::Shader(const char* compPath, const std::string& defines)
+{
+    buildProgram({ { readSource(compPath, defines), compPath, "COMPUTE" } }, true);
 }
 
 
-Shader::Shader(const char* compPath)
+Shader Shader::beginCompute(const char* compPath, const std::string& defines)
+{
+    Shader shader;
+    shader.buildProgram({ { readSource(compPath, defines), compPath, "COMPUTE" } }, false);
+    return shader;
+}
+
+
+bool Shader::isReady()
 {
+    if (!m_Build.active)
+        return true;
+
+    if (parallelCompile) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(m_ProgramId, COMPLETION_STATUS_KHR, &done);
+        if (!done)
+            return false;
+    }
+
+    finishProgram();
+    return true;
+}
+
+
+bool Shader::isLinked() const
+{
+    GLint success = GL_FALSE;
+    glGetProgramiv(m_ProgramId, GL_LINK_STATUS, &success);
+    return success == GL_TRUE;
+}
 
-    // Load shader includes
-    loadIncludes();
 
+void Shader::buildProgram(const std::vector<Stage>& stages, bool wait)
+{
+    double start = glfwGetTime();
     m_ProgramId = glCreateProgram();
-    compileShader(compPath, "COMPUTE", m_ProgramId);
+    m_Build = PendingBuild();
+
+    // Binaries are only valid for the exact sources and driver that produced them
+    std::string cache_path;
+    if (!cacheDirectory.empty()) {
+        std::string key = std::string((const char*)glGetString(GL_VENDOR)) + "\n"
+            + (const char*)glGetString(GL_RENDERER) + "\n" + (const char*)glGetString(GL_VERSION) + "\n";
+        {
+            // reloadIncludes() replaces the sources on the render thread
+            std::lock_guard<std::mutex> lock(includeMutex);
+            std::set<std::string> seen;
+            for (const Stage& stage : stages) {
+                key += stage.type;
+                key += stage.source;
+                resolveIncludes(stage.source, seen, key);
+            }
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)shaderHash(key));
+        cache_path = cacheDirectory + name;
+
+        if (loadProgramBinary(cache_path)) {
+            cacheHits++;
+            std::cout << "PROGRAM CACHE HIT: " << stages[0].path << " (" << (glfwGetTime() - start) * 1000.0 << " ms)\n";
+            return;
+        }
+        cacheMisses++;
+    }
+
+    for (const Stage& stage : stages) {
+        m_Build.shaders.push_back(compileShader(stage, m_ProgramId));
+        m_Build.types.push_back(stage.type);
+    }
 
     // Now that all shaders are attached, link the program:
+    if (!cache_path.empty())
+        glProgramParameteri(m_ProgramId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(m_ProgramId);
-    checkCompileErrors(m_ProgramId, "COMPUTE_PROGRAM", "COMPUTE_PROGRAM");
+
+    m_Build.path = stages[0].path;
+    m_Build.cachePath = cache_path;
+    m_Build.start = start;
+    m_Build.active = true;
+    if (wait)
+        finishProgram();
 }
 
 
-void Shader::compileShader(const char* shader_path,
-    const char* type,
-    unsigned int programId)
+void Shader::finishProgram()
 {
-    std::cout << "COMPILING SHADER: " << shader_path << "\n";
-    std::ifstream file(shader_path);
-    if (!file) {
-        std::cerr << "ERROR: Shader file not found: " << shader_path << "\n";
-        std::exit(EXIT_FAILURE);
+    // Status queries wait for the driver, so the logs are only read here
+    for (size_t i = 0; i < m_Build.shaders.size(); i++) {
+        checkCompileErrors(m_Build.shaders[i], m_Build.types[i], m_Build.path);
+        glDeleteShader(m_Build.shaders[i]);
     }
+    checkCompileErrors(m_ProgramId, "PROGRAM", m_Build.path);
 
-    std::string source((std::istreambuf_iterator<char>(file)),
-        std::istreambuf_iterator<char>());
-    const char* src = source.c_str();
+    if (!m_Build.cachePath.empty())
+        saveProgramBinary(m_Build.cachePath);
+    std::cout << "PROGRAM BUILT: " << m_Build.path << " (" << (glfwGetTime() - m_Build.start) * 1000.0 << " ms)\n";
+    m_Build = PendingBuild();
+}
+
+
+bool Shader::loadProgramBinary(const std::string& cache_path)
+{
+    std::ifstream file(cache_path, std::ios::binary);
+    if (!file)
+        return false;
+
+    std::string blob((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ProgramBinaryHeader header;
+    if (blob.size() <= sizeof(header))
+        return false;
+    memcpy(&header, blob.data(), sizeof(header));
+    if (header.magic != PROGRAM_BINARY_MAGIC)
+        return false;
+
+    glProgramBinary(m_ProgramId, header.format, blob.data() + sizeof(header), GLsizei(blob.size() - sizeof(header)));
+    GLint success = 0;
+    glGetProgramiv(m_ProgramId, GL_LINK_STATUS, &success);
+    if (success)
+        return true;
+
+    // Driver updates invalidate binaries, start over with a clean program
+    std::cout << "PROGRAM CACHE REJECTED: " << cache_path << "\n";
+    glDeleteProgram(m_ProgramId);
+    m_ProgramId = glCreateProgram();
+    return false;
+}
+
+
+void Shader::saveProgramBinary(const std::string& cache_path) const
+{
+    GLint success = 0, length = 0;
+    glGetProgramiv(m_ProgramId, GL_LINK_STATUS, &success);
+    glGetProgramiv(m_ProgramId, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!success || length <= 0)
+        return;
+
+    ProgramBinaryHeader header = { PROGRAM_BINARY_MAGIC, 0 };
+    std::vector<char> binary(length);
+    glGetProgramBinary(m_ProgramId, length, nullptr, &header.format, binary.data());
+
+    makeDirectory(cacheDirectory);
+    std::ofstream file(cache_path, std::ios::binary);
+    file.write((const char*)&header, sizeof(header));
+    file.write(binary.data(), length);
+}
+
+
+unsigned int Shader::compileShader(const Stage& stage, unsigned int programId)
+{
+    std::cout << "COMPILING SHADER: " << stage.path << "\n";
+    const char* src = stage.source.c_str();
+    const char* type = stage.type;
 
     // 1) Create the right shader object
     GLuint shader = 0;
@@ -101,17 +344,16 @@ void Shader::compileShader(const char* shader_path,
     else if (strcmp(type, "COMPUTE") == 0) shader = glCreateShader(GL_COMPUTE_SHADER);
     else {
         std::cerr << "ERROR: Invalid shader type: " << type << "\n";
-        return;
+        return 0;
     }
 
-    // 2) Compile
+    // 2) Compile, errors are checked after linking so the driver can work in the background
     glShaderSource(shader, 1, &src, nullptr);
     glCompileShader(shader);
-    checkCompileErrors(shader, type, shader_path);
 
-    // 3) Attach and then delete the shader object
+    // 3) Attach, the shader object is deleted by finishProgram()
     glAttachShader(programId, shader);
-    glDeleteShader(shader);
+    return shader;
 }
 
 Shader::Shader() = default;
@@ -168,9 +410,9 @@ void Shader::setInt(const std::string& name, const int value) const
 
 void Shader::setUInt(const std::string& name, const unsigned int value) const
 {
-    // Set the value of the uniform
+    // Set the value of the uniform, glUniform1i fails on a uint uniform
     glUseProgram(m_ProgramId);
-    glUniform1i(checkUniformLocation(name), value);
+    glUniform1ui(checkUniformLocation(name), value);
 }
 
 void Shader::setFloat(const std::string& name, const float value) const
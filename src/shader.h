@@ -9,6 +9,8 @@
 #include <string>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstdint>
+#include <atomic>
 #include <gl/GL.h>
 
 class Shader
@@ -18,11 +20,31 @@ public:
     unsigned int m_ProgramId;
     std::vector<std::string> filePaths;
 
+    // Linked program binaries are kept here between runs, empty disables the cache
+    static std::string cacheDirectory;
+    // Read sources from the embedded bundle (ShaderBundle.h), false reads the files on disk
+    static bool useBundle;
+    // Programs loaded from the cache and programs compiled from source since startup
+    static std::atomic<int> cacheHits;
+    static std::atomic<int> cacheMisses;
+    // Set when the driver compiles in the background (GL_KHR_parallel_shader_compile)
+    static bool parallelCompile;
+
 
     // constructor reads and builds the shader
     Shader(const char* vertex_path, const char* fragment_path);
     Shader(const char* compute_path);
+    // compute program with extra #define lines inserted after the #version line
+    Shader(const char* compute_path, const std::string& defines);
     Shader();
+
+    // Starts building a compute program without waiting for the driver, poll isReady() before use
+    static Shader beginCompute(const char* compute_path, const std::string& defines);
+    // True once the program is linked and checked. Only returns false with parallelCompile,
+    // otherwise it waits for the driver.
+    bool isReady();
+    // Link status, valid once isReady()
+    bool isLinked() const;
     // use/activate the shader
     void use();
     // utility uniform functions
@@ -36,7 +58,36 @@ public:
     void setVec3(const std::string& name, float x, float y, float z) const;
 
 private:
+    struct Stage {
+        std::string source;     // with defines inserted
+        const char* path;
+        const char* type;       // "VERTEX", "FRAGMENT" or "COMPUTE"
+    };
+
+    // Shaders of a build that has been linked but not checked yet
+    struct PendingBuild {
+        std::vector<unsigned int> shaders;
+        std::vector<std::string> types;
+        std::string path;
+        std::string cachePath;
+        double start = 0.0;
+        bool active = false;
+    };
+    PendingBuild m_Build;
+
+    // Loads the program from the binary cache, or compiles, links and stores it.
+    // Without wait the checks are left to isReady().
+    void buildProgram(const std::vector<Stage>& stages, bool wait);
+    void finishProgram();
+    bool loadProgramBinary(const std::string& cache_path);
+    void saveProgramBinary(const std::string& cache_path) const;
+
     void checkCompileErrors(const unsigned int id, const std::string& type, const std::string& path);
-    void compileShader(const char* shader_path, const char* type, unsigned int program_id);
+    unsigned int compileShader(const Stage& stage, unsigned int program_id);
     GLint checkUniformLocation(const std::string& name) const;
-};
\ No newline at end of file
+};
+
+// Re-reads the include files on disk and registers them again, for hot reload
+void reloadIncludes();
+// File behind a virtual include name such as "/ray.glsl", empty when it is not registered
+std::string includeFilePath(const std::string& name);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <random>
 
 // Returns a random float in range [0, 1)
@@ -25,6 +26,29 @@ inline glm::vec3 random_vec(float min, float max) {
     return glm::vec3(random_float(min, max), random_float(min, max), random_float(min, max));
 }
 
+// Integer hash (lowbias32), the same as hash_u32() in utilities.glsl
+inline uint32_t hash_u32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Counter based random float in [0,1): depends on its arguments only, so a sample draws the
+// same numbers whichever thread traces it and in whatever order. Same as sample_float() in
+// utilities.glsl, which gets the uSeedBits uniform as seed.
+inline float sample_float(uint32_t seed, glm::ivec2 pixel, uint32_t sample, uint32_t bounce, uint32_t dimension) {
+    uint32_t h = hash_u32(dimension);
+    h = hash_u32(h ^ bounce);
+    h = hash_u32(h ^ sample);
+    h = hash_u32(h ^ uint32_t(pixel.y));
+    h = hash_u32(h ^ uint32_t(pixel.x));
+    h = hash_u32(h ^ seed);
+    return float(h >> 8) * (1.f / 16777216.f);
+}
+
 // Fills an array of floats with random values
 inline void set_urandom(std::vector<float>& in) {
     for (int i = 0; i < in.size(); i++) {
@@ -0,0 +1,162 @@
+"""Resolves the #include directives of the shader programs and writes them, compressed,
+into a C++ source that is compiled into the executable (see src/ShaderBundle.h).
+
+    python tools/bundle_shaders.py <shaders dir> <output .inl>
+
+Runs as a pre-build step. The output is only rewritten when its content changes.
+"""
+
+import os
+import re
+import sys
+
+# Programs loaded by Shader, relative to the working directory of the executable
+PROGRAMS = ["shaders/source/comp.glsl", "shaders/source/vert.glsl", "shaders/source/frag.glsl"]
+
+# Directories searched for "/name" includes, same names loadIncludes() registers
+INCLUDE_DIRS = ["include", "source/implementations"]
+
+INCLUDE_RE = re.compile(r'^\s*#include\s+"([^"]+)"')
+EXTENSION_RE = re.compile(r"^\s*#extension\s+GL_ARB_shading_language_include\b")
+GUARD_RE = re.compile(r"^\s*#ifndef\s+\w+\s*$")
+
+MIN_MATCH = 4
+MAX_MATCH = 127 + MIN_MATCH
+MAX_LITERALS = 128
+WINDOW = 65535
+
+
+def fnv1a64(data):
+    h = 14695981039346656037
+    for b in data:
+        h = ((h ^ b) * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+def find_include(shaders_dir, name):
+    for d in INCLUDE_DIRS:
+        path = os.path.join(shaders_dir, d, name.lstrip("/"))
+        if os.path.isfile(path):
+            return path
+    raise SystemExit("bundle_shaders: include %s not found" % name)
+
+
+def is_guarded(lines):
+    for line in lines:
+        if line.strip():
+            return GUARD_RE.match(line) is not None
+    return False
+
+
+def resolve(shaders_dir, path, stack, guarded_done, out):
+    """Inline the includes of path the way the driver would. Guarded headers are
+    emitted once, they would preprocess to nothing the second time."""
+    with open(path, encoding="latin-1") as f:
+        lines = f.read().splitlines()
+
+    for line in lines:
+        m = INCLUDE_RE.match(line)
+        if m:
+            inc = find_include(shaders_dir, m.group(1))
+            if inc in stack or inc in guarded_done:
+                continue
+            with open(inc, encoding="latin-1") as f:
+                if is_guarded(f.read().splitlines()):
+                    guarded_done.add(inc)
+            resolve(shaders_dir, inc, stack + [inc], guarded_done, out)
+        elif EXTENSION_RE.match(line):
+            continue
+        else:
+            out.append(line)
+
+
+def compress(data):
+    """LZ77, decoded by decompress() in ShaderBundle.cpp. A tag byte below 0x80 is followed
+    by tag + 1 literal bytes, otherwise it is a match of tag - 0x80 + 4 bytes copied from a
+    little endian 16 bit distance back."""
+    out = bytearray()
+    literals = bytearray()
+    chains = {}
+    i = 0
+
+    def flush():
+        while literals:
+            run = literals[:MAX_LITERALS]
+            out.append(len(run) - 1)
+            out.extend(run)
+            del literals[:MAX_LITERALS]
+
+    while i < len(data):
+        best_len, best_dist = 0, 0
+        key = bytes(data[i:i + MIN_MATCH])
+        if len(key) == MIN_MATCH:
+            for j in reversed(chains.get(key, [])):
+                if i - j > WINDOW:
+                    break
+                n = MIN_MATCH
+                while n < MAX_MATCH and i + n < len(data) and data[j + n] == data[i + n]:
+                    n += 1
+                if n > best_len:
+                    best_len, best_dist = n, i - j
+                    if n == MAX_MATCH:
+                        break
+
+        step = best_len if best_len >= MIN_MATCH else 1
+        for k in range(i, i + step):
+            chain = chains.setdefault(bytes(data[k:k + MIN_MATCH]), [])
+            chain.append(k)
+            if len(chain) > 64:
+                del chain[0]
+
+        if best_len >= MIN_MATCH:
+            flush()
+            out.append(0x80 + best_len - MIN_MATCH)
+            out.append(best_dist & 0xFF)
+            out.append(best_dist >> 8)
+        else:
+            literals.append(data[i])
+        i += step
+
+    flush()
+    return bytes(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        raise SystemExit(__doc__)
+    shaders_dir, output = sys.argv[1], sys.argv[2]
+    root = os.path.dirname(os.path.abspath(shaders_dir))
+
+    entries = []
+    body = ["// Generated by tools/bundle_shaders.py, do not edit", ""]
+    for index, program in enumerate(PROGRAMS):
+        path = os.path.join(root, program)
+        lines = []
+        resolve(shaders_dir, path, [path], set(), lines)
+        source = ("\n".join(lines) + "\n").encode("latin-1")
+        packed = compress(source)
+
+        body.append("static const unsigned char bundle_data_%d[] = {" % index)
+        for k in range(0, len(packed), 20):
+            body.append("    " + ", ".join("0x%02x" % b for b in packed[k:k + 20]) + ",")
+        body.append("};")
+        entries.append('    { "%s", 0x%016xull, %d, bundle_data_%d, sizeof(bundle_data_%d) },'
+                       % (program, fnv1a64(source), len(source), index, index))
+        print("bundle_shaders: %s %d -> %d bytes" % (program, len(source), len(packed)))
+
+    body.append("")
+    body.append("static const BundledShader bundled_shaders[] = {")
+    body.extend(entries)
+    body.append("};")
+    text = "\n".join(body) + "\n"
+
+    if os.path.isfile(output):
+        with open(output) as f:
+            if f.read() == text:
+                return
+    with open(output, "w") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,358 @@
+"""Compiles the shader programs and their variants to SPIR-V with glslang and reports static
+statistics per function, so shader changes can be weighed on a machine without a GPU.
+
+    python tools/shader_stats.py [--shaders DIR] [--glslang PATH] [--function NAME]
+                                 [--threshold PERCENT] [--update-baseline]
+
+For every function: instruction count, calls, deepest loop nest, words of local variables
+and an estimate of the 32 bit registers it keeps live. "chain" adds the registers of the
+deepest call chain below it, glslang does not inline, drivers do. The numbers come from
+unoptimized glslang output and are only meant to be compared with each other.
+
+Functions are compared with tools/shader_stats_baseline.json. Growth of instructions or
+registers by more than the threshold (default 5%), or a deeper loop nest, is reported as a
+regression and the exit code is 1, as is a missing baseline or a variant missing from it.
+--update-baseline writes the current numbers instead.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from bundle_shaders import resolve
+
+BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "shader_stats_baseline.json")
+
+# Name -> (program, #define lines). The specialized variants are the ones ShaderVariants
+# builds for the default GUI settings, with every and with only the cheapest scene contents.
+VARIANTS = [
+    ("comp", "source/comp.glsl", ""),
+    ("comp.spp5.depth10", "source/comp.glsl",
+     "#define VARIANT_SAMPLES 5\n#define VARIANT_MAX_DEPTH 10\n"),
+    ("comp.spp5.depth10.lambertian.spheres", "source/comp.glsl",
+     "#define VARIANT_SAMPLES 5\n#define VARIANT_MAX_DEPTH 10\n"
+     "#define VARIANT_MATERIALS 1\n#define VARIANT_PRIMITIVES 1\n"),
+    ("vert", "source/vert.glsl", ""),
+    ("frag", "source/frag.glsl", ""),
+]
+
+STAGES = {"comp.glsl": "comp", "vert.glsl": "vert", "frag.glsl": "frag"}
+
+# SPIR-V opcodes
+OP_NAME = 5
+OP_LINE = 8
+OP_EXT_INST = 12
+OP_TYPE_VOID = 19
+OP_TYPE_BOOL = 20
+OP_TYPE_INT = 21
+OP_TYPE_FLOAT = 22
+OP_TYPE_VECTOR = 23
+OP_TYPE_MATRIX = 24
+OP_TYPE_ARRAY = 28
+OP_TYPE_STRUCT = 30
+OP_TYPE_POINTER = 32
+OP_CONSTANT = 43
+OP_FUNCTION = 54
+OP_FUNCTION_PARAMETER = 55
+OP_FUNCTION_END = 56
+OP_FUNCTION_CALL = 57
+OP_VARIABLE = 59
+OP_LOAD = 61
+OP_STORE = 62
+OP_VECTOR_SHUFFLE = 79
+OP_COMPOSITE_EXTRACT = 81
+OP_COMPOSITE_INSERT = 82
+OP_IMAGE_READ = 98
+OP_IMAGE_WRITE = 99
+OP_LOOP_MERGE = 246
+OP_SELECTION_MERGE = 247
+OP_LABEL = 248
+OP_SWITCH = 251
+OP_NO_LINE = 317
+STORAGE_FUNCTION = 7
+
+# Instructions in a function body without a result type and id
+NO_RESULT = {0, OP_LINE, OP_STORE, 63, 64, OP_IMAGE_WRITE, 218, 219, 224, 225, 228, OP_LOOP_MERGE,
+             OP_SELECTION_MERGE, 249, 250, OP_SWITCH, 252, 253, 254, 255, OP_NO_LINE, 4416, 5380}
+
+# Not counted as instructions
+STRUCTURAL = {OP_LINE, OP_NO_LINE, OP_LABEL, OP_FUNCTION_PARAMETER, OP_LOOP_MERGE,
+              OP_SELECTION_MERGE, OP_VARIABLE}
+
+# Operands that are ids, for instructions that mix ids and literals. Literals such as line
+# numbers and masks would otherwise stretch the value whose id they happen to equal
+ID_OPERANDS = {OP_LINE: 0, OP_FUNCTION: 0, OP_LOAD: 1, OP_STORE: 2, OP_VECTOR_SHUFFLE: 2, OP_COMPOSITE_EXTRACT: 1,
+               OP_COMPOSITE_INSERT: 2, OP_SWITCH: 1, OP_LOOP_MERGE: 2, OP_SELECTION_MERGE: 1,
+               OP_IMAGE_READ: 2, OP_IMAGE_WRITE: 3, OP_VARIABLE: 0}
+
+
+def find_glslang(path):
+    for name in ([path] if path else ["glslangValidator", "glslang"]):
+        found = shutil.which(name)
+        if found:
+            return found
+    raise SystemExit("shader_stats: glslangValidator not found, pass --glslang")
+
+
+def compile_spirv(glslang, shaders_dir, program, defines):
+    """Resolved source with the defines inserted after #version, like Shader does"""
+    path = os.path.join(shaders_dir, program)
+    lines = []
+    resolve(shaders_dir, path, [path], set(), lines)
+    if defines:
+        lines[1:1] = defines.rstrip("\n").split("\n")
+    stage = STAGES[os.path.basename(program)]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        source = os.path.join(tmp, "shader." + stage)
+        output = os.path.join(tmp, "shader.spv")
+        with open(source, "w", encoding="latin-1") as f:
+            f.write("\n".join(lines) + "\n")
+
+        # OpenGL semantics, loose uniforms get locations and bindings assigned
+        run = subprocess.run([glslang, "-G", "--aml", "--amb", "-o", output, source],
+                             capture_output=True, text=True)
+        if run.returncode != 0:
+            raise SystemExit("shader_stats: %s failed\n%s" % (program, run.stdout + run.stderr))
+        with open(output, "rb") as f:
+            data = f.read()
+    return struct.unpack("<%dI" % (len(data) // 4), data)
+
+
+def instructions(words):
+    i = 5
+    while i < len(words):
+        count, opcode = words[i] >> 16, words[i] & 0xFFFF
+        if count == 0:
+            raise SystemExit("shader_stats: malformed SPIR-V")
+        yield opcode, words[i + 1:i + count]
+        i += count
+
+
+def string_operand(operands):
+    raw = struct.pack("<%dI" % len(operands), *operands)
+    return raw.split(b"\0", 1)[0].decode("utf-8", "replace")
+
+
+class Module:
+    def __init__(self, words):
+        self.names = {}
+        self.sizes = {}         # type id -> 32 bit words
+        self.constants = {}
+        self.pointee = {}       # pointer type id -> (storage class, type id)
+        self.functions = []     # (id, [(opcode, operands)])
+
+        body = None
+        for opcode, ops in instructions(words):
+            if opcode == OP_NAME:
+                self.names[ops[0]] = string_operand(ops[1:])
+            elif opcode == OP_TYPE_VOID:
+                self.sizes[ops[0]] = 0
+            elif opcode == OP_TYPE_BOOL:
+                self.sizes[ops[0]] = 1
+            elif opcode in (OP_TYPE_INT, OP_TYPE_FLOAT):
+                self.sizes[ops[0]] = max(1, ops[1] // 32)
+            elif opcode in (OP_TYPE_VECTOR, OP_TYPE_MATRIX):
+                self.sizes[ops[0]] = self.sizes.get(ops[1], 1) * ops[2]
+            elif opcode == OP_TYPE_ARRAY:
+                self.sizes[ops[0]] = self.sizes.get(ops[1], 1) * self.constants.get(ops[2], 1)
+            elif opcode == OP_TYPE_STRUCT:
+                self.sizes[ops[0]] = sum(self.sizes.get(member, 1) for member in ops[1:])
+            elif opcode == OP_TYPE_POINTER:
+                self.pointee[ops[0]] = (ops[1], ops[2])
+                self.sizes[ops[0]] = 0
+            elif opcode == OP_CONSTANT:
+                self.constants[ops[1]] = ops[2]
+            elif opcode == OP_FUNCTION:
+                body = []
+                self.functions.append((ops[1], body))
+            elif opcode == OP_FUNCTION_END:
+                body = None
+
+            if body is not None:
+                body.append((opcode, ops))
+
+    def name(self, function_id):
+        return self.names.get(function_id, "%%%d" % function_id)
+
+
+def function_stats(module, body):
+    """Counts and a linear scan liveness estimate. A value is live from its definition to its
+    last use, stretched to the end of every loop it is used in but defined before. Function
+    variables are counted as registers too, drivers promote them."""
+    position = {}
+    size = {}
+    last_use = {}
+    loops = []              # (header position, merge label id)
+    labels = {}
+    calls = []              # (position, callee id)
+    stats = {"instructions": 0, "calls": 0, "loop_depth": 0, "locals": 0}
+    open_merges = []
+    header = 0
+
+    for pos, (opcode, ops) in enumerate(body):
+        if opcode not in STRUCTURAL and opcode not in (OP_FUNCTION, OP_FUNCTION_END):
+            stats["instructions"] += 1
+
+        if opcode == OP_LABEL:
+            labels[ops[0]] = pos
+            header = pos
+            if ops[0] in open_merges:
+                del open_merges[open_merges.index(ops[0]):]
+            continue
+        if opcode == OP_LOOP_MERGE:
+            loops.append((header, ops[0]))
+            open_merges.append(ops[0])
+            stats["loop_depth"] = max(stats["loop_depth"], len(open_merges))
+        if opcode == OP_FUNCTION_CALL:
+            stats["calls"] += 1
+            calls.append((pos, ops[2]))
+
+        if opcode in NO_RESULT or opcode == OP_FUNCTION_END:
+            uses = ops[:ID_OPERANDS.get(opcode, len(ops))]
+        else:
+            result_type, result = ops[0], ops[1]
+            position[result] = pos
+            last_use[result] = pos
+            if opcode == OP_VARIABLE and ops[2] == STORAGE_FUNCTION:
+                words = module.sizes.get(module.pointee.get(result_type, (0, 0))[1], 1)
+                size[result] = words
+                stats["locals"] += words
+            elif opcode != OP_FUNCTION:
+                size[result] = module.sizes.get(result_type, 1)
+
+            uses = ops[2:]
+            if opcode == OP_EXT_INST:
+                uses = ops[4:]
+            elif opcode in ID_OPERANDS:
+                uses = ops[2:2 + ID_OPERANDS[opcode]]
+            elif opcode == OP_FUNCTION_CALL:
+                uses = ops[3:]
+
+        for used in uses:
+            if used in size:
+                last_use[used] = max(last_use[used], pos)
+
+    # Inner loops first so a value used in a nested loop is stretched through the outer one
+    spans = sorted((labels[merge], start) for start, merge in loops if merge in labels)
+    for end, start in sorted(spans, key=lambda span: span[0] - span[1]):
+        for value, defined in position.items():
+            if value in size and defined < start and start <= last_use[value] < end:
+                last_use[value] = end
+
+    live = [0] * (len(body) + 1)
+    for value, words in size.items():
+        for pos in range(position[value], last_use[value] + 1):
+            live[pos] += words
+    stats["registers"] = max(live) if live else 0
+    return stats, live, calls
+
+
+def program_stats(words):
+    module = Module(words)
+    per_function = {}
+    details = {}
+    for function_id, body in module.functions:
+        stats, live, calls = function_stats(module, body)
+        details[function_id] = (live, calls)
+        per_function[function_id] = stats
+
+    # Registers along the deepest call chain, as if the callees were inlined
+    chain = {}
+
+    def chain_of(function_id):
+        if function_id not in chain:
+            chain[function_id] = per_function[function_id]["registers"]
+            live, calls = details[function_id]
+            for pos, callee in calls:
+                if callee in per_function:
+                    chain[function_id] = max(chain[function_id], live[pos] + chain_of(callee))
+        return chain[function_id]
+
+    result = {}
+    for function_id, stats in per_function.items():
+        stats["chain"] = chain_of(function_id)
+        result[module.name(function_id)] = stats
+    return result
+
+
+def regressions(current, baseline, threshold):
+    found = []
+    for name, stats in current.items():
+        old = baseline.get(name)
+        if old is None:
+            continue
+        for key in ("instructions", "registers", "chain"):
+            if stats[key] > old[key] * (1.0 + threshold / 100.0) and stats[key] - old[key] > 1:
+                found.append("%s: %s %d -> %d" % (name, key, old[key], stats[key]))
+        if stats["loop_depth"] > old["loop_depth"]:
+            found.append("%s: loop depth %d -> %d" % (name, old["loop_depth"], stats["loop_depth"]))
+    return found
+
+
+def print_table(variant, stats, baseline, only):
+    print("%s" % variant)
+    print("  %-44s %6s %5s %5s %6s %5s %5s" % ("function", "instr", "calls", "loops", "locals", "regs", "chain"))
+    for name in sorted(stats, key=lambda n: -stats[n]["instructions"]):
+        if only and only not in name:
+            continue
+        s = stats[name]
+        delta = ""
+        old = baseline.get(name)
+        if old is not None and old["instructions"] != s["instructions"]:
+            delta = "  (%+d instr)" % (s["instructions"] - old["instructions"])
+        print("  %-44s %6d %5d %5d %6d %5d %5d%s" % (name[:44], s["instructions"], s["calls"],
+              s["loop_depth"], s["locals"], s["registers"], s["chain"], delta))
+    print()
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--shaders", default=os.path.join(root, "shaders"))
+    parser.add_argument("--glslang")
+    parser.add_argument("--function", help="only list functions whose name contains this")
+    parser.add_argument("--threshold", type=float, default=5.0)
+    parser.add_argument("--update-baseline", action="store_true")
+    args = parser.parse_args()
+
+    glslang = find_glslang(args.glslang)
+    baseline = {}
+    if os.path.isfile(BASELINE):
+        with open(BASELINE) as f:
+            baseline = json.load(f)
+
+    current = {}
+    found = []
+    for variant, program, defines in VARIANTS:
+        current[variant] = program_stats(compile_spirv(glslang, args.shaders, program, defines))
+        print_table(variant, current[variant], baseline.get(variant, {}), args.function)
+        if baseline and variant not in baseline:
+            found.append("%s: not in the baseline" % variant)
+        found += ["%s %s" % (variant, line)
+                  for line in regressions(current[variant], baseline.get(variant, {}), args.threshold)]
+
+    if args.update_baseline:
+        with open(BASELINE, "w") as f:
+            json.dump(current, f, indent=1, sort_keys=True)
+            f.write("\n")
+        print("shader_stats: baseline written to %s" % BASELINE)
+        return 0
+
+    # Without a baseline nothing is compared, which must not pass as a clean run
+    if not baseline:
+        print("shader_stats: no baseline at %s, run with --update-baseline to create one" % BASELINE)
+        return 1
+    for line in found:
+        print("REGRESSION " + line)
+    return 1 if found else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())